@@ -25,6 +25,8 @@
 #include <iostream>
 #include <string>
 #include "opencv2/opencv.hpp"
+#include "opencv_task_pool.h"
+#include "task_pool.h"
 
 // configuration parameters
 #define NUM_COMNMAND_LINE_ARGUMENTS 1
@@ -42,13 +44,23 @@ int main(int argc, char **argv)
     cv::Mat imageIn;
 
     // validate and parse the command line arguments
-    if(argc != NUM_COMNMAND_LINE_ARGUMENTS + 1)
+    PoolConfig poolConfig;
+    bool validArguments = argc > NUM_COMNMAND_LINE_ARGUMENTS;
+    for(int i = NUM_COMNMAND_LINE_ARGUMENTS + 1; validArguments && i < argc; i++)
     {
-        std::printf("USAGE: %s <image_path> \n", argv[0]);
+        validArguments = parsePoolOption(argc, argv, i, poolConfig);
+    }
+    if(!validArguments)
+    {
+        std::printf("USAGE: %s <image_path> %s \n", argv[0], poolOptionsUsage());
         return 0;
     }
     else
     {
+        // run the parallel loops of the application and of OpenCV on the same threads
+        TaskPool::configureGlobal(poolConfig);
+        useTaskPoolInOpenCV();
+
         imageIn = cv::imread(argv[1], cv::IMREAD_COLOR);
 
         // check for file error
@@ -98,13 +110,16 @@ int main(int argc, char **argv)
         cv::drawContours(imageContours, contours, i, color);
     }
 
-    // compute minimum area bounding rectangles
+    // compute minimum area bounding rectangles, a range of contours per task
     std::vector<cv::RotatedRect> minAreaRectangles(contours.size());
-    for(int i = 0; i < contours.size(); i++)
+    TaskPool::global().parallelFor(0, contours.size(), 16, [&](size_t begin, size_t end)
     {
-        // compute a minimum area bounding rectangle for the contour
-        minAreaRectangles[i] = cv::minAreaRect(contours[i]);
-    }
+        for(size_t i = begin; i < end; i++)
+        {
+            // compute a minimum area bounding rectangle for the contour
+            minAreaRectangles[i] = cv::minAreaRect(contours[i]);
+        }
+    });
 
     // draw the rectangles
     cv::Mat imageRectangles = cv::Mat::zeros(imageEdges.size(), CV_8UC3);
@@ -119,16 +134,19 @@ int main(int argc, char **argv)
         }
     }
 
-    // fit ellipses to contours containing sufficient inliers
+    // fit ellipses to contours containing sufficient inliers, a range of contours per task
     std::vector<cv::RotatedRect> fittedEllipses(contours.size());
-    for(int i = 0; i < contours.size(); i++)
+    TaskPool::global().parallelFor(0, contours.size(), 16, [&](size_t begin, size_t end)
     {
-        // compute an ellipse only if the contour has more than 5 points (the minimum for ellipse fitting)
-        if(contours.at(i).size() > 5)
+        for(size_t i = begin; i < end; i++)
         {
-            fittedEllipses[i] = cv::fitEllipse(contours[i]);
+            // compute an ellipse only if the contour has more than 5 points (the minimum for ellipse fitting)
+            if(contours.at(i).size() > 5)
+            {
+                fittedEllipses[i] = cv::fitEllipse(contours[i]);
+            }
         }
-    }
+    });
 
     // draw the ellipses
     cv::Mat imageEllipse = cv::Mat::zeros(imageEdges.size(), CV_8UC3);
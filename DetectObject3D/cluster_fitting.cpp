@@ -0,0 +1,136 @@
+/***********************************************************************************************************************
+* @file cluster_fitting.cpp
+* @brief classifies object clusters by fitting sphere and box primitives in parallel
+**********************************************************************************************************************/
+
+#include "cluster_fitting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include "geometry_kernels.h"
+#include "task_pool.h"
+
+/*******************************************************************************************************************//**
+ * @brief Creates the default parameters, suited to objects of a few centimeters to a few decimeters
+ **********************************************************************************************************************/
+ClusterFitParams::ClusterFitParams():
+    distanceThreshold(0.01), minRadius(0.02), maxRadius(0.30), maxFaces(3), minFaceRatio(0.10), minCoverage(0.80),
+    maxHeight(0.20), maxIterations(1000), numThreads(0)
+{
+}
+
+ClusterFit::ClusterFit():
+    isObject(false), type(BOX), height(0), sphereInlierRatio(0), sphereRmse(0), boxInlierRatio(0), boxRmse(0)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Fits the primitives to a single cluster
+ * @param[in] cloud input point cloud
+ * @param[in] indices point indices of the cluster
+ * @param[in] tablePlane coefficients of the table plane
+ * @param[in] params classification parameters
+ * @param[in] seed random seed of the RANSAC searches
+ * @param[out] fit fitted primitives and classification
+ **********************************************************************************************************************/
+static void fitCluster(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> &indices,
+    const std::vector<float> &tablePlane, const ClusterFitParams &params, unsigned int seed, ClusterFit &fit)
+{
+    fit = ClusterFit();
+    if(indices.empty())
+    {
+        return;
+    }
+
+    // mean distance of the cluster to the table, clusters far from the table are not objects on it
+    std::vector<float> distances(indices.size());
+    planeDistancesIndexed(&cloud.points[0].x, POINT_STRIDE, indices.data(), indices.size(), tablePlane.data(),
+        distances.data());
+    fit.height = maskedStats(distances.data(), NULL, distances.size()).mean();
+    fit.isObject = fit.height < params.maxHeight;
+    if(!fit.isObject)
+    {
+        return;
+    }
+
+    // each cluster is one task, so the searches run single threaded
+    RansacParams ransacParams;
+    ransacParams.distanceThreshold = params.distanceThreshold;
+    ransacParams.maxIterations = params.maxIterations;
+    ransacParams.numThreads = 1;
+    ransacParams.seed = seed;
+    const double total = static_cast<double>(indices.size());
+
+    // sphere
+    ransacParams.minRadius = params.minRadius;
+    ransacParams.maxRadius = params.maxRadius;
+    RansacResult result;
+    if(ransacSegment(cloud, &indices, SPHERE, ransacParams, result))
+    {
+        fit.sphere = result.coefficients;
+        fit.sphereInlierRatio = result.inliers.size() / total;
+        fit.sphereRmse = result.rmse;
+    }
+
+    // box faces, each one fitted on the points left unexplained by the previous faces
+    ransacParams.minRadius = 0;
+    ransacParams.maxRadius = 0;
+    std::vector<int> remaining(indices);
+    std::vector<int> rest;
+    double squares = 0;
+    size_t explained = 0;
+    for(int f = 0; f < params.maxFaces; f++)
+    {
+        if(!ransacSegment(cloud, &remaining, BOX, ransacParams, result) ||
+            result.inliers.size() < params.minFaceRatio * total)
+        {
+            break;
+        }
+        fit.faces.push_back(result.coefficients);
+        squares += result.rmse * result.rmse * result.inliers.size();
+        explained += result.inliers.size();
+
+        // both lists are in increasing order of position in the cluster
+        rest.clear();
+        std::set_difference(remaining.begin(), remaining.end(), result.inliers.begin(), result.inliers.end(),
+            std::back_inserter(rest));
+        remaining.swap(rest);
+    }
+    fit.boxInlierRatio = explained / total;
+    fit.boxRmse = explained > 0 ? std::sqrt(squares / explained) : 0.0;
+
+    // a primitive qualifies if it explains most of the cluster, the tighter fit wins between qualifying primitives
+    const bool sphereQualifies = fit.sphereInlierRatio >= params.minCoverage;
+    const bool boxQualifies = fit.boxInlierRatio >= params.minCoverage;
+    if(sphereQualifies && boxQualifies)
+    {
+        fit.type = fit.sphereRmse < fit.boxRmse ? SPHERE : BOX;
+    }
+    else
+    {
+        fit.type = sphereQualifies || (!boxQualifies && fit.sphereInlierRatio > fit.boxInlierRatio) ? SPHERE : BOX;
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Classifies clusters as boxes or spheres, one parallel task per cluster
+ *
+ * Tasks are handed out dynamically, so a few large clusters do not hold back the others.
+ *
+ * @param[in] cloud input point cloud
+ * @param[in] clusters point indices of each cluster, in increasing order
+ * @param[in] tablePlane coefficients of the table plane
+ * @param[in] params classification parameters
+ * @param[out] fits fitted primitives and classification of each cluster
+ **********************************************************************************************************************/
+void fitClusters(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<pcl::PointIndices> &clusters,
+    const std::vector<float> &tablePlane, const ClusterFitParams &params, std::vector<ClusterFit> &fits)
+{
+    fits.assign(clusters.size(), ClusterFit());
+    parallelTasks(params.numThreads, clusters.size(), [&](size_t task, int)
+    {
+        fitCluster(cloud, clusters[task].indices, tablePlane, params, 12345u + static_cast<unsigned int>(task),
+            fits[task]);
+    });
+}
@@ -0,0 +1,62 @@
+/***********************************************************************************************************************
+* @file cluster_fitting.h
+* @brief classifies object clusters by fitting sphere and box primitives in parallel
+*
+* Each cluster is an independent task. A sphere is fitted with RANSAC, and a box is approximated by up to three
+* planar faces fitted one after the other on the remaining points. A primitive qualifies when it explains most of the
+* cluster; a few planes can cover a small sphere within the threshold, so between qualifying primitives the one with
+* the lower residual decides the classification.
+**********************************************************************************************************************/
+
+#ifndef DETECT_CLUSTER_FITTING_H
+#define DETECT_CLUSTER_FITTING_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include "ransac.h"
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of the cluster classification
+ **********************************************************************************************************************/
+struct ClusterFitParams
+{
+    double distanceThreshold;
+    double minRadius;
+    double maxRadius;
+    int maxFaces;
+    double minFaceRatio;
+    double minCoverage;
+    double maxHeight;
+    int maxIterations;
+    int numThreads;
+
+    ClusterFitParams();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Fitted primitives and classification of one cluster
+ *
+ * The inlier ratios are the shares of the cluster within the distance threshold of the sphere, or of any box face.
+ **********************************************************************************************************************/
+struct ClusterFit
+{
+    bool isObject;
+    TypeModel type;
+    double height;
+
+    std::vector<float> sphere;
+    double sphereInlierRatio;
+    double sphereRmse;
+
+    std::vector<std::vector<float> > faces;
+    double boxInlierRatio;
+    double boxRmse;
+
+    ClusterFit();
+};
+
+void fitClusters(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<pcl::PointIndices> &clusters,
+    const std::vector<float> &tablePlane, const ClusterFitParams &params, std::vector<ClusterFit> &fits);
+
+#endif
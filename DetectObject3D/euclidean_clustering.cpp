@@ -0,0 +1,319 @@
+/***********************************************************************************************************************
+* @file euclidean_clustering.cpp
+* @brief linear-time Euclidean clustering on a spatial hash
+**********************************************************************************************************************/
+
+#include "euclidean_clustering.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include "task_pool.h"
+
+// packing of the cell coordinates into a hash key
+static const int CELL_BITS = 21;
+static const uint64_t CELL_MASK = (uint64_t(1) << CELL_BITS) - 1;
+static const uint64_t EMPTY_KEY = ~uint64_t(0);
+
+/*******************************************************************************************************************//**
+ * @brief Open addressing hash table mapping cell keys to dense cell indices
+ **********************************************************************************************************************/
+class CellTable
+{
+    public:
+        explicit CellTable(size_t expectedCells)
+        {
+            size_t capacity = 16;
+            while(capacity < 2 * expectedCells)
+            {
+                capacity <<= 1;
+            }
+            _mask = capacity - 1;
+            _keys.assign(capacity, EMPTY_KEY);
+            _cells.assign(capacity, -1);
+        }
+
+        // gets the cell of a key, creating it if needed
+        int insert(uint64_t key, int nextCell)
+        {
+            size_t slot = hash(key);
+            while(_keys[slot] != EMPTY_KEY && _keys[slot] != key)
+            {
+                slot = (slot + 1) & _mask;
+            }
+            if(_keys[slot] == EMPTY_KEY)
+            {
+                _keys[slot] = key;
+                _cells[slot] = nextCell;
+            }
+            return _cells[slot];
+        }
+
+        // gets the cell of a key, or -1 if it holds no points
+        int find(uint64_t key) const
+        {
+            size_t slot = hash(key);
+            while(_keys[slot] != EMPTY_KEY)
+            {
+                if(_keys[slot] == key)
+                {
+                    return _cells[slot];
+                }
+                slot = (slot + 1) & _mask;
+            }
+            return -1;
+        }
+
+    private:
+        size_t hash(uint64_t key) const
+        {
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 20) & _mask;
+        }
+
+        size_t _mask;
+        std::vector<uint64_t> _keys;
+        std::vector<int> _cells;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Finds the representative of a set, halving the path on the way
+ **********************************************************************************************************************/
+static int findRoot(std::vector<std::atomic<int> > &parent, int x)
+{
+    int p = parent[x].load(std::memory_order_relaxed);
+    while(p != x)
+    {
+        int grandParent = parent[p].load(std::memory_order_relaxed);
+        if(grandParent != p)
+        {
+            parent[x].compare_exchange_weak(p, grandParent, std::memory_order_relaxed);
+        }
+        x = p;
+        p = parent[x].load(std::memory_order_relaxed);
+    }
+    return x;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Merges the sets of two elements, always linking the larger root below the smaller one
+ **********************************************************************************************************************/
+static void unite(std::vector<std::atomic<int> > &parent, int a, int b)
+{
+    while(true)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if(a == b)
+        {
+            return;
+        }
+        if(a < b)
+        {
+            std::swap(a, b);
+        }
+        int expected = a;
+        if(parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Packs cell coordinates into a hash key
+ **********************************************************************************************************************/
+static inline uint64_t cellKey(uint64_t ix, uint64_t iy, uint64_t iz)
+{
+    return (ix << (2 * CELL_BITS)) | (iy << CELL_BITS) | iz;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Groups the points of a cloud into clusters of points closer than a tolerance
+ *
+ * Non-finite points, such as the points removed by an organized ExtractIndices, are ignored. Clusters are returned
+ * with their indices in increasing order and sorted by decreasing size, like pcl::EuclideanClusterExtraction.
+ *
+ * @param[in] cloud input point cloud
+ * @param[in] tolerance maximum distance between two neighboring points of a cluster
+ * @param[in] minClusterSize minimum number of points of a cluster
+ * @param[in] maxClusterSize maximum number of points of a cluster
+ * @param[in] numThreads number of threads (0 for the threads of the process wide pool)
+ * @param[out] clusters point indices of each cluster
+ * @return false if the tolerance is too small for the extent of the cloud
+ **********************************************************************************************************************/
+bool euclideanClusters(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, float tolerance, int minClusterSize,
+    int maxClusterSize, int numThreads, std::vector<pcl::PointIndices> &clusters)
+{
+    clusters.clear();
+    if(tolerance <= 0)
+    {
+        return false;
+    }
+
+    // gather the finite points and their bounds
+    std::vector<int> points;
+    points.reserve(cloud.points.size());
+    float minBound[3] = {INFINITY, INFINITY, INFINITY};
+    float maxBound[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for(size_t i = 0; i < cloud.points.size(); i++)
+    {
+        const pcl::PointXYZRGBA &point = cloud.points[i];
+        if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+        {
+            continue;
+        }
+        points.push_back(static_cast<int>(i));
+        const float coordinates[3] = {point.x, point.y, point.z};
+        for(int k = 0; k < 3; k++)
+        {
+            minBound[k] = std::min(minBound[k], coordinates[k]);
+            maxBound[k] = std::max(maxBound[k], coordinates[k]);
+        }
+    }
+    if(points.empty())
+    {
+        return true;
+    }
+
+    // one cell margin on each side keeps the neighbor coordinates in range
+    const float inverseCell = 1.0f / tolerance;
+    for(int k = 0; k < 3; k++)
+    {
+        if((maxBound[k] - minBound[k]) * inverseCell + 2 >= float(CELL_MASK))
+        {
+            return false;
+        }
+    }
+
+    // compute the cell key of every point
+    const size_t numPoints = points.size();
+    std::vector<uint64_t> keys(numPoints);
+    parallelRanges(numThreads, numPoints, [&](size_t begin, size_t end, int)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            const pcl::PointXYZRGBA &point = cloud.points[points[i]];
+            keys[i] = cellKey(static_cast<uint64_t>((point.x - minBound[0]) * inverseCell) + 1,
+                static_cast<uint64_t>((point.y - minBound[1]) * inverseCell) + 1,
+                static_cast<uint64_t>((point.z - minBound[2]) * inverseCell) + 1);
+        }
+    });
+
+    // assign dense cell indices and bucket the points by cell (counting sort)
+    CellTable table(numPoints / 4 + 1);
+    std::vector<int> pointCell(numPoints);
+    std::vector<uint64_t> cellKeys;
+    std::vector<int> cellStart;
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        int cell = table.insert(keys[i], static_cast<int>(cellKeys.size()));
+        if(cell == static_cast<int>(cellKeys.size()))
+        {
+            cellKeys.push_back(keys[i]);
+            cellStart.push_back(0);
+        }
+        pointCell[i] = cell;
+        cellStart[cell]++;
+    }
+    std::vector<uint64_t>().swap(keys);
+    const size_t numCells = cellKeys.size();
+    int offset = 0;
+    for(size_t c = 0; c < numCells; c++)
+    {
+        int count = cellStart[c];
+        cellStart[c] = offset;
+        offset += count;
+    }
+    cellStart.push_back(offset);
+    std::vector<int> cellPoints(numPoints);
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        cellPoints[fill[pointCell[i]]++] = static_cast<int>(i);
+    }
+
+    // link every pair of neighbors; each pair of cells is visited once through the 13 forward neighbor offsets
+    std::vector<std::atomic<int> > parent(numPoints);
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        parent[i].store(static_cast<int>(i), std::memory_order_relaxed);
+    }
+    const float squaredTolerance = tolerance * tolerance;
+    parallelRanges(numThreads, numCells, [&](size_t begin, size_t end, int)
+    {
+        for(size_t c = begin; c < end; c++)
+        {
+            const uint64_t key = cellKeys[c];
+            const uint64_t ix = key >> (2 * CELL_BITS);
+            const uint64_t iy = (key >> CELL_BITS) & CELL_MASK;
+            const uint64_t iz = key & CELL_MASK;
+            for(int dx = 0; dx <= 1; dx++)
+            {
+                for(int dy = (dx == 0 ? 0 : -1); dy <= 1; dy++)
+                {
+                    for(int dz = (dx == 0 && dy == 0 ? 0 : -1); dz <= 1; dz++)
+                    {
+                        const bool sameCell = dx == 0 && dy == 0 && dz == 0;
+                        int neighbor = sameCell ? static_cast<int>(c) : table.find(cellKey(ix + dx, iy + dy, iz + dz));
+                        if(neighbor < 0)
+                        {
+                            continue;
+                        }
+                        for(int i = cellStart[c]; i < cellStart[c + 1]; i++)
+                        {
+                            const int p = cellPoints[i];
+                            const pcl::PointXYZRGBA &a = cloud.points[points[p]];
+                            for(int j = sameCell ? i + 1 : cellStart[neighbor]; j < cellStart[neighbor + 1]; j++)
+                            {
+                                const int q = cellPoints[j];
+                                const pcl::PointXYZRGBA &b = cloud.points[points[q]];
+                                float ex = a.x - b.x;
+                                float ey = a.y - b.y;
+                                float ez = a.z - b.z;
+                                if(ex * ex + ey * ey + ez * ez <= squaredTolerance)
+                                {
+                                    unite(parent, p, q);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // gather the points of each set, keeping the sets that satisfy the size limits
+    std::vector<int> rootSize(numPoints, 0);
+    std::vector<int> roots(numPoints);
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        roots[i] = findRoot(parent, static_cast<int>(i));
+        rootSize[roots[i]]++;
+    }
+    std::vector<int> rootCluster(numPoints, -1);
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        if(rootSize[i] >= minClusterSize && rootSize[i] <= maxClusterSize)
+        {
+            rootCluster[i] = static_cast<int>(clusters.size());
+            clusters.push_back(pcl::PointIndices());
+            clusters.back().indices.reserve(rootSize[i]);
+        }
+    }
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        int cluster = rootCluster[roots[i]];
+        if(cluster >= 0)
+        {
+            clusters[cluster].indices.push_back(points[i]);
+        }
+    }
+
+    // sort the clusters by decreasing size, the order of equal sizes follows their first point
+    std::stable_sort(clusters.begin(), clusters.end(), [](const pcl::PointIndices &a, const pcl::PointIndices &b)
+    {
+        return a.indices.size() > b.indices.size();
+    });
+    return true;
+}
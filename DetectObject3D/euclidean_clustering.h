@@ -0,0 +1,20 @@
+/***********************************************************************************************************************
+* @file euclidean_clustering.h
+* @brief linear-time Euclidean clustering on a spatial hash
+*
+* Points are bucketed into cubic cells whose edge equals the cluster tolerance, so every neighbor of a point lies in
+* its own cell or one of the 26 adjacent cells. Neighboring points are merged with a lock-free union-find shared by
+* the worker threads. The result matches pcl::EuclideanClusterExtraction without building a KdTree.
+**********************************************************************************************************************/
+
+#ifndef DETECT_EUCLIDEAN_CLUSTERING_H
+#define DETECT_EUCLIDEAN_CLUSTERING_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+bool euclideanClusters(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, float tolerance, int minClusterSize,
+    int maxClusterSize, int numThreads, std::vector<pcl::PointIndices> &clusters);
+
+#endif
@@ -0,0 +1,157 @@
+/***********************************************************************************************************************
+* @file file_hash.cpp
+* @brief content hash of a file, used to tie derived files to the input cloud they were computed from
+**********************************************************************************************************************/
+
+#include "file_hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the first block holds the header of a cloud file, the other samples are spread evenly over the rest of the file
+static const size_t STAMP_HEADER_BLOCK = 1 << 16;
+static const size_t STAMP_SAMPLE_BLOCK = 1 << 12;
+static const size_t STAMP_NUM_SAMPLES = 16;
+
+/*******************************************************************************************************************//**
+ * @brief Mixes a 64 bit word into the hash (MurmurHash3 style, not cryptographic)
+ **********************************************************************************************************************/
+static inline uint64_t mixWord(uint64_t hash, uint64_t word)
+{
+    word *= 0x87c37b91114253d5ULL;
+    word = (word << 31) | (word >> 33);
+    word *= 0x4cf5ad432745937fULL;
+    hash ^= word;
+    hash = (hash << 27) | (hash >> 37);
+    return hash * 5 + 0x52dce729;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Spreads the bits of the final hash
+ **********************************************************************************************************************/
+static inline uint64_t finalizeHash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Mixes a buffer into the hash a word at a time, the last partial word padded with zeros
+ **********************************************************************************************************************/
+static uint64_t mixBytes(uint64_t hash, const unsigned char *data, size_t size)
+{
+    size_t numWords = size / sizeof(uint64_t);
+    for(size_t i = 0; i < numWords; i++)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+        hash = mixWord(hash, word);
+    }
+    size_t tail = size - numWords * sizeof(uint64_t);
+    if(tail > 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, data + numWords * sizeof(uint64_t), tail);
+        hash = mixWord(hash, word);
+    }
+    return hash;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Hashes the content of a file
+ *
+ * The file is read in large blocks and hashed a word at a time, so hashing runs at about the speed of reading.
+ *
+ * @param[in] fileName path of the file
+ * @param[out] hash 64 bit hash of the content
+ * @param[out] size size of the file in bytes
+ * @return false if the file cannot be read
+ **********************************************************************************************************************/
+bool hashFile(const std::string &fileName, uint64_t &hash, uint64_t &size)
+{
+    FILE *file = std::fopen(fileName.c_str(), "rb");
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    // the block size is a multiple of the word size, so only the last block can end with a partial word
+    const size_t blockSize = 1 << 20;
+    std::vector<unsigned char> block(blockSize);
+    hash = 0x9e3779b97f4a7c15ULL;
+    size = 0;
+    size_t bytesRead = 0;
+    while((bytesRead = std::fread(block.data(), 1, blockSize, file)) > 0)
+    {
+        hash = mixBytes(hash, block.data(), bytesRead);
+        size += bytesRead;
+    }
+    bool valid = std::ferror(file) == 0;
+    std::fclose(file);
+    hash = finalizeHash(hash ^ size);
+    return valid;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Identifies a file from its metadata and a few sampled blocks, without reading all of it
+ *
+ * Replacing the file changes its inode or time stamp, and writing to it changes its time stamp. The sampled blocks
+ * also catch the writes that restore the time stamp, as long as they change the header or a sampled block.
+ *
+ * @param[in] fileName path of the file
+ * @param[out] stamp identity of the file
+ * @return false if the file cannot be read
+ **********************************************************************************************************************/
+bool stampFile(const std::string &fileName, FileStamp &stamp)
+{
+    int fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if(fileDescriptor < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if(fstat(fileDescriptor, &status) != 0)
+    {
+        ::close(fileDescriptor);
+        return false;
+    }
+    stamp.size = static_cast<uint64_t>(status.st_size);
+    stamp.device = static_cast<uint64_t>(status.st_dev);
+    stamp.inode = static_cast<uint64_t>(status.st_ino);
+    stamp.modifiedSeconds = static_cast<int64_t>(status.st_mtim.tv_sec);
+    stamp.modifiedNanoseconds = static_cast<int64_t>(status.st_mtim.tv_nsec);
+
+    // hash the first block, then blocks at evenly spaced offsets up to the end of the file
+    std::vector<unsigned char> block(STAMP_HEADER_BLOCK);
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    bool valid = true;
+    for(size_t sample = 0; sample <= STAMP_NUM_SAMPLES && valid; sample++)
+    {
+        uint64_t offset = 0;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(STAMP_HEADER_BLOCK, stamp.size));
+        if(sample > 0)
+        {
+            if(stamp.size <= STAMP_HEADER_BLOCK)
+            {
+                break;
+            }
+            length = static_cast<size_t>(std::min<uint64_t>(STAMP_SAMPLE_BLOCK, stamp.size - STAMP_HEADER_BLOCK));
+            offset = STAMP_HEADER_BLOCK + (stamp.size - STAMP_HEADER_BLOCK - length) * sample / STAMP_NUM_SAMPLES;
+        }
+        ssize_t bytesRead = pread(fileDescriptor, block.data(), length, static_cast<off_t>(offset));
+        valid = bytesRead == static_cast<ssize_t>(length);
+        hash = mixBytes(hash, block.data(), length);
+    }
+    ::close(fileDescriptor);
+    stamp.sampleHash = finalizeHash(hash ^ stamp.size);
+    return valid;
+}
@@ -0,0 +1,31 @@
+/***********************************************************************************************************************
+* @file file_hash.h
+* @brief content hash of a file, used to tie derived files to the input cloud they were computed from
+*
+* Hashing the whole content costs a full read of the file. A file stamp identifies a file in constant time instead,
+* from its size, device, inode and modification time, plus a hash of its first block and of blocks sampled across it.
+**********************************************************************************************************************/
+
+#ifndef DETECT_FILE_HASH_H
+#define DETECT_FILE_HASH_H
+
+#include <cstdint>
+#include <string>
+
+/*******************************************************************************************************************//**
+ * @brief Identity of a file, which changes when the file is replaced or written to
+ **********************************************************************************************************************/
+struct FileStamp
+{
+    uint64_t size;
+    uint64_t device;
+    uint64_t inode;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    uint64_t sampleHash;
+};
+
+bool hashFile(const std::string &fileName, uint64_t &hash, uint64_t &size);
+bool stampFile(const std::string &fileName, FileStamp &stamp);
+
+#endif
@@ -0,0 +1,534 @@
+/***********************************************************************************************************************
+* @file geometry_kernels.cpp
+* @brief vectorized kernels for point-to-plane distances, inlier masks, masked reductions and recoloring
+**********************************************************************************************************************/
+
+#include "geometry_kernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#define KERNELS_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*******************************************************************************************************************//**
+ * @brief Gets the byte mask of every 8 bit lane mask, for expanding comparison results into one byte per value
+ **********************************************************************************************************************/
+static const uint64_t *byteMaskTable()
+{
+    struct Table
+    {
+        uint64_t masks[256];
+
+        Table()
+        {
+            for(int bits = 0; bits < 256; bits++)
+            {
+                masks[bits] = 0;
+                for(int lane = 0; lane < 8; lane++)
+                {
+                    if(bits & (1 << lane))
+                    {
+                        masks[bits] |= uint64_t(1) << (8 * lane);
+                    }
+                }
+            }
+        }
+    };
+    static const Table table;
+    return table.masks;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the scale turning the plane equation into a Euclidean distance
+ **********************************************************************************************************************/
+static inline float inverseNormalLength(const float plane[4])
+{
+    float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    return length > 0 ? 1.0f / length : 0.0f;
+}
+
+// scalar reference variants
+
+static void scalarPlaneDistances(const float *xyz, size_t stride, const int *indices, size_t count,
+    const float plane[4], float *distances)
+{
+    const float scale = inverseNormalLength(plane);
+    for(size_t i = 0; i < count; i++)
+    {
+        const float *p = xyz + (indices != NULL ? static_cast<size_t>(indices[i]) : i) * stride;
+        distances[i] = std::fabs(plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3]) * scale;
+    }
+}
+
+static size_t scalarThresholdMask(const float *values, size_t count, float threshold, uint8_t *mask)
+{
+    size_t selected = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        mask[i] = values[i] <= threshold ? 1 : 0;
+        selected += mask[i];
+    }
+    return selected;
+}
+
+static void scalarMaskedStats(const float *values, const uint8_t *mask, size_t begin, size_t count,
+    MaskedStats &stats)
+{
+    for(size_t i = begin; i < count; i++)
+    {
+        if(mask == NULL || mask[i] != 0)
+        {
+            stats.count++;
+            stats.sum += values[i];
+            stats.min = values[i] < stats.min ? values[i] : stats.min;
+            stats.max = values[i] > stats.max ? values[i] : stats.max;
+        }
+    }
+}
+
+#ifdef KERNELS_X86
+
+// AVX2 variants, compiled for AVX2 regardless of the build flags and only called when the processor supports it
+
+KERNELS_AVX2 static inline void avx2LoadPoints(const float *const p[8], __m256 &x, __m256 &y, __m256 &z)
+{
+    // load (x, y, z, w) of eight points and transpose them into coordinate vectors
+    __m128 a0 = _mm_loadu_ps(p[0]);
+    __m128 a1 = _mm_loadu_ps(p[1]);
+    __m128 a2 = _mm_loadu_ps(p[2]);
+    __m128 a3 = _mm_loadu_ps(p[3]);
+    __m128 b0 = _mm_loadu_ps(p[4]);
+    __m128 b1 = _mm_loadu_ps(p[5]);
+    __m128 b2 = _mm_loadu_ps(p[6]);
+    __m128 b3 = _mm_loadu_ps(p[7]);
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+    _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+    x = _mm256_insertf128_ps(_mm256_castps128_ps256(a0), b0, 1);
+    y = _mm256_insertf128_ps(_mm256_castps128_ps256(a1), b1, 1);
+    z = _mm256_insertf128_ps(_mm256_castps128_ps256(a2), b2, 1);
+}
+
+KERNELS_AVX2 static void avx2PlaneDistances(const float *xyz, size_t stride, const int *indices, size_t count,
+    const float plane[4], float *distances)
+{
+    const float scale = inverseNormalLength(plane);
+    const __m256 a = _mm256_set1_ps(plane[0] * scale);
+    const __m256 b = _mm256_set1_ps(plane[1] * scale);
+    const __m256 c = _mm256_set1_ps(plane[2] * scale);
+    const __m256 d = _mm256_set1_ps(plane[3] * scale);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const float *p[8];
+        for(int k = 0; k < 8; k++)
+        {
+            p[k] = xyz + (indices != NULL ? static_cast<size_t>(indices[i + k]) : i + k) * stride;
+        }
+        __m256 x, y, z;
+        avx2LoadPoints(p, x, y, z);
+        __m256 distance = _mm256_fmadd_ps(a, x, _mm256_fmadd_ps(b, y, _mm256_fmadd_ps(c, z, d)));
+        _mm256_storeu_ps(distances + i, _mm256_and_ps(distance, absMask));
+    }
+    if(i < count)
+    {
+        scalarPlaneDistances(indices != NULL ? xyz : xyz + i * stride, stride, indices != NULL ? indices + i : NULL,
+            count - i, plane, distances + i);
+    }
+}
+
+KERNELS_AVX2 static size_t avx2ThresholdMask(const float *values, size_t count, float threshold, uint8_t *mask)
+{
+    const uint64_t *table = byteMaskTable();
+    const __m256 limit = _mm256_set1_ps(threshold);
+    size_t selected = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        int bits = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), limit, _CMP_LE_OQ));
+        std::memcpy(mask + i, &table[bits], 8);
+        selected += __builtin_popcount(bits);
+    }
+    return selected + scalarThresholdMask(values + i, count - i, threshold, mask + i);
+}
+
+KERNELS_AVX2 static void avx2MaskedStats(const float *values, const uint8_t *mask, size_t count, MaskedStats &stats)
+{
+    const __m256 positive = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 negative = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256d sum = _mm256_setzero_pd();
+    __m256 low = positive;
+    __m256 high = negative;
+    size_t selected = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(values + i);
+        __m256 keep = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        if(mask != NULL)
+        {
+            __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(mask + i)));
+            keep = _mm256_castsi256_ps(_mm256_cmpgt_epi32(lanes, _mm256_setzero_si256()));
+        }
+        selected += __builtin_popcount(_mm256_movemask_ps(keep));
+        __m256 kept = _mm256_and_ps(v, keep);
+        sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_castps256_ps128(kept)));
+        sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_extractf128_ps(kept, 1)));
+        low = _mm256_min_ps(low, _mm256_blendv_ps(positive, v, keep));
+        high = _mm256_max_ps(high, _mm256_blendv_ps(negative, v, keep));
+    }
+
+    // horizontal reductions
+    double sums[4];
+    float lows[8];
+    float highs[8];
+    _mm256_storeu_pd(sums, sum);
+    _mm256_storeu_ps(lows, low);
+    _mm256_storeu_ps(highs, high);
+    stats.count += selected;
+    stats.sum += sums[0] + sums[1] + sums[2] + sums[3];
+    for(int k = 0; k < 8; k++)
+    {
+        stats.min = lows[k] < stats.min ? lows[k] : stats.min;
+        stats.max = highs[k] > stats.max ? highs[k] : stats.max;
+    }
+    scalarMaskedStats(values, mask, i, count, stats);
+}
+
+#endif
+
+#ifdef KERNELS_NEON
+
+// NEON variants, always available on the ARM targets that define __ARM_NEON
+
+static inline void neonLoadPoints(const float *const p[4], float32x4_t &x, float32x4_t &y, float32x4_t &z)
+{
+    // load (x, y, z, w) of four points and transpose them into coordinate vectors
+    float32x4x2_t t01 = vtrnq_f32(vld1q_f32(p[0]), vld1q_f32(p[1]));
+    float32x4x2_t t23 = vtrnq_f32(vld1q_f32(p[2]), vld1q_f32(p[3]));
+    x = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    y = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    z = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+}
+
+static void neonPlaneDistances(const float *xyz, size_t stride, const int *indices, size_t count,
+    const float plane[4], float *distances)
+{
+    const float scale = inverseNormalLength(plane);
+    const float32x4_t a = vdupq_n_f32(plane[0] * scale);
+    const float32x4_t b = vdupq_n_f32(plane[1] * scale);
+    const float32x4_t c = vdupq_n_f32(plane[2] * scale);
+    const float32x4_t d = vdupq_n_f32(plane[3] * scale);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        const float *p[4];
+        for(int k = 0; k < 4; k++)
+        {
+            p[k] = xyz + (indices != NULL ? static_cast<size_t>(indices[i + k]) : i + k) * stride;
+        }
+        float32x4_t x, y, z;
+        neonLoadPoints(p, x, y, z);
+        float32x4_t distance = vmlaq_f32(vmlaq_f32(vmlaq_f32(d, c, z), b, y), a, x);
+        vst1q_f32(distances + i, vabsq_f32(distance));
+    }
+    if(i < count)
+    {
+        scalarPlaneDistances(indices != NULL ? xyz : xyz + i * stride, stride, indices != NULL ? indices + i : NULL,
+            count - i, plane, distances + i);
+    }
+}
+
+static size_t neonThresholdMask(const float *values, size_t count, float threshold, uint8_t *mask)
+{
+    const float32x4_t limit = vdupq_n_f32(threshold);
+    const uint8x8_t one = vdup_n_u8(1);
+    size_t selected = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        uint16x4_t low = vmovn_u32(vcleq_f32(vld1q_f32(values + i), limit));
+        uint16x4_t high = vmovn_u32(vcleq_f32(vld1q_f32(values + i + 4), limit));
+        uint8x8_t bytes = vand_u8(vmovn_u16(vcombine_u16(low, high)), one);
+        vst1_u8(mask + i, bytes);
+        uint64_t packed = vget_lane_u64(vreinterpret_u64_u8(bytes), 0);
+        selected += __builtin_popcountll(packed);
+    }
+    return selected + scalarThresholdMask(values + i, count - i, threshold, mask + i);
+}
+
+static void neonMaskedStats(const float *values, const uint8_t *mask, size_t count, MaskedStats &stats)
+{
+    const float32x4_t positive = vdupq_n_f32(std::numeric_limits<float>::infinity());
+    const float32x4_t negative = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+    float32x4_t low = positive;
+    float32x4_t high = negative;
+    size_t i = 0;
+    while(i + 4 <= count)
+    {
+        // accumulate blocks in single precision and flush them into the double precision sum
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        uint32x4_t selected = vdupq_n_u32(0);
+        size_t blockEnd = i + 1024 < count ? i + 1024 : count;
+        for(; i + 4 <= blockEnd; i += 4)
+        {
+            float32x4_t v = vld1q_f32(values + i);
+            uint32x4_t keep = vdupq_n_u32(0xffffffffu);
+            if(mask != NULL)
+            {
+                uint32_t bytes;
+                std::memcpy(&bytes, mask + i, 4);
+                uint16x8_t wide = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+                keep = vcgtq_u32(vmovl_u16(vget_low_u16(wide)), vdupq_n_u32(0));
+            }
+            selected = vsubq_u32(selected, keep);
+            sum = vaddq_f32(sum, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), keep)));
+            low = vminq_f32(low, vbslq_f32(keep, v, positive));
+            high = vmaxq_f32(high, vbslq_f32(keep, v, negative));
+        }
+        float sums[4];
+        uint32_t counts[4];
+        vst1q_f32(sums, sum);
+        vst1q_u32(counts, selected);
+        for(int k = 0; k < 4; k++)
+        {
+            stats.sum += sums[k];
+            stats.count += counts[k];
+        }
+    }
+    float lows[4];
+    float highs[4];
+    vst1q_f32(lows, low);
+    vst1q_f32(highs, high);
+    for(int k = 0; k < 4; k++)
+    {
+        stats.min = lows[k] < stats.min ? lows[k] : stats.min;
+        stats.max = highs[k] > stats.max ? highs[k] : stats.max;
+    }
+    scalarMaskedStats(values, mask, i, count, stats);
+}
+
+#endif
+
+// instruction set used by the kernels
+static KernelIsa activeIsa = detectKernelIsa();
+
+/*******************************************************************************************************************//**
+ * @brief Detects the best instruction set supported by the processor
+ * @return the instruction set the kernels use by default
+ **********************************************************************************************************************/
+KernelIsa detectKernelIsa()
+{
+#if defined(KERNELS_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return ISA_AVX2;
+    }
+    return ISA_SCALAR;
+#elif defined(KERNELS_NEON)
+    return ISA_NEON;
+#else
+    return ISA_SCALAR;
+#endif
+}
+
+KernelIsa kernelIsa()
+{
+    return activeIsa;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Selects the instruction set of the kernels, for instance to compare against the scalar variants
+ * @param[in] isa requested instruction set
+ * @return the instruction set in use, which is scalar if the requested one is not supported
+ **********************************************************************************************************************/
+KernelIsa setKernelIsa(KernelIsa isa)
+{
+    activeIsa = isa == detectKernelIsa() ? isa : ISA_SCALAR;
+    return activeIsa;
+}
+
+const char *kernelIsaName(KernelIsa isa)
+{
+    switch(isa)
+    {
+        case ISA_AVX2:
+            return "avx2";
+        case ISA_NEON:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the distance of consecutive points to a plane
+ *
+ * The distance is normalized by the length of the plane normal, like pcl::pointToPlaneDistance. The vectorized
+ * variants read four floats per point, so they require a stride of at least 4.
+ *
+ * @param[in] xyz pointer to the x coordinate of the first point
+ * @param[in] stride number of floats between consecutive points
+ * @param[in] count number of points
+ * @param[in] plane plane coefficients (a, b, c, d)
+ * @param[out] distances distance of each point
+ **********************************************************************************************************************/
+void planeDistances(const float *xyz, size_t stride, size_t count, const float plane[4], float *distances)
+{
+#ifdef KERNELS_X86
+    if(activeIsa == ISA_AVX2 && stride >= 4)
+    {
+        avx2PlaneDistances(xyz, stride, NULL, count, plane, distances);
+        return;
+    }
+#endif
+#ifdef KERNELS_NEON
+    if(activeIsa == ISA_NEON && stride >= 4)
+    {
+        neonPlaneDistances(xyz, stride, NULL, count, plane, distances);
+        return;
+    }
+#endif
+    scalarPlaneDistances(xyz, stride, NULL, count, plane, distances);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the distance of a list of points to a plane
+ * @param[in] xyz pointer to the x coordinate of the first point of the cloud
+ * @param[in] stride number of floats between consecutive points
+ * @param[in] indices indices of the points
+ * @param[in] count number of indices
+ * @param[in] plane plane coefficients (a, b, c, d)
+ * @param[out] distances distance of each listed point
+ **********************************************************************************************************************/
+void planeDistancesIndexed(const float *xyz, size_t stride, const int *indices, size_t count, const float plane[4],
+    float *distances)
+{
+#ifdef KERNELS_X86
+    if(activeIsa == ISA_AVX2 && stride >= 4)
+    {
+        avx2PlaneDistances(xyz, stride, indices, count, plane, distances);
+        return;
+    }
+#endif
+#ifdef KERNELS_NEON
+    if(activeIsa == ISA_NEON && stride >= 4)
+    {
+        neonPlaneDistances(xyz, stride, indices, count, plane, distances);
+        return;
+    }
+#endif
+    scalarPlaneDistances(xyz, stride, indices, count, plane, distances);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Marks the values below or equal to a threshold
+ * @param[in] values input values
+ * @param[in] count number of values
+ * @param[in] threshold largest selected value
+ * @param[out] mask 1 for each selected value, 0 otherwise (NaN values are never selected)
+ * @return the number of selected values
+ **********************************************************************************************************************/
+size_t thresholdMask(const float *values, size_t count, float threshold, uint8_t *mask)
+{
+#ifdef KERNELS_X86
+    if(activeIsa == ISA_AVX2)
+    {
+        return avx2ThresholdMask(values, count, threshold, mask);
+    }
+#endif
+#ifdef KERNELS_NEON
+    if(activeIsa == ISA_NEON)
+    {
+        return neonThresholdMask(values, count, threshold, mask);
+    }
+#endif
+    return scalarThresholdMask(values, count, threshold, mask);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the count, sum, minimum and maximum of the selected values
+ * @param[in] values input values
+ * @param[in] mask nonzero for each selected value, or NULL to select every value
+ * @param[in] count number of values
+ * @return the statistics of the selected values (infinite min and max if none is selected)
+ **********************************************************************************************************************/
+MaskedStats maskedStats(const float *values, const uint8_t *mask, size_t count)
+{
+    MaskedStats stats;
+    stats.count = 0;
+    stats.sum = 0;
+    stats.min = std::numeric_limits<float>::infinity();
+    stats.max = -std::numeric_limits<float>::infinity();
+#ifdef KERNELS_X86
+    if(activeIsa == ISA_AVX2)
+    {
+        avx2MaskedStats(values, mask, count, stats);
+        return stats;
+    }
+#endif
+#ifdef KERNELS_NEON
+    if(activeIsa == ISA_NEON)
+    {
+        neonMaskedStats(values, mask, count, stats);
+        return stats;
+    }
+#endif
+    scalarMaskedStats(values, mask, 0, count, stats);
+    return stats;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Sets the color of a list of points
+ *
+ * Neither AVX2 nor NEON has scatter stores, so every instruction set uses the same unchecked stores of the packed
+ * color, keeping the alpha channel of each point.
+ *
+ * @param[in,out] points points of the cloud
+ * @param[in] indices indices of the points to recolor
+ * @param[in] count number of indices
+ * @param[in] r red channel
+ * @param[in] g green channel
+ * @param[in] b blue channel
+ **********************************************************************************************************************/
+void recolorIndices(pcl::PointXYZRGBA *points, const int *indices, size_t count, uint8_t r, uint8_t g, uint8_t b)
+{
+    const uint32_t color = (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
+    for(size_t i = 0; i < count; i++)
+    {
+        pcl::PointXYZRGBA &point = points[indices[i]];
+        point.rgba = (point.rgba & 0xff000000u) | color;
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Sets the color of every point from its label
+ * @param[in,out] points points of the cloud
+ * @param[in] labels label of each point
+ * @param[in] count number of points
+ * @param[in] palette packed 0xRRGGBB color of each label, or 0xFFFFFFFF to keep the color of the points
+ * @param[in] numLabels number of palette entries, points with other labels keep their color
+ **********************************************************************************************************************/
+void recolorLabels(pcl::PointXYZRGBA *points, const int *labels, size_t count, const uint32_t *palette,
+    int numLabels)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        const int label = labels[i];
+        if(label >= 0 && label < numLabels && palette[label] != 0xffffffffu)
+        {
+            points[i].rgba = (points[i].rgba & 0xff000000u) | palette[label];
+        }
+    }
+}
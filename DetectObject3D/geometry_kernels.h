@@ -0,0 +1,54 @@
+/***********************************************************************************************************************
+* @file geometry_kernels.h
+* @brief vectorized kernels for point-to-plane distances, inlier masks, masked reductions and recoloring
+*
+* The kernels work directly on the points of a PCL cloud: positions are read through a pointer to the x coordinate of
+* the first point and a stride in floats between consecutive points (8 for pcl::PointXYZRGBA), with y and z following
+* x. On x86 the AVX2 variants are selected at run time when the processor supports them, on ARM the NEON variants are
+* always used, and the scalar variants serve as the reference on every platform.
+**********************************************************************************************************************/
+
+#ifndef DETECT_GEOMETRY_KERNELS_H
+#define DETECT_GEOMETRY_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <pcl/point_types.h>
+
+// instruction sets of the kernel variants
+enum KernelIsa {ISA_SCALAR, ISA_AVX2, ISA_NEON};
+
+/*******************************************************************************************************************//**
+ * @brief Result of a masked reduction
+ **********************************************************************************************************************/
+struct MaskedStats
+{
+    size_t count;
+    double sum;
+    float min;
+    float max;
+
+    double mean() const
+    {
+        return count > 0 ? sum / count : 0.0;
+    }
+};
+
+KernelIsa detectKernelIsa();
+KernelIsa kernelIsa();
+KernelIsa setKernelIsa(KernelIsa isa);
+const char *kernelIsaName(KernelIsa isa);
+
+// stride between consecutive pcl::PointXYZRGBA in floats
+const size_t POINT_STRIDE = sizeof(pcl::PointXYZRGBA) / sizeof(float);
+
+void planeDistances(const float *xyz, size_t stride, size_t count, const float plane[4], float *distances);
+void planeDistancesIndexed(const float *xyz, size_t stride, const int *indices, size_t count, const float plane[4],
+    float *distances);
+size_t thresholdMask(const float *values, size_t count, float threshold, uint8_t *mask);
+MaskedStats maskedStats(const float *values, const uint8_t *mask, size_t count);
+void recolorIndices(pcl::PointXYZRGBA *points, const int *indices, size_t count, uint8_t r, uint8_t g, uint8_t b);
+void recolorLabels(pcl::PointXYZRGBA *points, const int *labels, size_t count, const uint32_t *palette,
+    int numLabels);
+
+#endif
@@ -0,0 +1,393 @@
+/***********************************************************************************************************************
+* @file index_cache.cpp
+* @brief on-disk cache of the voxel index and table plane of a cloud, reused by later runs on the same file
+**********************************************************************************************************************/
+
+#include "index_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file_hash.h"
+
+static const char CACHE_MAGIC[4] = {'D', 'I', 'D', 'X'};
+static const uint32_t CACHE_VERSION = 2;
+
+// a voxel index is as large as the cloud itself, so only the most recent leaf sizes are kept
+static const size_t MAX_VOXEL_ENTRIES = 2;
+static const size_t MAX_PLANE_ENTRIES = 16;
+
+// size of the file header: magic, version, input stamp, input content hash and number of entries
+static const size_t HEADER_SIZE = sizeof(CACHE_MAGIC) + sizeof(uint32_t) + 7 * sizeof(uint64_t) + sizeof(uint32_t);
+
+// size of the parameters identifying a plane entry: voxel size, distance threshold and iterations
+static const size_t PLANE_KEY_SIZE = 2 * sizeof(float) + sizeof(int32_t);
+
+/*******************************************************************************************************************//**
+ * @brief Appends a fixed size value to a buffer
+ **********************************************************************************************************************/
+template<typename T>
+static void putValue(std::vector<unsigned char> &buffer, T value)
+{
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Reads a fixed size value at an offset of unaligned data
+ **********************************************************************************************************************/
+template<typename T>
+static T getValue(const unsigned char *data, size_t offset)
+{
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Decodes a plane entry
+ * @return false if the entry is truncated
+ **********************************************************************************************************************/
+static bool decodePlane(const unsigned char *data, size_t size, CachedPlane &plane)
+{
+    const size_t fixedSize = PLANE_KEY_SIZE + sizeof(double) + sizeof(uint32_t);
+    if(size < fixedSize)
+    {
+        return false;
+    }
+    plane.voxelSize = getValue<float>(data, 0);
+    plane.distanceThreshold = getValue<float>(data, sizeof(float));
+    plane.maxIterations = getValue<int32_t>(data, 2 * sizeof(float));
+    plane.inlierRatio = getValue<double>(data, PLANE_KEY_SIZE);
+    const uint32_t numCoefficients = getValue<uint32_t>(data, PLANE_KEY_SIZE + sizeof(double));
+    if(size != fixedSize + sizeof(float) * static_cast<uint64_t>(numCoefficients))
+    {
+        return false;
+    }
+    plane.coefficients.resize(numCoefficients);
+    for(uint32_t i = 0; i < numCoefficients; i++)
+    {
+        plane.coefficients[i] = getValue<float>(data, fixedSize + sizeof(float) * i);
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Creates a cache with no file open
+ **********************************************************************************************************************/
+IndexCache::IndexCache():
+    _inputStamp(), _contentHash(0), _verifyContent(false), _mapping(NULL), _mappingSize(0), _modified(false)
+{
+}
+
+IndexCache::~IndexCache()
+{
+    close();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Opens the cache of an input cloud
+ *
+ * The input file is stamped and the cache file mapped if it exists. A cache written for another stamp is ignored, and
+ * overwritten by the next save. The content hash of the input is only computed when verifying, as it reads the whole
+ * file; a cache without the hash of the current content is then ignored as well.
+ *
+ * @param[in] inputFileName path of the input cloud
+ * @param[in] verifyContent also checks the cache against the content hash of the whole input file
+ * @return false if the input file cannot be read
+ **********************************************************************************************************************/
+bool IndexCache::open(const std::string &inputFileName, bool verifyContent)
+{
+    close();
+    uint64_t contentSize = 0;
+    if(!stampFile(inputFileName, _inputStamp) ||
+        (verifyContent && !hashFile(inputFileName, _contentHash, contentSize)))
+    {
+        return false;
+    }
+    _verifyContent = verifyContent;
+    _fileName = inputFileName.substr(0, inputFileName.find_last_of(".")) + ".index";
+
+    // the mapping stays valid after closing the descriptor
+    int fileDescriptor = ::open(_fileName.c_str(), O_RDONLY);
+    if(fileDescriptor < 0)
+    {
+        return true;
+    }
+    struct stat status;
+    if(fstat(fileDescriptor, &status) == 0 && status.st_size > 0)
+    {
+        void *mapping = mmap(NULL, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if(mapping != MAP_FAILED)
+        {
+            _mapping = static_cast<unsigned char *>(mapping);
+            _mappingSize = static_cast<size_t>(status.st_size);
+        }
+    }
+    ::close(fileDescriptor);
+    if(_mapping != NULL && !parse())
+    {
+        _entries.clear();
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Drops the entries and unmaps the file, without saving
+ **********************************************************************************************************************/
+void IndexCache::close()
+{
+    _entries.clear();
+    if(_mapping != NULL)
+    {
+        munmap(_mapping, _mappingSize);
+    }
+    _mapping = NULL;
+    _mappingSize = 0;
+    _fileName.clear();
+    _inputStamp = FileStamp();
+    _contentHash = 0;
+    _verifyContent = false;
+    _modified = false;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Lists the entries of the mapped file
+ * @return false if the file is not a cache of the input cloud, or is truncated
+ **********************************************************************************************************************/
+bool IndexCache::parse()
+{
+    if(_mappingSize < HEADER_SIZE || std::memcmp(_mapping, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+    {
+        return false;
+    }
+    size_t offset = sizeof(CACHE_MAGIC);
+    const uint32_t version = getValue<uint32_t>(_mapping, offset);
+    offset += sizeof(uint32_t);
+    FileStamp stamp;
+    stamp.size = getValue<uint64_t>(_mapping, offset);
+    stamp.device = getValue<uint64_t>(_mapping, offset + sizeof(uint64_t));
+    stamp.inode = getValue<uint64_t>(_mapping, offset + 2 * sizeof(uint64_t));
+    stamp.modifiedSeconds = getValue<int64_t>(_mapping, offset + 3 * sizeof(uint64_t));
+    stamp.modifiedNanoseconds = getValue<int64_t>(_mapping, offset + 4 * sizeof(uint64_t));
+    stamp.sampleHash = getValue<uint64_t>(_mapping, offset + 5 * sizeof(uint64_t));
+    const uint64_t contentHash = getValue<uint64_t>(_mapping, offset + 6 * sizeof(uint64_t));
+    const uint32_t numEntries = getValue<uint32_t>(_mapping, offset + 7 * sizeof(uint64_t));
+    if(version != CACHE_VERSION || stamp.size != _inputStamp.size || stamp.device != _inputStamp.device ||
+        stamp.inode != _inputStamp.inode || stamp.modifiedSeconds != _inputStamp.modifiedSeconds ||
+        stamp.modifiedNanoseconds != _inputStamp.modifiedNanoseconds || stamp.sampleHash != _inputStamp.sampleHash)
+    {
+        return false;
+    }
+
+    // a cache written without verification has no content hash, and keeps it until a verified run rewrites it
+    if(_verifyContent && contentHash != _contentHash)
+    {
+        return false;
+    }
+    _contentHash = contentHash;
+    offset = HEADER_SIZE;
+    for(uint32_t i = 0; i < numEntries; i++)
+    {
+        if(_mappingSize - offset < sizeof(uint32_t) + sizeof(uint64_t))
+        {
+            return false;
+        }
+        Entry entry;
+        entry.type = getValue<uint32_t>(_mapping, offset);
+        const uint64_t size = getValue<uint64_t>(_mapping, offset + sizeof(uint32_t));
+        offset += sizeof(uint32_t) + sizeof(uint64_t);
+        if(size > _mappingSize - offset)
+        {
+            return false;
+        }
+        entry.mapped = _mapping + offset;
+        entry.size = static_cast<size_t>(size);
+        _entries.push_back(entry);
+        offset += entry.size;
+    }
+    return offset == _mappingSize;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Writes the cache file if entries were added since it was opened
+ *
+ * The file is written under a temporary name and renamed over the previous one, so an interrupted run never leaves a
+ * truncated cache, and the mapping of the previous file remains valid.
+ *
+ * @return false if the file cannot be written
+ **********************************************************************************************************************/
+bool IndexCache::save()
+{
+    if(!_modified || _fileName.empty())
+    {
+        return true;
+    }
+    std::vector<unsigned char> header;
+    header.insert(header.end(), CACHE_MAGIC, CACHE_MAGIC + sizeof(CACHE_MAGIC));
+    putValue<uint32_t>(header, CACHE_VERSION);
+    putValue<uint64_t>(header, _inputStamp.size);
+    putValue<uint64_t>(header, _inputStamp.device);
+    putValue<uint64_t>(header, _inputStamp.inode);
+    putValue<int64_t>(header, _inputStamp.modifiedSeconds);
+    putValue<int64_t>(header, _inputStamp.modifiedNanoseconds);
+    putValue<uint64_t>(header, _inputStamp.sampleHash);
+    putValue<uint64_t>(header, _contentHash);
+    putValue<uint32_t>(header, static_cast<uint32_t>(_entries.size()));
+
+    const std::string temporaryName = _fileName + ".tmp";
+    FILE *file = std::fopen(temporaryName.c_str(), "wb");
+    if(file == NULL)
+    {
+        return false;
+    }
+    bool valid = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+    for(size_t i = 0; i < _entries.size() && valid; i++)
+    {
+        std::vector<unsigned char> entryHeader;
+        putValue<uint32_t>(entryHeader, _entries[i].type);
+        putValue<uint64_t>(entryHeader, _entries[i].size);
+        valid = std::fwrite(entryHeader.data(), 1, entryHeader.size(), file) == entryHeader.size() &&
+            std::fwrite(_entries[i].data(), 1, _entries[i].size, file) == _entries[i].size;
+    }
+    valid = std::fclose(file) == 0 && valid;
+    if(!valid || std::rename(temporaryName.c_str(), _fileName.c_str()) != 0)
+    {
+        std::remove(temporaryName.c_str());
+        return false;
+    }
+    _modified = false;
+    return true;
+}
+
+const std::string &IndexCache::fileName() const
+{
+    return _fileName;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Loads the voxel index cached for a leaf size
+ * @param[in] leafSize edge length of the voxels
+ * @param[in] numPoints number of points of the cloud the index must cover
+ * @param[out] index loaded index
+ * @return false if no valid index of the cloud is cached for the leaf size
+ **********************************************************************************************************************/
+bool IndexCache::loadVoxelIndex(float leafSize, size_t numPoints, VoxelIndex &index) const
+{
+    for(size_t i = _entries.size(); i-- > 0; )
+    {
+        const Entry &entry = _entries[i];
+        if(entry.type == ENTRY_VOXEL_INDEX && entry.size >= sizeof(float) &&
+            getValue<float>(entry.data(), 0) == leafSize)
+        {
+            return index.deserialize(entry.data(), entry.size) && index.numPoints() == numPoints;
+        }
+    }
+    return false;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Adds a voxel index to the cache, replacing the one of the same leaf size
+ * @param[in] index index to cache
+ **********************************************************************************************************************/
+void IndexCache::storeVoxelIndex(const VoxelIndex &index)
+{
+    std::vector<unsigned char> data;
+    index.serialize(data);
+    addEntry(ENTRY_VOXEL_INDEX, sizeof(float), data, MAX_VOXEL_ENTRIES);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Finds the plane cached for a set of parameters, or the best plane to start a search from
+ *
+ * A plane found with a smaller distance threshold lies within the inliers of the larger one, so among the planes of the
+ * same voxel size, the one with the largest threshold below the requested one is a good starting point.
+ *
+ * @param[in] voxelSize voxel size of the segmentation, 0 for the full cloud
+ * @param[in] distanceThreshold distance threshold of the segmentation
+ * @param[in] maxIterations iteration budget of the segmentation
+ * @param[out] plane cached plane
+ * @param[out] exact true if the plane was found with the same parameters
+ * @return false if no cached plane applies
+ **********************************************************************************************************************/
+bool IndexCache::findPlane(float voxelSize, float distanceThreshold, int maxIterations, CachedPlane &plane,
+    bool &exact) const
+{
+    bool found = false;
+    exact = false;
+    for(size_t i = 0; i < _entries.size(); i++)
+    {
+        CachedPlane candidate;
+        if(_entries[i].type != ENTRY_PLANE || !decodePlane(_entries[i].data(), _entries[i].size, candidate) ||
+            candidate.voxelSize != voxelSize || candidate.distanceThreshold > distanceThreshold)
+        {
+            continue;
+        }
+        if(candidate.distanceThreshold == distanceThreshold && candidate.maxIterations == maxIterations)
+        {
+            plane = candidate;
+            exact = true;
+            return true;
+        }
+        if(!found || candidate.distanceThreshold > plane.distanceThreshold)
+        {
+            plane = candidate;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Adds a plane to the cache, replacing the one found with the same parameters
+ * @param[in] plane plane to cache
+ **********************************************************************************************************************/
+void IndexCache::storePlane(const CachedPlane &plane)
+{
+    std::vector<unsigned char> data;
+    putValue<float>(data, plane.voxelSize);
+    putValue<float>(data, plane.distanceThreshold);
+    putValue<int32_t>(data, plane.maxIterations);
+    putValue<double>(data, plane.inlierRatio);
+    putValue<uint32_t>(data, static_cast<uint32_t>(plane.coefficients.size()));
+    for(size_t i = 0; i < plane.coefficients.size(); i++)
+    {
+        putValue<float>(data, plane.coefficients[i]);
+    }
+    addEntry(ENTRY_PLANE, PLANE_KEY_SIZE, data, MAX_PLANE_ENTRIES);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Appends an entry, dropping the entry of the same type and key and the oldest entries beyond the limit
+ * @param[in] type entry type
+ * @param[in] keySize number of leading bytes of the data identifying the entry
+ * @param[in,out] data entry data, moved into the cache
+ * @param[in] maxEntries maximum number of entries of the type
+ **********************************************************************************************************************/
+void IndexCache::addEntry(uint32_t type, size_t keySize, std::vector<unsigned char> &data, size_t maxEntries)
+{
+    size_t count = 0;
+    for(size_t i = _entries.size(); i-- > 0; )
+    {
+        const Entry &entry = _entries[i];
+        if(entry.type != type)
+        {
+            continue;
+        }
+        if((entry.size >= keySize && std::memcmp(entry.data(), data.data(), keySize) == 0) || ++count >= maxEntries)
+        {
+            _entries.erase(_entries.begin() + i);
+        }
+    }
+    _entries.push_back(Entry());
+    Entry &entry = _entries.back();
+    entry.type = type;
+    entry.mapped = NULL;
+    entry.size = data.size();
+    entry.owned.swap(data);
+    _modified = true;
+}
@@ -0,0 +1,82 @@
+/***********************************************************************************************************************
+* @file index_cache.h
+* @brief on-disk cache of the voxel index and table plane of a cloud, reused by later runs on the same file
+*
+* The cache is written next to the input cloud, with the extension replaced by ".index", and is tied to the stamp of
+* the cloud file (size, inode, time stamp and sampled blocks), so it is ignored as soon as the file is replaced or
+* written to, without reading the whole file on every run. The content hash of the whole file is an optional check. The voxel index is cached per leaf size, and the
+* plane per voxel size, distance threshold and iteration budget: a run with the same parameters reuses the plane as is,
+* and a run with a larger distance threshold starts from it instead of searching. The cluster distance, cluster sizes
+* and output mode can be swept without rebuilding either. The file is memory-mapped and its entries copied out in bulk.
+**********************************************************************************************************************/
+
+#ifndef DETECT_INDEX_CACHE_H
+#define DETECT_INDEX_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "file_hash.h"
+#include "voxel_index.h"
+
+/*******************************************************************************************************************//**
+ * @brief Table plane found with a set of parameters
+ **********************************************************************************************************************/
+struct CachedPlane
+{
+    float voxelSize;
+    float distanceThreshold;
+    int maxIterations;
+    double inlierRatio;
+    std::vector<float> coefficients;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Cache of the results of a cloud that do not depend on the clustering parameters
+ **********************************************************************************************************************/
+class IndexCache
+{
+    public:
+        IndexCache();
+        ~IndexCache();
+        bool open(const std::string &inputFileName, bool verifyContent = false);
+        void close();
+        bool save();
+        const std::string &fileName() const;
+        bool loadVoxelIndex(float leafSize, size_t numPoints, VoxelIndex &index) const;
+        void storeVoxelIndex(const VoxelIndex &index);
+        bool findPlane(float voxelSize, float distanceThreshold, int maxIterations, CachedPlane &plane,
+            bool &exact) const;
+        void storePlane(const CachedPlane &plane);
+
+    private:
+        enum EntryType {ENTRY_VOXEL_INDEX = 1, ENTRY_PLANE = 2};
+
+        // entries read from the file point into the mapping, entries computed in this run own their data
+        struct Entry
+        {
+            uint32_t type;
+            const unsigned char *mapped;
+            size_t size;
+            std::vector<unsigned char> owned;
+
+            const unsigned char *data() const
+            {
+                return mapped != NULL ? mapped : owned.data();
+            }
+        };
+
+        bool parse();
+        void addEntry(uint32_t type, size_t keySize, std::vector<unsigned char> &data, size_t maxEntries);
+
+        std::string _fileName;
+        FileStamp _inputStamp;
+        uint64_t _contentHash;
+        bool _verifyContent;
+        unsigned char *_mapping;
+        size_t _mappingSize;
+        std::vector<Entry> _entries;
+        bool _modified;
+};
+
+#endif
@@ -0,0 +1,221 @@
+/***********************************************************************************************************************
+* @file kernel_bench.cpp
+* @brief benchmark of the geometry kernels against the point by point loops they replace
+*
+* A synthetic cloud of points scattered around a plane is generated in memory. Each kernel is timed in its scalar and
+* vectorized variants, next to the original loop using bounds checked accesses and pcl::pointToPlaneDistance, and the
+* results of every variant are checked against the original loop.
+**********************************************************************************************************************/
+
+// include necessary dependencies
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/sample_consensus/sac_model_plane.h>
+#include "geometry_kernels.h"
+
+/*******************************************************************************************************************//**
+ * @brief Measures the fastest of several runs of a function
+ * @param[in] repetitions number of runs
+ * @param[in] function function to time
+ * @return the shortest run time in seconds
+ **********************************************************************************************************************/
+template<typename Function>
+double timeBest(int repetitions, Function function)
+{
+    double best = 1e30;
+    for(int r = 0; r < repetitions; r++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Prints a line of the results table
+ **********************************************************************************************************************/
+void report(const char *kernel, const char *variant, double seconds, size_t count, double baseline)
+{
+    std::printf("%-22s %-10s %9.3f ms %8.2f ns/point %7.2fx \n", kernel, variant, seconds * 1e3, seconds * 1e9 / count,
+        baseline / seconds);
+}
+
+/*******************************************************************************************************************//**
+ * @brief program entry point
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @return return code (0 if every variant matched the original loops)
+ **********************************************************************************************************************/
+int main(int argc, char **argv)
+{
+    size_t numPoints = 2000000;
+    int repetitions = 20;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if(option == "--points" && i + 1 < argc)
+        {
+            numPoints = static_cast<size_t>(std::atoll(argv[++i]));
+        }
+        else if(option == "--repetitions" && i + 1 < argc)
+        {
+            repetitions = std::max(1, std::atoi(argv[++i]));
+        }
+        else
+        {
+            std::printf("USAGE: %s [--points <count>] [--repetitions <count>] \n", argv[0]);
+            return 1;
+        }
+    }
+
+    // scatter points around a tilted plane, and select half of them as a cluster
+    const float plane[4] = {0.06f, 0.14f, 0.988f, 0.63f};
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    cloud->points.resize(numPoints);
+    cloud->width = static_cast<uint32_t>(numPoints);
+    cloud->height = 1;
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    std::normal_distribution<float> offset(0.0f, 0.05f);
+    std::vector<int> indices;
+    for(size_t i = 0; i < numPoints; i++)
+    {
+        pcl::PointXYZRGBA &point = cloud->points[i];
+        point.x = coordinate(rng);
+        point.y = coordinate(rng);
+        point.z = -(plane[0] * point.x + plane[1] * point.y + plane[3]) / plane[2] + offset(rng);
+        point.rgba = 0xff808080u;
+        if(rng() & 1)
+        {
+            indices.push_back(static_cast<int>(i));
+        }
+    }
+    const float *xyz = &cloud->points[0].x;
+    const size_t numIndices = indices.size();
+    const float threshold = 0.0254f;
+    const KernelIsa bestIsa = detectKernelIsa();
+    std::printf("%zu points, %zu indexed, best instruction set: %s \n\n", numPoints, numIndices,
+        kernelIsaName(bestIsa));
+
+    // original loop: per point distances through bounds checked accesses, then the mean
+    std::vector<float> reference(numIndices);
+    double referenceMean = 0;
+    double loopSeconds = timeBest(repetitions, [&]()
+    {
+        double mean = 0;
+        for(size_t j = 0; j < numIndices; j++)
+        {
+            double distance = pcl::pointToPlaneDistance(cloud->points.at(indices.at(j)), plane[0], plane[1],
+                plane[2], plane[3]);
+            reference[j] = static_cast<float>(distance);
+            mean += distance;
+        }
+        referenceMean = mean / numIndices;
+    });
+    report("cluster distance+mean", "loop", loopSeconds, numIndices, loopSeconds);
+
+    // kernels: gathered distances followed by the reduction
+    bool valid = true;
+    std::vector<float> distances(numPoints);
+    const KernelIsa variants[] = {ISA_SCALAR, bestIsa};
+    const int numVariants = bestIsa == ISA_SCALAR ? 1 : 2;
+    for(int v = 0; v < numVariants; v++)
+    {
+        setKernelIsa(variants[v]);
+        MaskedStats stats;
+        double seconds = timeBest(repetitions, [&]()
+        {
+            planeDistancesIndexed(xyz, POINT_STRIDE, indices.data(), numIndices, plane, distances.data());
+            stats = maskedStats(distances.data(), NULL, numIndices);
+        });
+        report("cluster distance+mean", kernelIsaName(variants[v]), seconds, numIndices, loopSeconds);
+        for(size_t j = 0; j < numIndices; j++)
+        {
+            valid = valid && std::fabs(distances[j] - reference[j]) <= 1e-5f;
+        }
+        valid = valid && std::fabs(stats.mean() - referenceMean) <= 1e-5;
+    }
+    std::printf("\n");
+
+    // original loop: inlier selection over the whole cloud
+    std::vector<int> referenceInliers;
+    loopSeconds = timeBest(repetitions, [&]()
+    {
+        referenceInliers.clear();
+        for(size_t i = 0; i < numPoints; i++)
+        {
+            if(pcl::pointToPlaneDistance(cloud->points.at(i), plane[0], plane[1], plane[2], plane[3]) <= threshold)
+            {
+                referenceInliers.push_back(static_cast<int>(i));
+            }
+        }
+    });
+    report("inlier mask", "loop", loopSeconds, numPoints, loopSeconds);
+    std::vector<uint8_t> mask(numPoints);
+    for(int v = 0; v < numVariants; v++)
+    {
+        setKernelIsa(variants[v]);
+        size_t selected = 0;
+        double seconds = timeBest(repetitions, [&]()
+        {
+            planeDistances(xyz, POINT_STRIDE, numPoints, plane, distances.data());
+            selected = thresholdMask(distances.data(), numPoints, threshold, mask.data());
+        });
+        report("inlier mask", kernelIsaName(variants[v]), seconds, numPoints, loopSeconds);
+
+        // points right at the threshold may round differently, allow a handful of them
+        long long difference = static_cast<long long>(selected) - static_cast<long long>(referenceInliers.size());
+        valid = valid && std::llabs(difference) <= static_cast<long long>(numPoints / 100000 + 2);
+    }
+
+    // masked min/max/mean of the inlier distances, compared with the scalar variant
+    double scalarSeconds = 0;
+    for(int v = 0; v < numVariants; v++)
+    {
+        setKernelIsa(variants[v]);
+        MaskedStats stats;
+        double seconds = timeBest(repetitions, [&]()
+        {
+            stats = maskedStats(distances.data(), mask.data(), numPoints);
+        });
+        scalarSeconds = v == 0 ? seconds : scalarSeconds;
+        report("masked min/max/mean", kernelIsaName(variants[v]), seconds, numPoints, scalarSeconds);
+        valid = valid && stats.max <= threshold && stats.min >= 0.0f;
+    }
+    std::printf("\n");
+
+    // original loop: recoloring with bounds checked accesses
+    loopSeconds = timeBest(repetitions, [&]()
+    {
+        for(size_t j = 0; j < numIndices; j++)
+        {
+            cloud->points.at(indices.at(j)).r = 0;
+            cloud->points.at(indices.at(j)).g = 0;
+            cloud->points.at(indices.at(j)).b = 255;
+        }
+    });
+    report("recolor indices", "loop", loopSeconds, numIndices, loopSeconds);
+    double seconds = timeBest(repetitions, [&]()
+    {
+        recolorIndices(&cloud->points[0], indices.data(), numIndices, 255, 0, 0);
+    });
+    report("recolor indices", "kernel", seconds, numIndices, loopSeconds);
+    for(size_t j = 0; j < numIndices; j++)
+    {
+        const pcl::PointXYZRGBA &point = cloud->points[indices[j]];
+        valid = valid && point.r == 255 && point.g == 0 && point.b == 0 && point.a == 255;
+    }
+
+    setKernelIsa(bestIsa);
+    std::printf("\n%s \n", valid ? "all variants match the original loops" : "MISMATCH between variants");
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+/***********************************************************************************************************************
+* @file label_sidecar.cpp
+* @brief compact label file describing the objects found in a cloud, written instead of the recolored cloud
+**********************************************************************************************************************/
+
+#include "label_sidecar.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const char SIDECAR_MAGIC[4] = {'D', 'L', 'B', 'L'};
+static const uint32_t SIDECAR_VERSION = 1;
+
+/*******************************************************************************************************************//**
+ * @brief Appends a fixed size value to a buffer
+ **********************************************************************************************************************/
+template<typename T>
+static void putValue(std::vector<unsigned char> &buffer, T value)
+{
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Appends an unsigned integer to a buffer, seven bits per byte
+ **********************************************************************************************************************/
+static void putVarint(std::vector<unsigned char> &buffer, uint32_t value)
+{
+    while(value >= 0x80)
+    {
+        buffer.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<unsigned char>(value));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Sequential reader over a loaded file, failing once the data runs out
+ **********************************************************************************************************************/
+struct SidecarReader
+{
+    const std::vector<unsigned char> &buffer;
+    size_t offset;
+    bool valid;
+
+    explicit SidecarReader(const std::vector<unsigned char> &data): buffer(data), offset(0), valid(true)
+    {
+    }
+
+    template<typename T>
+    T value()
+    {
+        T result = T();
+        if(offset + sizeof(T) > buffer.size())
+        {
+            valid = false;
+            return result;
+        }
+        std::memcpy(&result, &buffer[offset], sizeof(T));
+        offset += sizeof(T);
+        return result;
+    }
+
+    uint32_t varint()
+    {
+        uint32_t result = 0;
+        for(int shift = 0; shift < 35; shift += 7)
+        {
+            if(offset >= buffer.size())
+            {
+                break;
+            }
+            unsigned char byte = buffer[offset++];
+            result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if((byte & 0x80) == 0)
+            {
+                return result;
+            }
+        }
+        valid = false;
+        return 0;
+    }
+};
+
+/*******************************************************************************************************************//**
+ * @brief Writes a label file
+ *
+ * The file is written under a temporary name and renamed over the target, so a crash while writing never leaves a
+ * truncated label file behind.
+ *
+ * @param[in] fileName path of the file
+ * @param[in] sidecar labels and objects to write
+ * @return false if the file cannot be written
+ **********************************************************************************************************************/
+bool writeLabelSidecar(const std::string &fileName, const LabelSidecar &sidecar)
+{
+    std::vector<unsigned char> buffer;
+    buffer.insert(buffer.end(), SIDECAR_MAGIC, SIDECAR_MAGIC + sizeof(SIDECAR_MAGIC));
+    putValue<uint32_t>(buffer, SIDECAR_VERSION);
+    putValue<uint64_t>(buffer, sidecar.inputHash);
+    putValue<uint64_t>(buffer, sidecar.inputSize);
+    putValue<uint32_t>(buffer, static_cast<uint32_t>(sidecar.labels.size()));
+    putValue<uint32_t>(buffer, static_cast<uint32_t>(sidecar.objects.size()));
+    for(size_t i = 0; i < sidecar.objects.size(); i++)
+    {
+        const LabeledObject &object = sidecar.objects[i];
+        putValue<int32_t>(buffer, object.type);
+        putValue<uint32_t>(buffer, object.numPoints);
+        putValue<float>(buffer, object.height);
+        putValue<float>(buffer, object.inlierRatio);
+        putValue<float>(buffer, object.rmse);
+        putValue<uint32_t>(buffer, static_cast<uint32_t>(object.coefficients.size()));
+        for(size_t j = 0; j < object.coefficients.size(); j++)
+        {
+            putValue<float>(buffer, object.coefficients[j]);
+        }
+    }
+
+    // the run count is patched in once the runs are encoded
+    size_t runCountOffset = buffer.size();
+    putValue<uint32_t>(buffer, 0);
+    uint32_t numRuns = 0;
+    const std::vector<int> &labels = sidecar.labels;
+    for(size_t i = 0; i < labels.size(); )
+    {
+        size_t end = i + 1;
+        while(end < labels.size() && labels[end] == labels[i])
+        {
+            end++;
+        }
+        putVarint(buffer, static_cast<uint32_t>(labels[i]));
+        putVarint(buffer, static_cast<uint32_t>(end - i));
+        numRuns++;
+        i = end;
+    }
+    std::memcpy(&buffer[runCountOffset], &numRuns, sizeof(numRuns));
+
+    const std::string temporaryName = fileName + ".tmp";
+    FILE *file = std::fopen(temporaryName.c_str(), "wb");
+    if(file == NULL)
+    {
+        return false;
+    }
+    bool valid = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    valid = std::fclose(file) == 0 && valid;
+    if(!valid || std::rename(temporaryName.c_str(), fileName.c_str()) != 0)
+    {
+        std::remove(temporaryName.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Reads a label file
+ * @param[in] fileName path of the file
+ * @param[out] sidecar labels and objects read
+ * @return false if the file cannot be read or is not a valid label file
+ **********************************************************************************************************************/
+bool readLabelSidecar(const std::string &fileName, LabelSidecar &sidecar)
+{
+    FILE *file = std::fopen(fileName.c_str(), "rb");
+    if(file == NULL)
+    {
+        return false;
+    }
+    std::vector<unsigned char> buffer;
+    unsigned char block[65536];
+    size_t bytesRead = 0;
+    while((bytesRead = std::fread(block, 1, sizeof(block), file)) > 0)
+    {
+        buffer.insert(buffer.end(), block, block + bytesRead);
+    }
+    std::fclose(file);
+    if(buffer.size() < sizeof(SIDECAR_MAGIC) || std::memcmp(&buffer[0], SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    SidecarReader reader(buffer);
+    reader.offset = sizeof(SIDECAR_MAGIC);
+    if(reader.value<uint32_t>() != SIDECAR_VERSION)
+    {
+        return false;
+    }
+    sidecar.inputHash = reader.value<uint64_t>();
+    sidecar.inputSize = reader.value<uint64_t>();
+    uint32_t numPoints = reader.value<uint32_t>();
+    uint32_t numObjects = reader.value<uint32_t>();
+    sidecar.objects.clear();
+    for(uint32_t i = 0; i < numObjects && reader.valid; i++)
+    {
+        LabeledObject object;
+        object.type = reader.value<int32_t>();
+        object.numPoints = reader.value<uint32_t>();
+        object.height = reader.value<float>();
+        object.inlierRatio = reader.value<float>();
+        object.rmse = reader.value<float>();
+        uint32_t numCoefficients = reader.value<uint32_t>();
+        for(uint32_t j = 0; j < numCoefficients && reader.valid; j++)
+        {
+            object.coefficients.push_back(reader.value<float>());
+        }
+        sidecar.objects.push_back(object);
+    }
+
+    // expand the runs, rejecting runs past the number of points or labels of unknown objects
+    uint32_t numRuns = reader.value<uint32_t>();
+    if(!reader.valid)
+    {
+        return false;
+    }
+    sidecar.labels.assign(numPoints, 0);
+    size_t position = 0;
+    for(uint32_t i = 0; i < numRuns && reader.valid; i++)
+    {
+        uint32_t label = reader.varint();
+        uint32_t length = reader.varint();
+        if(label > numObjects || length > numPoints - position)
+        {
+            return false;
+        }
+        std::fill(sidecar.labels.begin() + position, sidecar.labels.begin() + position + length,
+            static_cast<int>(label));
+        position += length;
+    }
+    return reader.valid && position == numPoints;
+}
@@ -0,0 +1,58 @@
+/***********************************************************************************************************************
+* @file label_sidecar.h
+* @brief compact label file describing the objects found in a cloud, written instead of the recolored cloud
+*
+* The file stores the object of every point of the input cloud, run-length encoded in the order of the points, and the
+* type and fitted model of each object. It is tied to its input by the size and content hash of the input file, so a
+* reader can tell whether the labels still apply to a given cloud.
+*
+* Layout (little endian):
+*   "DLBL", version (u32), input hash (u64), input size (u64), number of points (u32), number of objects (u32)
+*   per object: type (i32), number of points (u32), height, inlier ratio, rmse (f32), number of coefficients (u32),
+*               coefficients (f32)
+*   number of runs (u32), runs of (object, length) as variable length integers
+**********************************************************************************************************************/
+
+#ifndef DETECT_LABEL_SIDECAR_H
+#define DETECT_LABEL_SIDECAR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// classification of the objects, and of the points they contain
+enum PointLabel {LABEL_NONE, LABEL_TABLE, LABEL_BOX, LABEL_SPHERE};
+
+/*******************************************************************************************************************//**
+ * @brief An object found in the cloud and its fitted model
+ *
+ * The coefficients are the plane (a, b, c, d) of the table, the sphere (x, y, z, radius), or the faces of a box, four
+ * plane coefficients per face. The height is measured above the table.
+ **********************************************************************************************************************/
+struct LabeledObject
+{
+    int type;
+    uint32_t numPoints;
+    float height;
+    float inlierRatio;
+    float rmse;
+    std::vector<float> coefficients;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Content of a label file
+ *
+ * The label of a point is 0 when it belongs to no object, or the index of its object plus one.
+ **********************************************************************************************************************/
+struct LabelSidecar
+{
+    uint64_t inputHash;
+    uint64_t inputSize;
+    std::vector<int> labels;
+    std::vector<LabeledObject> objects;
+};
+
+bool writeLabelSidecar(const std::string &fileName, const LabelSidecar &sidecar);
+bool readLabelSidecar(const std::string &fileName, LabelSidecar &sidecar);
+
+#endif
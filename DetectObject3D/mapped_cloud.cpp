@@ -0,0 +1,520 @@
+/***********************************************************************************************************************
+* @file mapped_cloud.cpp
+* @brief memory-mapped reader for binary PCD and PLY point cloud files
+**********************************************************************************************************************/
+
+#include "mapped_cloud.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "task_pool.h"
+
+/*******************************************************************************************************************//**
+ * @brief Creates a reader with no file open
+ **********************************************************************************************************************/
+MappedCloud::MappedCloud():
+    _fileDescriptor(-1), _mapping(NULL), _mappingSize(0), _points(NULL), _pointStep(0), _numPoints(0), _width(0),
+    _height(0)
+{
+}
+
+MappedCloud::~MappedCloud()
+{
+    close();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Maps a point cloud file and parses its header
+ *
+ * Only uncompressed binary files are supported: PCD files with "DATA binary" and little endian binary PLY files whose
+ * first element is the vertex list. Other files are rejected, so the caller can fall back to the PCL readers.
+ *
+ * @param[in] fileName path and name of the PCD or PLY file
+ * @return false if the file cannot be mapped or its format is not supported
+ **********************************************************************************************************************/
+bool MappedCloud::open(const std::string &fileName)
+{
+    close();
+    _fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if(_fileDescriptor < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if(fstat(_fileDescriptor, &status) != 0 || status.st_size <= 0)
+    {
+        close();
+        return false;
+    }
+    _mappingSize = static_cast<size_t>(status.st_size);
+    void *mapping = mmap(NULL, _mappingSize, PROT_READ, MAP_PRIVATE, _fileDescriptor, 0);
+    if(mapping == MAP_FAILED)
+    {
+        _mappingSize = 0;
+        close();
+        return false;
+    }
+    _mapping = static_cast<unsigned char *>(mapping);
+
+    // parse the header matching the file extension
+    std::string fileExtension = fileName.substr(fileName.find_last_of(".") + 1);
+    size_t dataOffset = 0;
+    bool parsed = false;
+    if(fileExtension.compare("pcd") == 0)
+    {
+        parsed = parsePcdHeader(dataOffset);
+    }
+    else if(fileExtension.compare("ply") == 0)
+    {
+        parsed = parsePlyHeader(dataOffset);
+    }
+    if(!parsed || _pointStep == 0 || dataOffset > _mappingSize || (_mappingSize - dataOffset) / _pointStep < _numPoints)
+    {
+        close();
+        return false;
+    }
+    _points = _mapping + dataOffset;
+    madvise(_mapping, _mappingSize, MADV_SEQUENTIAL);
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Unmaps the file
+ **********************************************************************************************************************/
+void MappedCloud::close()
+{
+    if(_mapping != NULL)
+    {
+        munmap(_mapping, _mappingSize);
+    }
+    if(_fileDescriptor >= 0)
+    {
+        ::close(_fileDescriptor);
+    }
+    _fileDescriptor = -1;
+    _mapping = NULL;
+    _mappingSize = 0;
+    _points = NULL;
+    _pointStep = 0;
+    _numPoints = 0;
+    _width = 0;
+    _height = 0;
+    _fields.clear();
+}
+
+size_t MappedCloud::size() const
+{
+    return _numPoints;
+}
+
+unsigned int MappedCloud::width() const
+{
+    return _width;
+}
+
+unsigned int MappedCloud::height() const
+{
+    return _height;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Finds a field by name
+ * @param[in] name field name
+ * @return the field description, or NULL if the points have no such field
+ **********************************************************************************************************************/
+const MappedField *MappedCloud::field(const std::string &name) const
+{
+    for(size_t i = 0; i < _fields.size(); i++)
+    {
+        if(_fields[i].name == name)
+        {
+            return &_fields[i];
+        }
+    }
+    return NULL;
+}
+
+const std::vector<MappedField> &MappedCloud::fields() const
+{
+    return _fields;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the views of the x, y and z coordinates over all points
+ * @param[out] x column of the x coordinates
+ * @param[out] y column of the y coordinates
+ * @param[out] z column of the z coordinates
+ * @return false if the points have no single precision x, y and z fields
+ **********************************************************************************************************************/
+bool MappedCloud::positionColumns(StridedView<float> &x, StridedView<float> &y, StridedView<float> &z) const
+{
+    return column("x", x) && column("y", y) && column("z", z);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the views of the color fields over all points
+ * @param[out] colors views of the color fields present in the file
+ **********************************************************************************************************************/
+void MappedCloud::colorColumns(ColorColumns &colors) const
+{
+    colors = ColorColumns();
+    if(!column("rgb", colors.packed))
+    {
+        column("rgba", colors.packed);
+    }
+    column("red", colors.red);
+    column("green", colors.green);
+    column("blue", colors.blue);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Releases the resident pages of a range of points, they are read from the file again if accessed later
+ * @param[in] begin first point of the range
+ * @param[in] end one past the last point of the range
+ **********************************************************************************************************************/
+void MappedCloud::release(size_t begin, size_t end) const
+{
+    if(_mapping == NULL || begin >= end)
+    {
+        return;
+    }
+
+    // release the pages from the one holding the first point, which may be shared with the previous range, to the last
+    // page fully covered by the range, so streaming consecutive ranges releases every page once
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t first = static_cast<size_t>(_points - _mapping) + begin * _pointStep;
+    size_t last = static_cast<size_t>(_points - _mapping) + end * _pointStep;
+    first = first / pageSize * pageSize;
+    last = end == _numPoints ? _mappingSize : last / pageSize * pageSize;
+    if(last > first)
+    {
+        madvise(_mapping + first, last - first, MADV_DONTNEED);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Converts a range of points into a PCL cloud
+ *
+ * Colors are read from a packed "rgb" or "rgba" field (PCD), or from "red", "green" and "blue" fields (PLY).
+ *
+ * @param[out] cloud destination cloud, already sized to hold every point
+ * @param[in] begin first point of the range
+ * @param[in] end one past the last point of the range
+ **********************************************************************************************************************/
+void MappedCloud::copyTo(pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t begin, size_t end) const
+{
+    StridedView<float> x, y, z;
+    ColorColumns colors;
+    const bool hasPosition = positionColumns(x, y, z);
+    colorColumns(colors);
+    for(size_t i = begin; i < end; i++)
+    {
+        pcl::PointXYZRGBA &point = cloud.points[i];
+        point.x = hasPosition ? x[i] : 0.0f;
+        point.y = hasPosition ? y[i] : 0.0f;
+        point.z = hasPosition ? z[i] : 0.0f;
+        point.rgba = colors.rgba(i);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Converts every point into a PCL cloud, in parallel over the mapped pages
+ * @param[out] cloud destination cloud
+ * @return false if the points have no x, y and z fields
+ **********************************************************************************************************************/
+bool MappedCloud::toPointCloud(pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const
+{
+    StridedView<float> x, y, z;
+    if(!positionColumns(x, y, z))
+    {
+        return false;
+    }
+    cloud.points.resize(_numPoints);
+    cloud.width = _width;
+    cloud.height = _height;
+    cloud.is_dense = false;
+    parallelRanges(0, _numPoints, [&](size_t begin, size_t end, int)
+    {
+        copyTo(cloud, begin, end);
+    });
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Reads the lines of a text header
+ * @param[in] mapping mapped file
+ * @param[in] size size of the mapped file
+ * @param[in,out] position offset of the next line, moved past the line
+ * @param[out] line line read, without its end of line characters
+ * @return false at the end of the file
+ **********************************************************************************************************************/
+static bool readLine(const unsigned char *mapping, size_t size, size_t &position, std::string &line)
+{
+    if(position >= size)
+    {
+        return false;
+    }
+    size_t end = position;
+    while(end < size && mapping[end] != '\n')
+    {
+        end++;
+    }
+    line.assign(reinterpret_cast<const char *>(mapping) + position, end - position);
+    if(!line.empty() && line[line.size() - 1] == '\r')
+    {
+        line.erase(line.size() - 1);
+    }
+    position = end < size ? end + 1 : end;
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Checks that the coordinates of the points, when present, are plain floating point values
+ *
+ * The columns are read by size, so integer or multi-valued x, y or z fields would be misread as floats. Such files are
+ * left to the PCL readers, which convert them.
+ *
+ * @param[in] fields fields of the points
+ * @return false if x, y or z is not a single floating point value
+ **********************************************************************************************************************/
+static bool floatingPointPositions(const std::vector<MappedField> &fields)
+{
+    for(size_t i = 0; i < fields.size(); i++)
+    {
+        const MappedField &info = fields[i];
+        if((info.name == "x" || info.name == "y" || info.name == "z") && (info.type != 'F' || info.count != 1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Parses the header of a PCD file
+ * @param[out] dataOffset offset of the first point in the file
+ * @return false if the header is invalid, the data is not stored in uncompressed binary form, or the coordinates are
+ * not floating point
+ **********************************************************************************************************************/
+bool MappedCloud::parsePcdHeader(size_t &dataOffset)
+{
+    std::vector<std::string> names;
+    std::vector<int> sizes;
+    std::vector<char> types;
+    std::vector<int> counts;
+    size_t points = 0;
+    size_t position = 0;
+    std::string line;
+    while(readLine(_mapping, _mappingSize, position, line))
+    {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if(keyword.empty() || keyword[0] == '#')
+        {
+            continue;
+        }
+        std::string value;
+        if(keyword == "FIELDS")
+        {
+            while(stream >> value)
+            {
+                names.push_back(value);
+            }
+        }
+        else if(keyword == "SIZE")
+        {
+            while(stream >> value)
+            {
+                sizes.push_back(std::atoi(value.c_str()));
+            }
+        }
+        else if(keyword == "TYPE")
+        {
+            while(stream >> value)
+            {
+                types.push_back(value[0]);
+            }
+        }
+        else if(keyword == "COUNT")
+        {
+            while(stream >> value)
+            {
+                counts.push_back(std::atoi(value.c_str()));
+            }
+        }
+        else if(keyword == "WIDTH")
+        {
+            stream >> _width;
+        }
+        else if(keyword == "HEIGHT")
+        {
+            stream >> _height;
+        }
+        else if(keyword == "POINTS")
+        {
+            stream >> points;
+        }
+        else if(keyword == "DATA")
+        {
+            stream >> value;
+            if(value != "binary")
+            {
+                return false;
+            }
+            dataOffset = position;
+            break;
+        }
+    }
+    if(dataOffset == 0 || names.empty() || sizes.size() != names.size() || types.size() != names.size())
+    {
+        return false;
+    }
+
+    // the fields of a point are packed one after the other
+    for(size_t i = 0; i < names.size(); i++)
+    {
+        MappedField info;
+        info.name = names[i];
+        info.type = types[i];
+        info.size = sizes[i];
+        info.count = i < counts.size() ? counts[i] : 1;
+        info.offset = _pointStep;
+        _pointStep += static_cast<size_t>(info.size) * info.count;
+        _fields.push_back(info);
+    }
+    if(!floatingPointPositions(_fields))
+    {
+        return false;
+    }
+    _numPoints = points > 0 ? points : static_cast<size_t>(_width) * _height;
+    if(_height == 0 || static_cast<size_t>(_width) * _height != _numPoints)
+    {
+        _width = static_cast<unsigned int>(_numPoints);
+        _height = 1;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Parses the header of a PLY file
+ * @param[out] dataOffset offset of the first vertex in the file
+ * @return false if the header is invalid, the file is not little endian binary, the vertices are not the first
+ * element, or their coordinates are not floating point
+ **********************************************************************************************************************/
+bool MappedCloud::parsePlyHeader(size_t &dataOffset)
+{
+    size_t position = 0;
+    std::string line;
+    if(!readLine(_mapping, _mappingSize, position, line) || line != "ply")
+    {
+        return false;
+    }
+    bool binary = false;
+    bool inVertex = false;
+    bool seenElement = false;
+    while(readLine(_mapping, _mappingSize, position, line))
+    {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if(keyword == "format")
+        {
+            std::string format;
+            stream >> format;
+            binary = format == "binary_little_endian";
+        }
+        else if(keyword == "element")
+        {
+            std::string name;
+            size_t count = 0;
+            stream >> name >> count;
+            inVertex = name == "vertex" && !seenElement;
+            if(inVertex)
+            {
+                _numPoints = count;
+            }
+            else if(!seenElement)
+            {
+                return false;
+            }
+            seenElement = true;
+        }
+        else if(keyword == "property" && inVertex)
+        {
+            std::string type;
+            std::string name;
+            stream >> type >> name;
+            if(type == "list")
+            {
+                return false;
+            }
+            MappedField info;
+            info.name = name;
+            info.count = 1;
+            if(type == "float" || type == "float32")
+            {
+                info.type = 'F';
+                info.size = 4;
+            }
+            else if(type == "double" || type == "float64")
+            {
+                info.type = 'F';
+                info.size = 8;
+            }
+            else if(type == "uchar" || type == "uint8")
+            {
+                info.type = 'U';
+                info.size = 1;
+            }
+            else if(type == "char" || type == "int8")
+            {
+                info.type = 'I';
+                info.size = 1;
+            }
+            else if(type == "ushort" || type == "uint16")
+            {
+                info.type = 'U';
+                info.size = 2;
+            }
+            else if(type == "short" || type == "int16")
+            {
+                info.type = 'I';
+                info.size = 2;
+            }
+            else if(type == "uint" || type == "uint32")
+            {
+                info.type = 'U';
+                info.size = 4;
+            }
+            else if(type == "int" || type == "int32")
+            {
+                info.type = 'I';
+                info.size = 4;
+            }
+            else
+            {
+                return false;
+            }
+            info.offset = _pointStep;
+            _pointStep += info.size;
+            _fields.push_back(info);
+        }
+        else if(keyword == "end_header")
+        {
+            dataOffset = position;
+            break;
+        }
+    }
+    if(!binary || dataOffset == 0 || !floatingPointPositions(_fields))
+    {
+        return false;
+    }
+    _width = static_cast<unsigned int>(_numPoints);
+    _height = 1;
+    return true;
+}
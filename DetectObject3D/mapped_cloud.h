@@ -0,0 +1,168 @@
+/***********************************************************************************************************************
+* @file mapped_cloud.h
+* @brief memory-mapped reader for binary PCD and PLY point cloud files
+*
+* The file is mapped read-only and each field is exposed as a strided column view over the mapped bytes, so opening a
+* cloud only parses the header and the points are paged in on first access. The columns can be read in place, e.g. to
+* build a voxel index without an intermediate PCL cloud, or converted into a PCL cloud in a single parallel pass. Files
+* larger than memory are streamed in chunks, releasing the pages of each chunk once it has been processed.
+**********************************************************************************************************************/
+
+#ifndef DETECT_MAPPED_CLOUD_H
+#define DETECT_MAPPED_CLOUD_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// number of points per chunk when streaming a mapped file, about 16 MB of a binary PCD file with x, y, z and rgb
+const size_t MAPPED_CHUNK_POINTS = 1 << 20;
+
+/*******************************************************************************************************************//**
+ * @brief Read-only view of one field of every point, located at a fixed stride in memory
+ **********************************************************************************************************************/
+template<typename T>
+struct StridedView
+{
+    const unsigned char *data;
+    size_t stride;
+    size_t size;
+
+    StridedView(): data(NULL), stride(0), size(0)
+    {
+    }
+
+    // fields are not necessarily aligned in the file, so values are copied out
+    T operator[](size_t i) const
+    {
+        T value;
+        std::memcpy(&value, data + i * stride, sizeof(T));
+        return value;
+    }
+};
+
+/*******************************************************************************************************************//**
+ * @brief Views of the color of every point
+ *
+ * Colors are packed in a "rgb" or "rgba" field in PCD files, and split into "red", "green" and "blue" fields in PLY
+ * files. The views of the missing fields are left empty.
+ **********************************************************************************************************************/
+struct ColorColumns
+{
+    StridedView<uint32_t> packed;
+    StridedView<uint8_t> red;
+    StridedView<uint8_t> green;
+    StridedView<uint8_t> blue;
+
+    // color of a point in the layout of pcl::PointXYZRGBA::rgba, opaque black if the points have no color
+    uint32_t rgba(size_t i) const
+    {
+        if(packed.data != NULL)
+        {
+            return packed[i];
+        }
+        if(red.data != NULL && green.data != NULL && blue.data != NULL)
+        {
+            return 0xff000000u | static_cast<uint32_t>(red[i]) << 16 | static_cast<uint32_t>(green[i]) << 8 | blue[i];
+        }
+        return 0xff000000u;
+    }
+};
+
+/*******************************************************************************************************************//**
+ * @brief Description of a field of the points
+ *
+ * The type follows the PCD conventions: 'F' for floating point, 'U' for unsigned and 'I' for signed integers.
+ **********************************************************************************************************************/
+struct MappedField
+{
+    std::string name;
+    char type;
+    int size;
+    int count;
+    size_t offset;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Binary PCD or PLY file mapped into memory
+ **********************************************************************************************************************/
+class MappedCloud
+{
+    public:
+        MappedCloud();
+        ~MappedCloud();
+        bool open(const std::string &fileName);
+        void close();
+        size_t size() const;
+        unsigned int width() const;
+        unsigned int height() const;
+        const std::vector<MappedField> &fields() const;
+        const MappedField *field(const std::string &name) const;
+        bool positionColumns(StridedView<float> &x, StridedView<float> &y, StridedView<float> &z) const;
+        void colorColumns(ColorColumns &colors) const;
+        void release(size_t begin, size_t end) const;
+        bool toPointCloud(pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const;
+
+        /***************************************************************************************************************
+         * @brief Gets a view of a field over all points
+         * @param[in] name field name
+         * @param[out] view column view of the field
+         * @return false if the field does not exist or its size does not match the requested type
+         **************************************************************************************************************/
+        template<typename T>
+        bool column(const std::string &name, StridedView<T> &view) const
+        {
+            const MappedField *info = field(name);
+            if(info == NULL || info->size != static_cast<int>(sizeof(T)))
+            {
+                return false;
+            }
+            view.data = _points + info->offset;
+            view.stride = _pointStep;
+            view.size = _numPoints;
+            return true;
+        }
+
+        /***************************************************************************************************************
+         * @brief Processes the points in consecutive chunks, releasing the pages of each chunk afterwards
+         *
+         * Only about one chunk of the file is resident at a time, which allows processing files larger than memory.
+         *
+         * @param[in] chunkPoints number of points per chunk
+         * @param[in] function callable taking the (begin, end) point range of a chunk
+         **************************************************************************************************************/
+        template<typename Function>
+        void forEachChunk(size_t chunkPoints, Function function) const
+        {
+            chunkPoints = chunkPoints > 0 ? chunkPoints : 1;
+            for(size_t begin = 0; begin < _numPoints; begin += chunkPoints)
+            {
+                size_t end = begin + chunkPoints < _numPoints ? begin + chunkPoints : _numPoints;
+                function(begin, end);
+                release(begin, end);
+            }
+        }
+
+    private:
+        MappedCloud(const MappedCloud &);
+        MappedCloud &operator=(const MappedCloud &);
+
+        void copyTo(pcl::PointCloud<pcl::PointXYZRGBA> &cloud, size_t begin, size_t end) const;
+        bool parsePcdHeader(size_t &dataOffset);
+        bool parsePlyHeader(size_t &dataOffset);
+
+        int _fileDescriptor;
+        unsigned char *_mapping;
+        size_t _mappingSize;
+        const unsigned char *_points;
+        size_t _pointStep;
+        size_t _numPoints;
+        unsigned int _width;
+        unsigned int _height;
+        std::vector<MappedField> _fields;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/***********************************************************************************************************************
+* @file organized_segmentation.cpp
+* @brief table and object segmentation of organized clouds, using the neighborhoods of the image grid
+**********************************************************************************************************************/
+
+#include "organized_segmentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <pcl/pcl_config.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/segmentation/euclidean_cluster_comparator.h>
+#include <pcl/segmentation/organized_connected_component_segmentation.h>
+#include <pcl/segmentation/organized_multi_plane_segmentation.h>
+#include <pcl/segmentation/planar_region.h>
+
+// the comparator dropped its normal type and takes a set of excluded labels since PCL 1.10
+#if PCL_VERSION_COMPARE(>=, 1, 10, 0)
+typedef pcl::EuclideanClusterComparator<pcl::PointXYZRGBA, pcl::Label> ClusterComparator;
+#else
+typedef pcl::EuclideanClusterComparator<pcl::PointXYZRGBA, pcl::Normal, pcl::Label> ClusterComparator;
+#endif
+
+/*******************************************************************************************************************//**
+ * @brief Default parameters, matching the distance thresholds of the unorganized pipeline
+ **********************************************************************************************************************/
+OrganizedParams::OrganizedParams():
+    maxDepthChangeFactor(0.02f), normalSmoothingSize(10.0f), angularThreshold(3.0 * M_PI / 180.0),
+    distanceThreshold(0.0254), minPlaneRatio(0.02), minPlaneInliers(1000), clusterDistance(0.02f),
+    minClusterSize(50), maxClusterSize(100000)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Segments the table and the object clusters of an organized cloud
+ * @param[in] cloud organized input point cloud
+ * @param[in] params segmentation parameters
+ * @param[out] result table plane and inliers, and object clusters
+ * @return false if the cloud is not organized or contains no plane
+ **********************************************************************************************************************/
+bool organizedSegment(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, const OrganizedParams &params,
+    OrganizedResult &result)
+{
+    result.tablePlane.clear();
+    result.tableInliers.indices.clear();
+    result.clusters.clear();
+    result.numPlanes = 0;
+    if(!cloud->isOrganized() || cloud->points.empty())
+    {
+        return false;
+    }
+
+    // estimate the normals from integral images over the grid, without any neighbor search
+    pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
+    pcl::IntegralImageNormalEstimation<pcl::PointXYZRGBA, pcl::Normal> normalEstimation;
+    normalEstimation.setNormalEstimationMethod(normalEstimation.COVARIANCE_MATRIX);
+    normalEstimation.setMaxDepthChangeFactor(params.maxDepthChangeFactor);
+    normalEstimation.setNormalSmoothingSize(params.normalSmoothingSize);
+    normalEstimation.setInputCloud(cloud);
+    normalEstimation.compute(*normals);
+
+    // extract every planar region in one pass over the grid
+    const unsigned int minInliers = static_cast<unsigned int>(std::max<double>(params.minPlaneInliers,
+        params.minPlaneRatio * cloud->points.size()));
+    pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGBA, pcl::Normal, pcl::Label> planeSegmentation;
+    planeSegmentation.setMinInliers(minInliers);
+    planeSegmentation.setAngularThreshold(params.angularThreshold);
+    planeSegmentation.setDistanceThreshold(params.distanceThreshold);
+    planeSegmentation.setInputNormals(normals);
+    planeSegmentation.setInputCloud(cloud);
+    std::vector<pcl::PlanarRegion<pcl::PointXYZRGBA>,
+        Eigen::aligned_allocator<pcl::PlanarRegion<pcl::PointXYZRGBA> > > regions;
+    std::vector<pcl::ModelCoefficients> planeCoefficients;
+    std::vector<pcl::PointIndices> planeInliers;
+    pcl::PointCloud<pcl::Label>::Ptr planeLabels(new pcl::PointCloud<pcl::Label>);
+    std::vector<pcl::PointIndices> labelIndices;
+    std::vector<pcl::PointIndices> boundaryIndices;
+    planeSegmentation.segmentAndRefine(regions, planeCoefficients, planeInliers, planeLabels, labelIndices,
+        boundaryIndices);
+    if(planeInliers.empty())
+    {
+        return false;
+    }
+
+    // the largest plane is the table
+    size_t table = 0;
+    for(size_t i = 1; i < planeInliers.size(); i++)
+    {
+        if(planeInliers[i].indices.size() > planeInliers[table].indices.size())
+        {
+            table = i;
+        }
+    }
+    result.tablePlane = planeCoefficients[table].values;
+    result.tableInliers = planeInliers[table];
+    result.numPlanes = static_cast<int>(planeInliers.size());
+
+    // cluster the points outside of every plane by connected components of the grid
+    ClusterComparator::Ptr comparator(new ClusterComparator);
+    comparator->setInputCloud(cloud);
+    comparator->setLabels(planeLabels);
+    comparator->setDistanceThreshold(params.clusterDistance, false);
+#if PCL_VERSION_COMPARE(>=, 1, 10, 0)
+    ClusterComparator::ExcludeLabelSetPtr excludeLabels(new ClusterComparator::ExcludeLabelSet);
+    for(size_t i = 0; i < labelIndices.size(); i++)
+    {
+        if(labelIndices[i].indices.size() >= minInliers)
+        {
+            excludeLabels->insert(static_cast<uint32_t>(i));
+        }
+    }
+    comparator->setExcludeLabels(excludeLabels);
+#else
+    std::vector<bool> excludeLabels(labelIndices.size(), false);
+    for(size_t i = 0; i < labelIndices.size(); i++)
+    {
+        excludeLabels[i] = labelIndices[i].indices.size() >= minInliers;
+    }
+    comparator->setInputNormals(normals);
+    comparator->setExcludeLabels(excludeLabels);
+#endif
+
+    pcl::OrganizedConnectedComponentSegmentation<pcl::PointXYZRGBA, pcl::Label> clustering(comparator);
+    clustering.setInputCloud(cloud);
+    pcl::PointCloud<pcl::Label> clusterLabels;
+    std::vector<pcl::PointIndices> clusterIndices;
+    clustering.segment(clusterLabels, clusterIndices);
+    for(size_t i = 0; i < clusterIndices.size(); i++)
+    {
+        const int size = static_cast<int>(clusterIndices[i].indices.size());
+        if(size >= params.minClusterSize && size <= params.maxClusterSize)
+        {
+            result.clusters.push_back(clusterIndices[i]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+/***********************************************************************************************************************
+* @file organized_segmentation.h
+* @brief table and object segmentation of organized clouds, using the neighborhoods of the image grid
+*
+* Depth cameras deliver organized clouds, where the neighbors of a point are the adjacent pixels. Normals are estimated
+* from integral images, every planar region is extracted in a single pass over the grid, and the remaining points are
+* clustered by connected components of the grid, so no search structure and no random sampling are needed.
+**********************************************************************************************************************/
+
+#ifndef DETECT_ORGANIZED_SEGMENTATION_H
+#define DETECT_ORGANIZED_SEGMENTATION_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of the organized segmentation
+ *
+ * Planes need at least the given share of the points of the cloud, and at least the given number of points.
+ **********************************************************************************************************************/
+struct OrganizedParams
+{
+    float maxDepthChangeFactor;
+    float normalSmoothingSize;
+    double angularThreshold;
+    double distanceThreshold;
+    double minPlaneRatio;
+    int minPlaneInliers;
+    float clusterDistance;
+    int minClusterSize;
+    int maxClusterSize;
+
+    OrganizedParams();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Table and object clusters found in an organized cloud
+ *
+ * The table is the largest planar region. The points of every planar region are left out of the clusters.
+ **********************************************************************************************************************/
+struct OrganizedResult
+{
+    std::vector<float> tablePlane;
+    pcl::PointIndices tableInliers;
+    std::vector<pcl::PointIndices> clusters;
+    int numPlanes;
+};
+
+bool organizedSegment(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, const OrganizedParams &params,
+    OrganizedResult &result);
+
+#endif
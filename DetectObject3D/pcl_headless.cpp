@@ -23,155 +23,102 @@
 * @author Christopher D. McMurrough
 **********************************************************************************************************************/
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
-#include <pcl/io/pcd_io.h>
-#include <pcl/io/ply_io.h>
 #include <pcl/common/time.h>
+#include <pcl/console/print.h>
 
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/sac_model_plane.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/sample_consensus/sac_model_sphere.h>
-#include <pcl/sample_consensus/sac_model_cylinder.h>
-#include <pcl/sample_consensus/sac_model_cone.h>
-
-#include <pcl/filters/extract_indices.h>
-#include <pcl/filters/statistical_outlier_removal.h>
-#include <pcl/filters/voxel_grid.h>
-
-#include <pcl/kdtree/kdtree_flann.h>
-#include <pcl/kdtree/io.h>
-#include <pcl/segmentation/euclidean_cluster_comparator.h>
-#include <pcl/filters/statistical_outlier_removal.h>
-#include <pcl/segmentation/extract_clusters.h>
+#include "sequence_reader.h"
+#include "tabletop_pipeline.h"
+#include "task_pool.h"
 
 #define NUM_COMMAND_ARGS 2
 
-enum TypeModel {BOX,SPHERE};
+// number of frames loaded ahead in sequence mode
+const size_t SEQUENCE_PREFETCH_DEPTH = 2;
 
 /***********************************************************************************************************************
-* @brief Opens a point cloud file
+* @brief Processes every frame of a directory in order, warm starting the plane of each frame from the previous one
 *
-* Opens a point cloud file in either PCD or PLY format
+* The next frames are loaded on a separate thread while the current one is processed. The output of each frame is
+* saved in the output directory under the name of its input file.
 *
-* @param[out] cloudOut pointer to opened point cloud
-* @param[in] filename path and name of input file
-* @return false if an error occurred while opening file
-* @author Christopher D. McMurrough
+* @param[in] inputDirectory directory containing the PCD or PLY frames
+* @param[in] outputDirectory directory receiving the outputs
+* @param[in] params pipeline parameters
+* @param[in] outputMode content of the output files
+* @return return code (0 if every frame was processed)
 **********************************************************************************************************************/
-bool openCloud(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudOut, std::string fileName)
+int processSequence(const std::string &inputDirectory, const std::string &outputDirectory,
+    const PipelineParams &params, OutputMode outputMode)
 {
-    // handle various file types
-    std::string fileExtension = fileName.substr(fileName.find_last_of(".") + 1);
-    if(fileExtension.compare("pcd") == 0)
-    {
-        // attempt to open the file
-        if(pcl::io::loadPCDFile<pcl::PointXYZRGBA>(fileName, *cloudOut) == -1)
-        {
-            PCL_ERROR("error while attempting to read pcd file: %s \n", fileName.c_str());
-            return false;
-        }
-        else
-        {
-            return true;
-        }
-    }
-    else if(fileExtension.compare("ply") == 0)
+    std::vector<std::string> fileNames;
+    if(!listSequenceFrames(inputDirectory, fileNames))
     {
-        // attempt to open the file
-        if(pcl::io::loadPLYFile<pcl::PointXYZRGBA>(fileName, *cloudOut) == -1)
-        {
-            PCL_ERROR("error while attempting to read pcl file: %s \n", fileName.c_str());
-            return false;
-        }
-        else
-        {
-            return true;
-        }
+        PCL_ERROR("error while attempting to read directory: %s \n", inputDirectory.c_str());
+        return 1;
     }
-    else
+    if(fileNames.empty())
     {
-        PCL_ERROR("error while attempting to read unsupported file: %s \n", fileName.c_str());
-        return false;
+        PCL_ERROR("no pcd or ply file in directory: %s \n", inputDirectory.c_str());
+        return 1;
     }
-}
 
-/*******************************************************************************************************************//**
- * @brief Saves a point cloud to file
- *
- * Saves a given point cloud to disk in PCD format
- *
- * @param[in] cloudIn pointer to output point cloud
- * @param[in] filename path and name of output file
- * @param[in] binaryMode saves the file in binary form if true (default:false)
- * @return false if an error occured while writing file
- * @author Christopher D. McMurrough
- **********************************************************************************************************************/
-bool saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn, std::string fileName, bool binaryMode=true)
-{
-    // if the input cloud is empty, return
-    if(cloudIn->points.size() == 0)
+    // load the frames ahead of their processing
+    SequenceReader reader(fileNames, [](const std::string &fileName, SequenceReader::CloudPtr &cloud)
     {
-        return false;
-    }
+        return openCloud(cloud, fileName);
+    }, SEQUENCE_PREFETCH_DEPTH);
 
-    // attempt to save the file
-    if(pcl::io::savePCDFile<pcl::PointXYZRGBA>(fileName, *cloudIn, binaryMode) == -1)
+    pcl::StopWatch watch;
+    PlaneTracker tracker;
+    int numFrames = 0;
+    int numFailed = 0;
+    int numWarm = 0;
+    double totalSeconds = 0;
+    double worstSeconds = 0;
+    std::string fileName;
+    SequenceReader::CloudPtr cloud;
+    bool loaded = false;
+    while(reader.next(fileName, cloud, loaded))
     {
-        PCL_ERROR("error while attempting to save pcd file: %s \n", fileName);
-        return false;
+        std::string baseName = fileName.substr(fileName.find_last_of("/") + 1);
+        FrameResult result;
+        if(!loaded || !processCloud(cloud, params, &tracker, NULL, false, result))
+        {
+            std::printf("%s: failed \n", baseName.c_str());
+            tracker.valid = false;
+            numFailed++;
+            continue;
+        }
+        numFrames++;
+        numWarm += tracker.warmStarted ? 1 : 0;
+        totalSeconds += result.seconds;
+        worstSeconds = std::max(worstSeconds, result.seconds);
+        std::printf("%s: %s plane (%.0f%% inliers), %d boxes, %d spheres, %.1f ms \n", baseName.c_str(),
+            tracker.warmStarted ? "warm" : "cold", 100.0 * tracker.inlierRatio, result.boxes, result.spherical,
+            1e3 * result.seconds);
+
+        // save the output with the name of the input
+        std::string outputName = baseName.substr(0, baseName.find_last_of(".")) +
+            (outputMode == OUTPUT_LABELS ? ".labels" : ".pcd");
+        saveOutput(cloud, fileName, result, outputDirectory + "/" + outputName, outputMode);
     }
-    else
+
+    double elapsedTime = watch.getTimeSeconds();
+    if(numFrames > 0)
     {
-        return true;
+        std::printf("%d frames (%d warm started), mean latency %.1f ms, worst %.1f ms, %.1f frames per second \n",
+            numFrames, numWarm, 1e3 * totalSeconds / numFrames, 1e3 * worstSeconds, numFrames / elapsedTime);
     }
+    return numFailed == 0 ? 0 : 1;
 }
 
-/*******************************************************************************************************************//**
- * @brief Locate a plane in the cloud
- *
- * Perform planar segmentation using RANSAC, returning the plane parameters and point indices
- *
- * @param[in] cloudIn pointer to input point cloud
- * @param[out] inliers list containing the point indices of inliers
- * @param[in] distanceThreshold maximum distance of a point to the planar model to be considered an inlier
- * @param[in] maxIterations maximum number of iterations to attempt before returning
- * @return the number of inliers
- * @author Christopher D. McMurrough
- **********************************************************************************************************************/
-void segmentPlane(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn,
-    std::vector<pcl::ModelCoefficients::Ptr> &allPlanes,
-    std::vector<pcl::PointIndices::Ptr> &allindices,
-    double distanceThreshold, 
-    int maxIterations, TypeModel type_model)
-{
-    // store the model coefficients
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-    pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
-    // Create the segmentation object for the planar model and set the parameters
-    pcl::SACSegmentation<pcl::PointXYZRGBA> seg;
-    seg.setOptimizeCoefficients(true);
-    if(type_model == BOX)
-        seg.setModelType(pcl::SACMODEL_PLANE);
-    else if(type_model == SPHERE)
-        seg.setModelType(pcl::SACMODEL_SPHERE );
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(maxIterations);
-    seg.setDistanceThreshold(distanceThreshold);
-
-    // Segment the largest planar component from the remaining cloud
-    seg.setInputCloud(cloudIn);
-    seg.segment(*inliers, *coefficients);
-    allPlanes.push_back(coefficients);
-    allindices.push_back(inliers);
-    // std::cout<<"Distance:"<<coefficients->values[3]<<std::endl;
-}
-
-
-
-
 /***********************************************************************************************************************
 * @brief program entry point
 * @param[in] argc number of command line arguments
@@ -182,188 +129,154 @@ void segmentPlane(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn,
 int main(int argc, char** argv)
 {
     // validate and parse the command line arguments
-    if(argc <= 1)
+    if(argc <= NUM_COMMAND_ARGS)
     {
-        std::printf("USAGE: %s <file_name>\n", argv[0]);
+        std::printf("USAGE: %s <input_file> <output_file> [--voxel <leaf_size>] [--output-mode <mode>] "
+            "[--distance-threshold <meters>] [--cluster-distance <meters>] [--index-cache [--verify-cache]] %s\n", argv[0],
+            poolOptionsUsage());
+        std::printf("       %s <input_directory> <output_directory> --sequence [--voxel <leaf_size>] "
+            "[--output-mode <mode>] [--distance-threshold <meters>] [--cluster-distance <meters>] %s\n", argv[0],
+            poolOptionsUsage());
+        std::printf("output modes: cloud (colored binary PCD, default), compressed (colored compressed PCD), labels "
+            "(label file)\n");
+        std::printf("--index-cache keeps the voxel index and the plane next to the input file, for the next runs\n");
+        std::printf("--verify-cache checks the cache against a hash of the whole input file, not only its stamp\n");
         return 0;
     }
 	std::string inputFilePath(argv[1]);
 	std::string outputFilePath(argv[2]);
-
-    // create a stop watch for measuring time
-    pcl::StopWatch watch;
-
-    // open the point cloud
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    openCloud(cloud, inputFilePath);
-
-	// start timing the processing step
-    watch.reset();
-
-    // Statistical OutlierRemoval
-    // pcl::StatisticalOutlierRemoval<pcl::PointXYZRGBA> sor;
-    // sor.setInputCloud (cloud);
-    // sor.setMeanK (50);
-    // sor.setStddevMulThresh (1.0);
-    // sor.filter (*cloud);
-
-    // 
-    std::vector<pcl::ModelCoefficients::Ptr> allPlanes;
-    std::vector<pcl::PointIndices::Ptr> allindices;
-
-    // segment a plane
-    const float distanceThreshold = 0.0254; // 0.0254
-    const int maxIterations = 5000;
-    segmentPlane(cloud,allPlanes,allindices, distanceThreshold, maxIterations,BOX);
-    //std::cout << "Segmentation result: " << inliers->indices.size() << " points" << std::endl;
-    
-    // color the plane inliers green
-    for(int i = 0; i < allindices.at(0)->indices.size(); i++)
+    PipelineParams params;
+    bool sequence = false;
+    bool indexCache = false;
+    bool verifyCache = false;
+    OutputMode outputMode = OUTPUT_CLOUD;
+    PoolConfig poolConfig;
+    for(int i = NUM_COMMAND_ARGS + 1; i < argc; i++)
     {
-        int index = allindices.at(0)->indices.at(i);
-        cloud->points.at(index).r = 0;
-        cloud->points.at(index).g = 0;
-        cloud->points.at(index).b = 255;
-        // std::cout<<cloud->points.at(index).z<<std::endl;
-    }
-    double a = allPlanes.at(0)->values[0];
-    double b = allPlanes.at(0)->values[1];
-    double c = allPlanes.at(0)->values[2];
-    double d = allPlanes.at(0)->values[3];
-
-   
-
-    // for(int i=0;i<cloud->points.size();i++)
-    // {
-    //     std::cout<< pcl::pointToPlaneDistance(cloud->points.at(i),a,b,c,d)<<std::endl;
-    //     //std::cout<< a<<std::endl;
-    // }
-
-    // filtered the planes
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudFiltered(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    pcl::ExtractIndices<pcl::PointXYZRGBA> extract;
-    extract.setInputCloud(cloud);
-    extract.setIndices (allindices.at(0));
-    extract.setNegative (true);
-    extract.setKeepOrganized(true);
-    extract.filter (*cloudFiltered);
-
-    // // downsample the cloud using a voxel grid filter
-    // const float voxelSize = 0.01;
-    // pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudFiltered(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    // pcl::VoxelGrid<pcl::PointXYZRGBA> voxFilter;
-    // voxFilter.setInputCloud(cloudFiltered);
-    // voxFilter.setLeafSize(static_cast<float>(voxelSize), static_cast<float>(voxelSize), static_cast<float>(voxelSize));
-    // voxFilter.filter(*cloudFiltered);
-    // std::cout << "Points before downsampling: " << cloud->points.size() << std::endl;
-    // std::cout << "Points before downsampling: " << cloudFiltered->points.size() << std::endl;
-
-    
-    // create the vector of indices lists (each element contains a list of imultiple indices)
-    const float clusterDistance = 0.02;
-    int minClusterSize = 50;
-    int maxClusterSize = 100000;
-    std::vector<pcl::PointIndices> clusterIndices;
-
-    // // Creating the KdTree object for the search method of the extraction
-    pcl::search::KdTree<pcl::PointXYZRGBA>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGBA>);
-    tree->setInputCloud(cloudFiltered);
-
-    // create the euclidian cluster extraction object
-    pcl::EuclideanClusterExtraction<pcl::PointXYZRGBA> ec;
-    ec.setClusterTolerance(clusterDistance);
-    ec.setMinClusterSize(minClusterSize);
-    ec.setMaxClusterSize(maxClusterSize);
-    ec.setSearchMethod(tree);
-    ec.setInputCloud(cloudFiltered);
-
-    // // perform the clustering
-    ec.extract(clusterIndices);
-    //std::cout << "Clusters identified: " << clusterIndices.size() << std::endl;
-
-    int spherical = 0;
-    int boxes = 0;
-    // // color each cluster
-    for(int i = 0; i < clusterIndices.size(); i++)
-    {
-        // create a random color for this cluster
-        // int r = rand() % 256;
-        // int g = rand() % 256;
-        // int b = rand() % 256;
-
-        // iterate through the cluster points
-        // for(int j = 0; j < clusterIndices.at(i).indices.size(); j++)
-        // {
-        //     cloudFiltered->points.at(clusterIndices.at(i).indices.at(j)).r = r;
-        //     cloudFiltered->points.at(clusterIndices.at(i).indices.at(j)).g = g;
-        //     cloudFiltered->points.at(clusterIndices.at(i).indices.at(j)).b = b;
-        // }
-        double mean = 0;
-
-        for(int j = 0; j < clusterIndices.at(i).indices.size(); j++){
-            mean +=pcl::pointToPlaneDistance(cloudFiltered->points.at(clusterIndices.at(i).indices.at(j)),a,b,c,d);
+        std::string option(argv[i]);
+        if(parsePoolOption(argc, argv, i, poolConfig))
+        {
+            continue;
+        }
+        if(option == "--voxel" && i + 1 < argc)
+        {
+            params.voxelSize = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--distance-threshold" && i + 1 < argc)
+        {
+            params.distanceThreshold = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--cluster-distance" && i + 1 < argc)
+        {
+            params.clusterDistance = static_cast<float>(std::atof(argv[++i]));
         }
-        mean/=clusterIndices.at(i).indices.size();
-        
-         // iterate through the cluster points
-        if(mean<0.20)
+        else if(option == "--sequence")
         {
-            // std::cout<< "Cluster" << i<<": "<< mean<<std::endl;
-            int r=0,g=0,b=0;
-            if(mean>0.07 && mean < 0.10)
+            sequence = true;
+        }
+        else if(option == "--index-cache")
+        {
+            indexCache = true;
+        }
+        else if(option == "--verify-cache")
+        {
+            verifyCache = true;
+        }
+        else if(option == "--output-mode" && i + 1 < argc)
+        {
+            std::string mode(argv[++i]);
+            if(mode == "cloud")
             {
-                r= 255;
-                spherical++;
+                outputMode = OUTPUT_CLOUD;
             }
-            else{
-                g = 255;
-                boxes++;
+            else if(mode == "compressed")
+            {
+                outputMode = OUTPUT_COMPRESSED;
+            }
+            else if(mode == "labels")
+            {
+                outputMode = OUTPUT_LABELS;
             }
-            
-            for(int j = 0; j < clusterIndices.at(i).indices.size(); j++)
+            else
             {
-                cloud->points.at(clusterIndices.at(i).indices.at(j)).r = r;
-                cloud->points.at(clusterIndices.at(i).indices.at(j)).g = g;
-                cloud->points.at(clusterIndices.at(i).indices.at(j)).b = b;
+                std::printf("unknown output mode: %s \n", mode.c_str());
+                return 1;
             }
         }
-
+        else
+        {
+            std::printf("unknown option: %s \n", argv[i]);
+            return 1;
+        }
     }
-    
-    std::cout<<"Boxes Count: "<< boxes << std::endl;
-    std::cout<<"Spherical Count: "<< spherical << std::endl;
+    TaskPool::configureGlobal(poolConfig);
 
-    
-    
-    // segmentPlane(cloudFiltered,allPlanes,allindices, distanceThreshold, maxIterations,SPHERE);
+    // process a directory of frames, each frame being seen once there is nothing to cache
+    if(sequence)
+    {
+        if(indexCache)
+        {
+            std::printf("--index-cache is not supported with --sequence \n");
+            return 1;
+        }
+        return processSequence(inputFilePath, outputFilePath, params, outputMode);
+    }
 
-    // for(int i = 0; i < allindices.at(1)->indices.size(); i++)
-    // {
-    //     int index = allindices.at(1)->indices.at(i);
-    //     cloud->points.at(index).r = 0;
-    //     cloud->points.at(index).g = 255;
-    //     cloud->points.at(index).b = 0;
-    //     // std::cout<<cloud->points.at(index).z<<std::endl;
-    // }
-    
+    // open the cache of the input file, checking that it was written for the same file
+    pcl::StopWatch watch;
+    IndexCache cache;
+    if(indexCache)
+    {
+        if(!cache.open(inputFilePath, verifyCache))
+        {
+            PCL_ERROR("error while attempting to read file: %s \n", inputFilePath.c_str());
+            return 1;
+        }
+        std::cout << watch.getTimeSeconds() << " seconds to open the index cache " << std::endl;
+    }
 
-    
+    // with only the labels to save, a downsampled binary file is processed in place, streaming its mapped columns, so
+    // it may be larger than memory; otherwise the point cloud is opened
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    MappedCloud mappedCloud;
+    StridedView<float> x, y, z;
+    const bool streamed = params.voxelSize > 0 && outputMode == OUTPUT_LABELS && mappedCloud.open(inputFilePath) &&
+        mappedCloud.positionColumns(x, y, z);
+    if(!streamed)
+    {
+        mappedCloud.close();
+        openCloud(cloud, inputFilePath);
+    }
 
-	
-	// // color all of the points random colors
-	// for(int i = 0; i < cloud->points.size(); i++)
-	// {
-	// 	cloud->points.at(i).r = rand() % 256;
-	// 	cloud->points.at(i).g = rand() % 256;
-	// 	cloud->points.at(i).b = rand() % 256;
-	// }
+    // detect the objects
+    FrameResult result;
+    if(streamed ? !processMappedCloud(mappedCloud, params, indexCache ? &cache : NULL, true, result) :
+        !processCloud(cloud, params, NULL, indexCache ? &cache : NULL, true, result))
+    {
+        return 1;
+    }
+    std::cout<<"Boxes Count: "<< result.boxes << std::endl;
+    std::cout<<"Spherical Count: "<< result.spherical << std::endl;
+    std::cout << result.seconds << " seconds passed " << std::endl;
 
-    // get the elapsed time
-    double elapsedTime = watch.getTimeSeconds();
-    std::cout << elapsedTime << " seconds passed " << std::endl;
+    // keep what was computed for the next runs, a failure only costs the next run the time to compute it again
+    if(indexCache)
+    {
+        watch.reset();
+        if(!cache.save())
+        {
+            PCL_ERROR("error while attempting to save the index cache: %s \n", cache.fileName().c_str());
+        }
+        std::cout << watch.getTimeSeconds() << " seconds to save the index cache " << std::endl;
+    }
 
-    // save the point cloud
-	saveCloud(cloud, outputFilePath);
+    // save the colored point cloud or the labels
+    watch.reset();
+    if(!saveOutput(cloud, inputFilePath, result, outputFilePath, outputMode))
+    {
+        return 1;
+    }
+    std::cout << watch.getTimeSeconds() << " seconds to save the output " << std::endl;
 
     // exit program
     return 0;
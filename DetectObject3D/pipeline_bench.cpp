@@ -0,0 +1,363 @@
+/***********************************************************************************************************************
+* @file pipeline_bench.cpp
+* @brief scaling benchmark of the detection pipeline on synthetic tabletop scenes
+*
+* For every scale a scene is generated and written to disk, then a separate process loads it, runs the pipeline and
+* saves the output, reporting the time of each stage, its peak memory and the share of the points given their true
+* class. Running each scale in its own process keeps the peak memory of one scale from hiding the next. With a list of
+* thread counts, the process runs the pipeline once per count, reconfiguring the task pool in between, and reports the
+* speedup of the processing time over the counts.
+*
+* Organized scenes at full resolution go through the organized pipeline. The same points are then run through the
+* unorganized pipeline as well, and the scale fails if the two disagree on the objects or on too many points.
+**********************************************************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/common/time.h>
+#include "file_hash.h"
+#include "label_sidecar.h"
+#include "scaling_report.h"
+#include "scene_generator.h"
+#include "tabletop_pipeline.h"
+#include "task_pool.h"
+
+// share of the valid points of an organized scene that the organized and unorganized pipelines must put in one class
+const double MIN_PATH_AGREEMENT = 0.95;
+
+/*******************************************************************************************************************//**
+ * @brief Generates a scene and writes it with its ground truth
+ * @return return code of the process (0 on success)
+ **********************************************************************************************************************/
+int writeScene(const SceneParams &sceneParams, const std::string &cloudFile, const std::string &truthFile)
+{
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    LabelSidecar truth;
+    if(!generateScene(sceneParams, *cloud, truth) || !saveCloud(cloud, cloudFile))
+    {
+        return 1;
+    }
+    if(!hashFile(cloudFile, truth.inputHash, truth.inputSize) || !writeLabelSidecar(truthFile, truth))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Class of the object of each point, LABEL_NONE for the points of no object
+ **********************************************************************************************************************/
+static int pointClass(const std::vector<int> &labels, const std::vector<LabeledObject> &objects, size_t i)
+{
+    return labels[i] > 0 ? objects[labels[i] - 1].type : static_cast<int>(LABEL_NONE);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs the unorganized pipeline on an organized cloud and compares its results with the organized pipeline
+ *
+ * The cloud is flattened to a single row, which sends it through RANSAC and the spatial hash clustering instead of
+ * the image grid. The pixels without a point are left out of the comparison.
+ *
+ * @param[in] cloud organized cloud
+ * @param[in] params pipeline parameters, at full resolution
+ * @param[in] organizedResult results of the organized pipeline on the cloud
+ * @return true if both pipelines find the same numbers of boxes and spheres, and put at least MIN_PATH_AGREEMENT of
+ * the valid points in the same class
+ **********************************************************************************************************************/
+static bool matchesUnorganized(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const PipelineParams &params,
+    const FrameResult &organizedResult)
+{
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr flatCloud(new pcl::PointCloud<pcl::PointXYZRGBA>(*cloud));
+    flatCloud->width = static_cast<uint32_t>(flatCloud->points.size());
+    flatCloud->height = 1;
+    FrameResult result;
+    if(!processCloud(flatCloud, params, NULL, NULL, false, result))
+    {
+        std::printf("%10s the unorganized pipeline failed \n", "");
+        std::fflush(stdout);
+        return false;
+    }
+
+    size_t numValid = 0;
+    size_t agreeing = 0;
+    for(size_t i = 0; i < cloud->points.size(); i++)
+    {
+        const pcl::PointXYZRGBA &point = cloud->points[i];
+        if(std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z))
+        {
+            numValid++;
+            agreeing += pointClass(organizedResult.labels, organizedResult.objects, i) ==
+                pointClass(result.labels, result.objects, i) ? 1 : 0;
+        }
+    }
+    const double agreement = numValid > 0 ? static_cast<double>(agreeing) / numValid : 0.0;
+    std::printf("%10s unorganized pipeline: %.2f%% of the valid points in the same class, %d boxes, %d spheres \n", "",
+        100.0 * agreement, result.boxes, result.spherical);
+    std::fflush(stdout);
+    return result.boxes == organizedResult.boxes && result.spherical == organizedResult.spherical &&
+        agreement >= MIN_PATH_AGREEMENT;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs the pipeline on a scene written to disk and prints a line of the results table per thread count
+ *
+ * An empty list of thread counts runs the pipeline once with the pool as configured.
+ *
+ * @return return code of the process (0 on success)
+ **********************************************************************************************************************/
+int runScene(const std::string &cloudFile, const std::string &truthFile, const std::string &outputFile,
+    const PipelineParams &params, OutputMode outputMode, const PoolConfig &poolConfig,
+    const std::vector<int> &threadCounts)
+{
+    // the pool is only created here, in the child, so the parent never forks with live worker threads
+    PoolConfig config = poolConfig;
+    if(!threadCounts.empty())
+    {
+        config.numThreads = threadCounts.front();
+    }
+    TaskPool::configureGlobal(config);
+
+    pcl::StopWatch watch;
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    if(!openCloud(cloud, cloudFile))
+    {
+        return 1;
+    }
+    double loadSeconds = watch.getTimeSeconds();
+
+    LabelSidecar truth;
+    if(!readLabelSidecar(truthFile, truth) || truth.labels.size() != cloud->points.size())
+    {
+        return 1;
+    }
+    int trueBoxes = 0;
+    int trueSpheres = 0;
+    for(size_t i = 0; i < truth.objects.size(); i++)
+    {
+        trueBoxes += truth.objects[i].type == LABEL_BOX ? 1 : 0;
+        trueSpheres += truth.objects[i].type == LABEL_SPHERE ? 1 : 0;
+    }
+
+    ScalingReport report("the pipeline on " + std::to_string(cloud->points.size()) + " points");
+    const size_t numRuns = std::max<size_t>(threadCounts.size(), 1);
+    for(size_t run = 0; run < numRuns; run++)
+    {
+        if(run > 0)
+        {
+            config.numThreads = threadCounts[run];
+            TaskPool::configureGlobal(config);
+        }
+
+        FrameResult result;
+        if(!processCloud(cloud, params, NULL, NULL, false, result))
+        {
+            return 1;
+        }
+
+        watch.reset();
+        if(!saveOutput(cloud, cloudFile, result, outputFile, outputMode))
+        {
+            return 1;
+        }
+        double saveSeconds = watch.getTimeSeconds();
+
+        // peak resident memory of this process, in kilobytes on Linux
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        // share of the points labeled with the class of their true object
+        size_t correct = 0;
+        for(size_t i = 0; i < truth.labels.size(); i++)
+        {
+            correct += pointClass(truth.labels, truth.objects, i) == pointClass(result.labels, result.objects, i) ?
+                1 : 0;
+        }
+
+        const PipelineTimings &t = result.timings;
+        const int numThreads = TaskPool::global().numThreads();
+        std::printf("%10zu %7d %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %9.1f %9.1f %8.2f%% %3d/%-3d %3d/%-3d \n",
+            cloud->points.size(), numThreads, 1e3 * loadSeconds, 1e3 * t.downsampling, 1e3 * t.plane,
+            1e3 * t.extraction, 1e3 * t.clustering, 1e3 * t.classification, 1e3 * t.labeling, 1e3 * saveSeconds,
+            1e3 * (loadSeconds + result.seconds + saveSeconds), usage.ru_maxrss / 1024.0,
+            100.0 * correct / truth.labels.size(), result.boxes, trueBoxes, result.spherical, trueSpheres);
+        std::fflush(stdout);
+        report.add(numThreads, result.seconds);
+
+        // an organized scene must give the same objects through both pipelines
+        if(run == 0 && cloud->isOrganized() && params.voxelSize <= 0 && !matchesUnorganized(cloud, params, result))
+        {
+            return 1;
+        }
+    }
+    if(threadCounts.size() > 1)
+    {
+        report.print();
+        std::fflush(stdout);
+    }
+    return 0;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs a function in a child process and waits for it
+ * @return the return code of the function, or 1 if the child did not exit normally
+ **********************************************************************************************************************/
+template<typename Function>
+int runInChild(Function function)
+{
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+        return 1;
+    }
+    if(pid == 0)
+    {
+        std::_Exit(function());
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/*******************************************************************************************************************//**
+ * @brief program entry point
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @return return code (0 if every scale ran)
+ **********************************************************************************************************************/
+int main(int argc, char **argv)
+{
+    std::vector<size_t> scales;
+    SceneParams sceneParams;
+    PipelineParams params;
+    OutputMode outputMode = OUTPUT_LABELS;
+    std::string directory = "/tmp";
+    PoolConfig poolConfig;
+    std::vector<int> threadCounts;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string option(argv[i]);
+        if(option == "--threads" && i + 1 < argc)
+        {
+            if(!parseThreadCounts(argv[++i], threadCounts))
+            {
+                std::printf("invalid thread counts: %s \n", argv[i]);
+                return 1;
+            }
+        }
+        else if(parsePoolOption(argc, argv, i, poolConfig))
+        {
+            // affinity and NUMA node of the pool, applied with every thread count
+        }
+        else if(option == "--points" && i + 1 < argc)
+        {
+            std::stringstream list(argv[++i]);
+            std::string scale;
+            while(std::getline(list, scale, ','))
+            {
+                scales.push_back(static_cast<size_t>(std::atoll(scale.c_str())));
+            }
+        }
+        else if(option == "--voxel" && i + 1 < argc)
+        {
+            params.voxelSize = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--boxes" && i + 1 < argc)
+        {
+            sceneParams.numBoxes = std::atoi(argv[++i]);
+        }
+        else if(option == "--spheres" && i + 1 < argc)
+        {
+            sceneParams.numSpheres = std::atoi(argv[++i]);
+        }
+        else if(option == "--noise" && i + 1 < argc)
+        {
+            sceneParams.noise = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--outliers" && i + 1 < argc)
+        {
+            sceneParams.outlierRatio = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--seed" && i + 1 < argc)
+        {
+            sceneParams.seed = static_cast<unsigned int>(std::strtoul(argv[++i], NULL, 10));
+        }
+        else if(option == "--organized")
+        {
+            sceneParams.organized = true;
+        }
+        else if(option == "--output-mode" && i + 1 < argc)
+        {
+            std::string mode(argv[++i]);
+            outputMode = mode == "cloud" ? OUTPUT_CLOUD : mode == "compressed" ? OUTPUT_COMPRESSED : OUTPUT_LABELS;
+        }
+        else if(option == "--directory" && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else
+        {
+            std::printf("USAGE: %s [--points <count,count,...>] [--voxel <leaf_size>] [--boxes <count>] "
+                "[--spheres <count>] [--noise <meters>] [--outliers <ratio>] [--seed <seed>] [--organized] "
+                "[--output-mode <cloud|compressed|labels>] [--directory <scratch_directory>] "
+                "[--threads <count,count,...>] [--affinity none|compact|scatter] [--numa-node <node>] \n", argv[0]);
+            return 1;
+        }
+    }
+    if(scales.empty())
+    {
+        const size_t defaultScales[] = {10000, 100000, 1000000, 10000000};
+        scales.assign(defaultScales, defaultScales + 4);
+    }
+
+    std::printf("times in ms, memory in MB, objects found/true \n");
+    const std::string prefix = directory + "/pipeline_bench_" + std::to_string(getpid());
+    const std::string cloudFile = prefix + ".pcd";
+    const std::string truthFile = prefix + ".truth.labels";
+    const std::string outputFile = prefix + (outputMode == OUTPUT_LABELS ? ".labels" : ".out.pcd");
+    int failures = 0;
+    for(size_t s = 0; s < scales.size(); s++)
+    {
+        sceneParams.numPoints = scales[s];
+
+        // clusters grow with the density, so the maximum cluster size follows the number of points
+        PipelineParams scaleParams = params;
+        scaleParams.maxClusterSize = static_cast<int>(std::max<size_t>(params.maxClusterSize, scales[s]));
+
+        // the header is repeated after the scaling report of the previous scale
+        if(s == 0 || threadCounts.size() > 1)
+        {
+            std::printf("%10s %7s %8s %8s %8s %8s %8s %8s %8s %8s %9s %9s %9s %7s %7s \n", "points", "threads", "load",
+                "voxel", "plane", "extract", "cluster", "classify", "label", "save", "total", "peak rss", "accuracy",
+                "boxes", "spheres");
+        }
+
+        int status = runInChild([&]() { return writeScene(sceneParams, cloudFile, truthFile); });
+        if(status == 0)
+        {
+            status = runInChild([&]()
+            {
+                return runScene(cloudFile, truthFile, outputFile, scaleParams, outputMode, poolConfig, threadCounts);
+            });
+        }
+        if(status != 0)
+        {
+            std::printf("%10zu failed \n", scales[s]);
+            failures++;
+        }
+        std::remove(cloudFile.c_str());
+        std::remove(truthFile.c_str());
+        std::remove(outputFile.c_str());
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,791 @@
+/***********************************************************************************************************************
+* @file ransac.cpp
+* @brief multi-threaded RANSAC for plane and sphere models with preemptive scoring and early termination
+**********************************************************************************************************************/
+
+#include "ransac.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <Eigen/Dense>
+#include "geometry_kernels.h"
+#include "task_pool.h"
+
+// number of points processed per call of the geometry kernels
+static const size_t KERNEL_BLOCK = 1024;
+
+// a model hypothesis along with its score on the evaluation subset
+struct Hypothesis
+{
+    Eigen::Vector4f coefficients;
+    int score;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Creates the default parameters, matching the previous SACSegmentation setup
+ **********************************************************************************************************************/
+RansacParams::RansacParams():
+    distanceThreshold(0.0254), maxIterations(5000), confidence(0.99), numThreads(0), subsetSize(2000),
+    verifyCandidates(8), minRadius(0), maxRadius(0), seed(12345), weights(NULL)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Checks whether a point has finite coordinates
+ **********************************************************************************************************************/
+static inline bool isValidPoint(const pcl::PointXYZRGBA &point)
+{
+    return std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the distance of a point to a model
+ **********************************************************************************************************************/
+static inline float modelDistance(TypeModel typeModel, const Eigen::Vector4f &model, float x, float y, float z)
+{
+    if(typeModel == SPHERE)
+    {
+        float dx = x - model[0];
+        float dy = y - model[1];
+        float dz = z - model[2];
+        return std::fabs(std::sqrt(dx * dx + dy * dy + dz * dz) - model[3]);
+    }
+    return std::fabs(model[0] * x + model[1] * y + model[2] * z + model[3]);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gathers the finite points with a positive weight
+ * @param[in] cloud input point cloud
+ * @param[in] indices indices of the points to consider, or NULL for the whole cloud
+ * @param[in] weights optional weight of each point
+ * @param[out] candidates indices of the valid points
+ **********************************************************************************************************************/
+static void gatherCandidates(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    const std::vector<float> *weights, std::vector<int> &candidates)
+{
+    size_t total = indices != NULL ? indices->size() : cloud.points.size();
+    candidates.clear();
+    candidates.reserve(total);
+    for(size_t i = 0; i < total; i++)
+    {
+        int index = indices != NULL ? (*indices)[i] : static_cast<int>(i);
+        if(isValidPoint(cloud.points[index]) && (weights == NULL || (*weights)[index] > 0))
+        {
+            candidates.push_back(index);
+        }
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the share of the candidate points (or of their weight) covered by the inliers
+ **********************************************************************************************************************/
+static double inlierRatio(const std::vector<int> &inliers, const std::vector<int> &candidates,
+    const std::vector<float> *weights)
+{
+    if(candidates.empty())
+    {
+        return 0.0;
+    }
+    if(weights == NULL)
+    {
+        return static_cast<double>(inliers.size()) / candidates.size();
+    }
+    double inlierWeight = 0;
+    double totalWeight = 0;
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+        inlierWeight += (*weights)[inliers[i]];
+    }
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        totalWeight += (*weights)[candidates[i]];
+    }
+    return totalWeight > 0 ? inlierWeight / totalWeight : 0.0;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes a model from a minimal sample
+ * @param[in] typeModel model type
+ * @param[in] sample 3 points for a plane, 4 points for a sphere
+ * @param[in] params RANSAC parameters (radius limits)
+ * @param[out] model model coefficients
+ * @return false if the sample is degenerate or the model violates the radius limits
+ **********************************************************************************************************************/
+static bool modelFromSample(TypeModel typeModel, const Eigen::Vector3f *sample, const RansacParams &params,
+    Eigen::Vector4f &model)
+{
+    if(typeModel == SPHERE)
+    {
+        // solve x^2 + y^2 + z^2 + D x + E y + F z + G = 0 through the four points
+        Eigen::Matrix4d A;
+        Eigen::Vector4d b;
+        for(int i = 0; i < 4; i++)
+        {
+            Eigen::Vector3d p = sample[i].cast<double>();
+            A.row(i) << p[0], p[1], p[2], 1.0;
+            b[i] = -p.squaredNorm();
+        }
+        Eigen::FullPivLU<Eigen::Matrix4d> lu(A);
+        if(!lu.isInvertible())
+        {
+            return false;
+        }
+        Eigen::Vector4d x = lu.solve(b);
+        Eigen::Vector3d center = -0.5 * x.head<3>();
+        double radiusSquared = center.squaredNorm() - x[3];
+        if(radiusSquared <= 0)
+        {
+            return false;
+        }
+        double radius = std::sqrt(radiusSquared);
+        if((params.minRadius > 0 && radius < params.minRadius) || (params.maxRadius > 0 && radius > params.maxRadius))
+        {
+            return false;
+        }
+        model << static_cast<float>(center[0]), static_cast<float>(center[1]), static_cast<float>(center[2]),
+            static_cast<float>(radius);
+        return true;
+    }
+
+    // plane through three points
+    Eigen::Vector3f normal = (sample[1] - sample[0]).cross(sample[2] - sample[0]);
+    float norm = normal.norm();
+    if(norm < 1e-8f)
+    {
+        return false;
+    }
+    normal /= norm;
+    model << normal[0], normal[1], normal[2], -normal.dot(sample[0]);
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the number of iterations needed to reach the confidence for a given inlier ratio
+ **********************************************************************************************************************/
+static int requiredIterations(double inlierRatio, int sampleSize, double confidence, int maxIterations)
+{
+    double probability = std::pow(inlierRatio, sampleSize);
+    if(probability <= std::numeric_limits<double>::epsilon())
+    {
+        return maxIterations;
+    }
+    if(probability >= 1.0)
+    {
+        return 1;
+    }
+    double iterations = std::log(1.0 - confidence) / std::log(1.0 - probability);
+    if(iterations >= maxIterations)
+    {
+        return maxIterations;
+    }
+    return std::max(1, static_cast<int>(std::ceil(iterations)));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Finds the model with the most inliers using parallel preemptive RANSAC
+ *
+ * Worker threads share an iteration budget. Every hypothesis is scored on the same random subset of the points, and
+ * scoring is abandoned as soon as the hypothesis can no longer enter the list of best candidates. The budget shrinks as
+ * better hypotheses are found, following the standard adaptive termination criterion. The best candidates are then
+ * verified on all points, refined by least squares, and their inliers recomputed.
+ *
+ * When weights are given, points are sampled and counted in proportion to their weight. This lets a downsampled cloud
+ * reproduce the consensus of the full resolution cloud, by weighting each voxel with its number of points.
+ *
+ * @param[in] cloud input point cloud
+ * @param[in] indices indices of the points to consider, or NULL for the whole cloud
+ * @param[in] typeModel model to fit (BOX segments a plane, SPHERE a sphere)
+ * @param[in] params RANSAC parameters
+ * @param[out] result model coefficients and inlier indices
+ * @return false if no model could be found
+ **********************************************************************************************************************/
+bool ransacSegment(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const RansacParams &params, RansacResult &result)
+{
+    result.coefficients.clear();
+    result.inliers.clear();
+    result.iterations = 0;
+    result.rmse = 0;
+    result.inlierRatio = 0;
+
+    // gather the valid candidate points
+    std::vector<int> candidates;
+    gatherCandidates(cloud, indices, params.weights, candidates);
+    const int sampleSize = typeModel == SPHERE ? 4 : 3;
+    if(static_cast<int>(candidates.size()) < sampleSize)
+    {
+        return false;
+    }
+
+    // weighted points are drawn with probability proportional to their weight
+    std::vector<double> cumulative;
+    if(params.weights != NULL)
+    {
+        cumulative.resize(candidates.size());
+        double sum = 0;
+        for(size_t i = 0; i < candidates.size(); i++)
+        {
+            sum += (*params.weights)[candidates[i]];
+            cumulative[i] = sum;
+        }
+    }
+
+    // draw the evaluation subset shared by all hypotheses
+    std::mt19937 subsetRng(params.seed);
+    const int subsetSize = static_cast<int>(std::min<size_t>(std::max(params.subsetSize, sampleSize),
+        candidates.size()));
+    std::vector<Eigen::Vector3f> subset(subsetSize);
+    if(params.weights != NULL)
+    {
+        std::uniform_real_distribution<double> pick(0, cumulative.back());
+        for(int i = 0; i < subsetSize; i++)
+        {
+            size_t drawn = std::upper_bound(cumulative.begin(), cumulative.end() - 1, pick(subsetRng)) -
+                cumulative.begin();
+            subset[i] = cloud.points[candidates[drawn]].getVector3fMap();
+        }
+    }
+    else
+    {
+        std::vector<int> shuffled(candidates);
+        for(int i = 0; i < subsetSize; i++)
+        {
+            std::uniform_int_distribution<size_t> pick(i, shuffled.size() - 1);
+            std::swap(shuffled[i], shuffled[pick(subsetRng)]);
+            subset[i] = cloud.points[shuffled[i]].getVector3fMap();
+        }
+    }
+
+    // shared search state
+    const int numThreads = resolveThreadCount(params.numThreads);
+    const int maxCandidates = std::max(1, params.verifyCandidates);
+    const float threshold = static_cast<float>(params.distanceThreshold);
+    std::atomic<int> iterations(0);
+    std::atomic<int> iterationBudget(params.maxIterations);
+    std::atomic<int> minTopScore(0);
+    std::mutex topMutex;
+    std::vector<Hypothesis> top;
+
+    // one search task per thread, each with its own random sequence
+    TaskPool::global().run(numThreads, [&](size_t t)
+    {
+        std::mt19937 rng(params.seed + 7919u * (t + 1));
+        std::uniform_int_distribution<size_t> pick(0, candidates.size() - 1);
+        std::uniform_real_distribution<double> pickWeighted(0, cumulative.empty() ? 1.0 : cumulative.back());
+        Eigen::Vector3f sample[4];
+        while(iterations.fetch_add(1) < iterationBudget.load())
+        {
+            // draw a minimal sample of distinct points
+            size_t drawn[4];
+            for(int s = 0; s < sampleSize; s++)
+            {
+                bool distinct;
+                do
+                {
+                    drawn[s] = cumulative.empty() ? pick(rng) : std::upper_bound(cumulative.begin(),
+                        cumulative.end() - 1, pickWeighted(rng)) - cumulative.begin();
+                    distinct = true;
+                    for(int r = 0; r < s; r++)
+                    {
+                        distinct = distinct && drawn[r] != drawn[s];
+                    }
+                } while(!distinct);
+                const pcl::PointXYZRGBA &point = cloud.points[candidates[drawn[s]]];
+                sample[s] = Eigen::Vector3f(point.x, point.y, point.z);
+            }
+            Eigen::Vector4f model;
+            if(!modelFromSample(typeModel, sample, params, model))
+            {
+                continue;
+            }
+
+            // score on the subset, giving up once the hypothesis cannot make the candidate list
+            int score = 0;
+            int cutoff = minTopScore.load(std::memory_order_relaxed);
+            for(int i = 0; i < subsetSize; i++)
+            {
+                if(modelDistance(typeModel, model, subset[i][0], subset[i][1], subset[i][2]) <= threshold)
+                {
+                    score++;
+                }
+                if((i & 255) == 255 && score + (subsetSize - i - 1) <= cutoff)
+                {
+                    break;
+                }
+            }
+            if(score <= cutoff)
+            {
+                continue;
+            }
+
+            // insert into the sorted candidate list
+            std::lock_guard<std::mutex> lock(topMutex);
+            Hypothesis hypothesis;
+            hypothesis.coefficients = model;
+            hypothesis.score = score;
+            std::vector<Hypothesis>::iterator position = top.begin();
+            while(position != top.end() && position->score >= score)
+            {
+                ++position;
+            }
+            top.insert(position, hypothesis);
+            if(static_cast<int>(top.size()) > maxCandidates)
+            {
+                top.pop_back();
+            }
+            if(static_cast<int>(top.size()) == maxCandidates)
+            {
+                minTopScore.store(top.back().score);
+            }
+
+            // shrink the budget according to the best inlier ratio
+            int budget = requiredIterations(static_cast<double>(top.front().score) / subsetSize, sampleSize,
+                params.confidence, params.maxIterations);
+            if(budget < iterationBudget.load())
+            {
+                iterationBudget.store(budget);
+            }
+        }
+    });
+    result.iterations = std::min(iterations.load(), iterationBudget.load());
+    if(top.empty())
+    {
+        return false;
+    }
+
+    // verify the candidates on all points in a single parallel pass
+    const int numCandidates = static_cast<int>(top.size());
+    std::vector<std::vector<double> > counts(numThreads, std::vector<double>(numCandidates, 0.0));
+    parallelRanges(numThreads, candidates.size(), [&](size_t begin, size_t end, int thread)
+    {
+        std::vector<double> &threadCounts = counts[thread];
+        if(typeModel == BOX)
+        {
+            // planes are verified with the vectorized distance kernel, one block of points at a time
+            float distances[KERNEL_BLOCK];
+            uint8_t mask[KERNEL_BLOCK];
+            for(size_t block = begin; block < end; block += KERNEL_BLOCK)
+            {
+                const size_t count = std::min(KERNEL_BLOCK, end - block);
+                for(int c = 0; c < numCandidates; c++)
+                {
+                    planeDistancesIndexed(&cloud.points[0].x, POINT_STRIDE, &candidates[block], count,
+                        top[c].coefficients.data(), distances);
+                    size_t selected = thresholdMask(distances, count, threshold, mask);
+                    if(params.weights == NULL)
+                    {
+                        threadCounts[c] += selected;
+                        continue;
+                    }
+                    for(size_t k = 0; k < count; k++)
+                    {
+                        threadCounts[c] += mask[k] ? (*params.weights)[candidates[block + k]] : 0.0;
+                    }
+                }
+            }
+            return;
+        }
+        for(size_t i = begin; i < end; i++)
+        {
+            const pcl::PointXYZRGBA &point = cloud.points[candidates[i]];
+            for(int c = 0; c < numCandidates; c++)
+            {
+                if(modelDistance(typeModel, top[c].coefficients, point.x, point.y, point.z) <= threshold)
+                {
+                    threadCounts[c] += params.weights != NULL ? (*params.weights)[candidates[i]] : 1.0;
+                }
+            }
+        }
+    });
+    int best = 0;
+    double bestCount = -1;
+    for(int c = 0; c < numCandidates; c++)
+    {
+        double count = 0;
+        for(int t = 0; t < numThreads; t++)
+        {
+            count += counts[t][c];
+        }
+        if(count > bestCount)
+        {
+            bestCount = count;
+            best = c;
+        }
+    }
+
+    // refine the best model on its inliers and recompute the inliers
+    std::vector<float> coefficients(top[best].coefficients.data(), top[best].coefficients.data() + 4);
+    std::vector<int> inliers;
+    selectInliers(cloud, &candidates, typeModel, coefficients, params.distanceThreshold, numThreads, inliers, NULL);
+    std::vector<float> refined;
+    if(fitModel(cloud, inliers, typeModel, refined))
+    {
+        coefficients = refined;
+    }
+    selectInliers(cloud, &candidates, typeModel, coefficients, params.distanceThreshold, numThreads, result.inliers,
+        &result.rmse);
+    result.coefficients = coefficients;
+    result.inlierRatio = inlierRatio(result.inliers, candidates, params.weights);
+    return !result.inliers.empty();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Verifies and refines a known model instead of searching for one
+ *
+ * Used to reuse a cached model. The inliers of the seed model are refitted by least squares a few times, each pass
+ * recomputing the inliers of the refined model on all points. Without refinements, the inliers of the seed model are
+ * only selected, as for a model already refined on the same points.
+ *
+ * @param[in] cloud input point cloud
+ * @param[in] indices indices of the points to consider, or NULL for the whole cloud
+ * @param[in] typeModel model type
+ * @param[in] seed coefficients of the known model
+ * @param[in] params RANSAC parameters (distance threshold, threads and weights)
+ * @param[out] result refined coefficients, inliers and inlier ratio
+ * @param[in] refinements number of least squares refinements
+ * @return false if the seed model has no inliers
+ **********************************************************************************************************************/
+bool refineModel(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const std::vector<float> &seed, const RansacParams &params, RansacResult &result,
+    int refinements)
+{
+    result.coefficients = seed;
+    result.inliers.clear();
+    result.iterations = 0;
+    result.rmse = 0;
+    result.inlierRatio = 0;
+    if(seed.size() != 4)
+    {
+        return false;
+    }
+
+    std::vector<int> candidates;
+    gatherCandidates(cloud, indices, params.weights, candidates);
+    const int numThreads = resolveThreadCount(params.numThreads);
+    for(int r = 0; r <= refinements; r++)
+    {
+        selectInliers(cloud, &candidates, typeModel, result.coefficients, params.distanceThreshold, numThreads,
+            result.inliers, &result.rmse);
+        std::vector<float> refined;
+        if(r == refinements || !fitModel(cloud, result.inliers, typeModel, refined))
+        {
+            break;
+        }
+        result.coefficients = refined;
+    }
+    result.inlierRatio = inlierRatio(result.inliers, candidates, params.weights);
+    return !result.inliers.empty();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Follows a known model on a new cloud without searching for one
+ *
+ * Used to warm start the segmentation of a sequence from the model of the previous frame. The seed is scored on a
+ * random subset of the points, without any early cutoff, and rejected before the rest of the cloud is read if it lost
+ * too many inliers. Otherwise it is refined by least squares on its inliers of the subset, and a single pass over all
+ * points selects the inliers of the refined model and measures its exact inlier ratio.
+ *
+ * @param[in] cloud input point cloud
+ * @param[in] indices indices of the points to consider, or NULL for the whole cloud
+ * @param[in] typeModel model type
+ * @param[in] seed coefficients of the known model
+ * @param[in] params RANSAC parameters (distance threshold, subset size, seed, threads and weights)
+ * @param[in] minRatio inlier ratio the model must keep, on the subset and then on all points
+ * @param[out] result refined coefficients, inliers and inlier ratio
+ * @param[in] refinements number of least squares refinements on the subset
+ * @return false if the model kept too few inliers, in which case a full search is needed
+ **********************************************************************************************************************/
+bool trackModel(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const std::vector<float> &seed, const RansacParams &params, double minRatio,
+    RansacResult &result, int refinements)
+{
+    result.coefficients = seed;
+    result.inliers.clear();
+    result.iterations = 0;
+    result.rmse = 0;
+    result.inlierRatio = 0;
+    const size_t total = indices != NULL ? indices->size() : cloud.points.size();
+    if(seed.size() != 4 || total == 0)
+    {
+        return false;
+    }
+
+    // draw the subset among the valid points, the weights are applied when counting the inliers
+    const size_t sampleSize = typeModel == SPHERE ? 4 : 3;
+    const size_t subsetSize = std::max<size_t>(std::max(params.subsetSize, 0), sampleSize);
+    std::mt19937 rng(params.seed);
+    std::uniform_int_distribution<size_t> pick(0, total - 1);
+    std::vector<int> subset;
+    subset.reserve(subsetSize);
+    for(size_t attempt = 0; attempt < 16 * subsetSize && subset.size() < subsetSize; attempt++)
+    {
+        const size_t drawn = pick(rng);
+        const int index = indices != NULL ? (*indices)[drawn] : static_cast<int>(drawn);
+        if(isValidPoint(cloud.points[index]) && (params.weights == NULL || (*params.weights)[index] > 0))
+        {
+            subset.push_back(index);
+        }
+    }
+
+    // verify the seed on the subset, then refine it on the inliers of the subset
+    std::vector<int> subsetInliers;
+    selectInliers(cloud, &subset, typeModel, result.coefficients, params.distanceThreshold, 1, subsetInliers, NULL);
+    if(subset.size() < sampleSize || inlierRatio(subsetInliers, subset, params.weights) < minRatio)
+    {
+        return false;
+    }
+    for(int r = 0; r < refinements; r++)
+    {
+        std::vector<float> refined;
+        if(!fitModel(cloud, subsetInliers, typeModel, refined))
+        {
+            break;
+        }
+        result.coefficients = refined;
+        if(r + 1 < refinements)
+        {
+            selectInliers(cloud, &subset, typeModel, result.coefficients, params.distanceThreshold, 1, subsetInliers,
+                NULL);
+        }
+    }
+
+    // select the inliers on all points, the points with a non finite distance are the invalid ones
+    const int numThreads = resolveThreadCount(params.numThreads);
+    const float threshold = static_cast<float>(params.distanceThreshold);
+    const Eigen::Vector4f model(result.coefficients[0], result.coefficients[1], result.coefficients[2],
+        result.coefficients[3]);
+    std::vector<std::vector<int> > threadInliers(numThreads);
+    std::vector<double> threadSquares(numThreads, 0.0);
+    std::vector<double> threadInlierWeights(numThreads, 0.0);
+    std::vector<double> threadTotalWeights(numThreads, 0.0);
+    int chunks = parallelRanges(numThreads, total, [&](size_t begin, size_t end, int thread)
+    {
+        std::vector<int> &local = threadInliers[thread];
+        double squares = 0;
+        double inlierWeight = 0;
+        double totalWeight = 0;
+        float distances[KERNEL_BLOCK];
+        for(size_t block = begin; block < end; block += KERNEL_BLOCK)
+        {
+            const size_t count = std::min(KERNEL_BLOCK, end - block);
+            const int *blockIndices = indices != NULL ? &(*indices)[block] : NULL;
+            if(typeModel == BOX && blockIndices != NULL)
+            {
+                planeDistancesIndexed(&cloud.points[0].x, POINT_STRIDE, blockIndices, count,
+                    result.coefficients.data(), distances);
+            }
+            else if(typeModel == BOX)
+            {
+                planeDistances(&cloud.points[block].x, POINT_STRIDE, count, result.coefficients.data(), distances);
+            }
+            else
+            {
+                for(size_t k = 0; k < count; k++)
+                {
+                    const pcl::PointXYZRGBA &point = cloud.points[blockIndices != NULL ? blockIndices[k] :
+                        static_cast<int>(block + k)];
+                    distances[k] = modelDistance(typeModel, model, point.x, point.y, point.z);
+                }
+            }
+            for(size_t k = 0; k < count; k++)
+            {
+                const int index = blockIndices != NULL ? blockIndices[k] : static_cast<int>(block + k);
+                const double weight = params.weights != NULL ? (*params.weights)[index] : 1.0;
+                if(!std::isfinite(distances[k]) || weight <= 0)
+                {
+                    continue;
+                }
+                totalWeight += weight;
+                if(distances[k] <= threshold)
+                {
+                    local.push_back(index);
+                    squares += distances[k] * distances[k];
+                    inlierWeight += weight;
+                }
+            }
+        }
+        threadSquares[thread] = squares;
+        threadInlierWeights[thread] = inlierWeight;
+        threadTotalWeights[thread] = totalWeight;
+    });
+    double squares = 0;
+    double inlierWeight = 0;
+    double totalWeight = 0;
+    for(int t = 0; t < chunks; t++)
+    {
+        result.inliers.insert(result.inliers.end(), threadInliers[t].begin(), threadInliers[t].end());
+        squares += threadSquares[t];
+        inlierWeight += threadInlierWeights[t];
+        totalWeight += threadTotalWeights[t];
+    }
+    result.rmse = result.inliers.empty() ? 0.0 : std::sqrt(squares / result.inliers.size());
+    result.inlierRatio = totalWeight > 0 ? inlierWeight / totalWeight : 0.0;
+    return !result.inliers.empty() && result.inlierRatio >= minRatio;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Fits a model to a set of points by least squares
+ *
+ * Planes are fitted through the centroid along the direction of least variance, spheres by an algebraic fit.
+ *
+ * @param[in] cloud input point cloud
+ * @param[in] indices indices of the points to fit
+ * @param[in] typeModel model type
+ * @param[out] coefficients fitted model coefficients
+ * @return false if there are too few points or the fit is degenerate
+ **********************************************************************************************************************/
+bool fitModel(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> &indices, TypeModel typeModel,
+    std::vector<float> &coefficients)
+{
+    const size_t sampleSize = typeModel == SPHERE ? 4 : 3;
+    if(indices.size() < sampleSize)
+    {
+        return false;
+    }
+
+    // center the points for numerical stability
+    Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+    for(size_t i = 0; i < indices.size(); i++)
+    {
+        centroid += cloud.points[indices[i]].getVector3fMap().cast<double>();
+    }
+    centroid /= static_cast<double>(indices.size());
+
+    if(typeModel == SPHERE)
+    {
+        // least squares solution of x^2 + y^2 + z^2 + D x + E y + F z + G = 0
+        Eigen::Matrix4d AtA = Eigen::Matrix4d::Zero();
+        Eigen::Vector4d Atb = Eigen::Vector4d::Zero();
+        for(size_t i = 0; i < indices.size(); i++)
+        {
+            Eigen::Vector3d p = cloud.points[indices[i]].getVector3fMap().cast<double>() - centroid;
+            Eigen::Vector4d row(p[0], p[1], p[2], 1.0);
+            AtA += row * row.transpose();
+            Atb -= row * p.squaredNorm();
+        }
+        Eigen::FullPivLU<Eigen::Matrix4d> lu(AtA);
+        if(!lu.isInvertible())
+        {
+            return false;
+        }
+        Eigen::Vector4d x = lu.solve(Atb);
+        Eigen::Vector3d center = -0.5 * x.head<3>();
+        double radiusSquared = center.squaredNorm() - x[3];
+        if(radiusSquared <= 0)
+        {
+            return false;
+        }
+        center += centroid;
+        coefficients.resize(4);
+        coefficients[0] = static_cast<float>(center[0]);
+        coefficients[1] = static_cast<float>(center[1]);
+        coefficients[2] = static_cast<float>(center[2]);
+        coefficients[3] = static_cast<float>(std::sqrt(radiusSquared));
+        return true;
+    }
+
+    // the plane normal is the eigenvector of the smallest covariance eigenvalue
+    Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+    for(size_t i = 0; i < indices.size(); i++)
+    {
+        Eigen::Vector3d p = cloud.points[indices[i]].getVector3fMap().cast<double>() - centroid;
+        covariance += p * p.transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    if(solver.info() != Eigen::Success)
+    {
+        return false;
+    }
+    Eigen::Vector3d normal = solver.eigenvectors().col(0).normalized();
+    coefficients.resize(4);
+    coefficients[0] = static_cast<float>(normal[0]);
+    coefficients[1] = static_cast<float>(normal[1]);
+    coefficients[2] = static_cast<float>(normal[2]);
+    coefficients[3] = static_cast<float>(-normal.dot(centroid));
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Selects the points within a distance of a model
+ * @param[in] cloud input point cloud
+ * @param[in] indices indices of the points to test, or NULL for the whole cloud
+ * @param[in] typeModel model type
+ * @param[in] coefficients model coefficients
+ * @param[in] distanceThreshold maximum distance of an inlier to the model
+ * @param[in] numThreads number of threads (0 for the threads of the process wide pool)
+ * @param[out] inliers indices of the inliers, in increasing order of position in the input
+ * @param[out] rmse root mean square distance of the inliers (optional)
+ **********************************************************************************************************************/
+void selectInliers(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const std::vector<float> &coefficients, double distanceThreshold, int numThreads,
+    std::vector<int> &inliers, double *rmse)
+{
+    Eigen::Vector4f model(coefficients[0], coefficients[1], coefficients[2], coefficients[3]);
+    const float threshold = static_cast<float>(distanceThreshold);
+    size_t total = indices != NULL ? indices->size() : cloud.points.size();
+
+    // each thread collects the inliers of its chunk, the chunks are then concatenated in order
+    std::vector<std::vector<int> > threadInliers(resolveThreadCount(numThreads));
+    std::vector<double> threadSquares(threadInliers.size(), 0.0);
+    int chunks = parallelRanges(numThreads, total, [&](size_t begin, size_t end, int thread)
+    {
+        std::vector<int> &local = threadInliers[thread];
+        double squares = 0;
+        if(typeModel == BOX)
+        {
+            // planes use the vectorized distance kernel, one block of points at a time
+            float distances[KERNEL_BLOCK];
+            for(size_t block = begin; block < end; block += KERNEL_BLOCK)
+            {
+                const size_t count = std::min(KERNEL_BLOCK, end - block);
+                if(indices != NULL)
+                {
+                    planeDistancesIndexed(&cloud.points[0].x, POINT_STRIDE, &(*indices)[block], count,
+                        coefficients.data(), distances);
+                }
+                else
+                {
+                    planeDistances(&cloud.points[block].x, POINT_STRIDE, count, coefficients.data(), distances);
+                }
+                for(size_t k = 0; k < count; k++)
+                {
+                    if(distances[k] <= threshold)
+                    {
+                        local.push_back(indices != NULL ? (*indices)[block + k] : static_cast<int>(block + k));
+                        squares += distances[k] * distances[k];
+                    }
+                }
+            }
+            threadSquares[thread] = squares;
+            return;
+        }
+        for(size_t i = begin; i < end; i++)
+        {
+            int index = indices != NULL ? (*indices)[i] : static_cast<int>(i);
+            const pcl::PointXYZRGBA &point = cloud.points[index];
+            float distance = modelDistance(typeModel, model, point.x, point.y, point.z);
+            if(distance <= threshold)
+            {
+                local.push_back(index);
+                squares += distance * distance;
+            }
+        }
+        threadSquares[thread] = squares;
+    });
+
+    inliers.clear();
+    double squares = 0;
+    for(int t = 0; t < chunks; t++)
+    {
+        inliers.insert(inliers.end(), threadInliers[t].begin(), threadInliers[t].end());
+        squares += threadSquares[t];
+    }
+    if(rmse != NULL)
+    {
+        *rmse = inliers.empty() ? 0.0 : std::sqrt(squares / inliers.size());
+    }
+}
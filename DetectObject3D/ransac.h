@@ -0,0 +1,74 @@
+/***********************************************************************************************************************
+* @file ransac.h
+* @brief multi-threaded RANSAC for plane and sphere models with preemptive scoring and early termination
+*
+* Hypotheses are generated concurrently by several threads. Each hypothesis is first scored on a fixed random subset
+* of the points, and only the best scoring hypotheses are verified against the full cloud. The number of iterations
+* adapts to the best inlier ratio found so far and stops once the requested confidence is reached.
+**********************************************************************************************************************/
+
+#ifndef DETECT_RANSAC_H
+#define DETECT_RANSAC_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// model types: a box is segmented through its planar faces
+enum TypeModel {BOX,SPHERE};
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of the RANSAC engine
+ **********************************************************************************************************************/
+struct RansacParams
+{
+    double distanceThreshold;
+    int maxIterations;
+    double confidence;
+    int numThreads;
+    int subsetSize;
+    int verifyCandidates;
+    double minRadius;
+    double maxRadius;
+    unsigned int seed;
+
+    // optional weight of each point of the cloud in the consensus score (NULL for unit weights)
+    const std::vector<float> *weights;
+
+    RansacParams();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Result of a RANSAC segmentation
+ *
+ * The coefficients follow the PCL conventions: (a, b, c, d) with a unit normal for planes, and (x, y, z, radius) for
+ * spheres. The inlier ratio is the share of the valid points (or of their weight) within the distance threshold.
+ **********************************************************************************************************************/
+struct RansacResult
+{
+    std::vector<float> coefficients;
+    std::vector<int> inliers;
+    int iterations;
+    double rmse;
+    double inlierRatio;
+};
+
+bool ransacSegment(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const RansacParams &params, RansacResult &result);
+
+bool refineModel(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const std::vector<float> &seed, const RansacParams &params, RansacResult &result,
+    int refinements = 2);
+
+bool trackModel(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const std::vector<float> &seed, const RansacParams &params, double minRatio,
+    RansacResult &result, int refinements = 2);
+
+bool fitModel(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> &indices, TypeModel typeModel,
+    std::vector<float> &coefficients);
+
+void selectInliers(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> *indices,
+    TypeModel typeModel, const std::vector<float> &coefficients, double distanceThreshold, int numThreads,
+    std::vector<int> &inliers, double *rmse);
+
+#endif
@@ -0,0 +1,538 @@
+/***********************************************************************************************************************
+* @file scene_generator.cpp
+* @brief deterministic generator of synthetic tabletop scenes with ground truth labels
+**********************************************************************************************************************/
+
+#include "scene_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <Eigen/Geometry>
+
+// size ranges of the objects, every object fits in a cell of the placement grid with room to spare
+const float BOX_MIN_SIDE = 0.05f;
+const float BOX_MAX_SIDE = 0.12f;
+const float BOX_MIN_HEIGHT = 0.04f;
+const float BOX_MAX_HEIGHT = 0.12f;
+const float SPHERE_MIN_RADIUS = 0.03f;
+const float SPHERE_MAX_RADIUS = 0.07f;
+const float CELL_SIZE = 0.22f;
+
+// height of the volume above the table filled with outliers
+const float OUTLIER_HEIGHT = 0.5f;
+
+// pose of the camera: tilted down by 35 degrees, with the center of the table 0.9 m ahead
+const float CAMERA_TILT = 35.0f * static_cast<float>(M_PI) / 180.0f;
+const float CAMERA_DISTANCE = 0.9f;
+
+// share of the image left around the table by the focal length of organized scenes
+const float IMAGE_MARGIN = 1.1f;
+
+// colors of the table and the objects, in turn, and of the outliers
+const uint32_t SURFACE_COLORS[] = {0xff8b6d4au, 0xff3a7bd5u, 0xffd5573au, 0xff5ad53au, 0xffd5c43au, 0xff9b3ad5u};
+const uint32_t OUTLIER_COLOR = 0xff808080u;
+
+/*******************************************************************************************************************//**
+ * @brief Random numbers with the same sequence on every platform
+ **********************************************************************************************************************/
+class SceneRandom
+{
+    public:
+        explicit SceneRandom(unsigned int seed): _engine(seed)
+        {
+        }
+
+        // uniform in [low, high), from the 24 high bits of the engine output
+        float uniform(float low, float high)
+        {
+            return low + (high - low) * static_cast<float>(_engine() >> 8) * (1.0f / 16777216.0f);
+        }
+
+        // standard normal, by the Box-Muller transform
+        float normal()
+        {
+            float u = uniform(1e-7f, 1.0f);
+            float v = uniform(0.0f, 1.0f);
+            return std::sqrt(-2.0f * std::log(u)) * std::cos(2.0f * static_cast<float>(M_PI) * v);
+        }
+
+    private:
+        std::mt19937 _engine;
+};
+
+/*******************************************************************************************************************//**
+ * @brief An object placed on the table, in the table frame (z up, table top at z = 0)
+ **********************************************************************************************************************/
+struct SceneObject
+{
+    int type;
+    float x;
+    float y;
+    float yaw;
+    float sizeX;
+    float sizeY;
+    float height;
+    float radius;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Tells whether a point of the table top is hidden under an object
+ **********************************************************************************************************************/
+static bool isUnderObject(const std::vector<SceneObject> &objects, float x, float y)
+{
+    for(size_t i = 0; i < objects.size(); i++)
+    {
+        const SceneObject &object = objects[i];
+        float dx = x - object.x;
+        float dy = y - object.y;
+        if(object.type == LABEL_SPHERE)
+        {
+            if(dx * dx + dy * dy < object.radius * object.radius)
+            {
+                return true;
+            }
+            continue;
+        }
+        float u = std::cos(object.yaw) * dx + std::sin(object.yaw) * dy;
+        float v = -std::sin(object.yaw) * dx + std::cos(object.yaw) * dy;
+        if(std::fabs(u) < 0.5f * object.sizeX && std::fabs(v) < 0.5f * object.sizeY)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Draws a point on the visible surface of an object, in the table frame
+ *
+ * Boxes are sampled on their top and four sides, spheres on the part above a quarter of their height, which is the
+ * part a camera above the table sees.
+ **********************************************************************************************************************/
+static Eigen::Vector3f sampleObject(const SceneObject &object, SceneRandom &random)
+{
+    if(object.type == LABEL_SPHERE)
+    {
+        // the area of a spherical zone is proportional to its height, so the height is drawn uniformly
+        float z = random.uniform(-0.5f * object.radius, object.radius);
+        float angle = random.uniform(0.0f, 2.0f * static_cast<float>(M_PI));
+        float ring = std::sqrt(std::max(0.0f, object.radius * object.radius - z * z));
+        return Eigen::Vector3f(object.x + ring * std::cos(angle), object.y + ring * std::sin(angle),
+            object.radius + z);
+    }
+
+    // pick the top or a side in proportion to its area, then a point on it in the box frame
+    const float topArea = object.sizeX * object.sizeY;
+    const float sideAreaX = object.sizeY * object.height;
+    const float sideAreaY = object.sizeX * object.height;
+    float pick = random.uniform(0.0f, topArea + 2.0f * sideAreaX + 2.0f * sideAreaY);
+    float u = 0;
+    float v = 0;
+    float z = 0;
+    if(pick < topArea)
+    {
+        u = random.uniform(-0.5f, 0.5f) * object.sizeX;
+        v = random.uniform(-0.5f, 0.5f) * object.sizeY;
+        z = object.height;
+    }
+    else if(pick < topArea + 2.0f * sideAreaX)
+    {
+        u = (pick < topArea + sideAreaX ? -0.5f : 0.5f) * object.sizeX;
+        v = random.uniform(-0.5f, 0.5f) * object.sizeY;
+        z = random.uniform(0.0f, object.height);
+    }
+    else
+    {
+        u = random.uniform(-0.5f, 0.5f) * object.sizeX;
+        v = (pick < topArea + 2.0f * sideAreaX + sideAreaY ? -0.5f : 0.5f) * object.sizeY;
+        z = random.uniform(0.0f, object.height);
+    }
+    float c = std::cos(object.yaw);
+    float s = std::sin(object.yaw);
+    return Eigen::Vector3f(object.x + c * u - s * v, object.y + s * u + c * v, z);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Area of the visible surface of an object
+ **********************************************************************************************************************/
+static float objectArea(const SceneObject &object)
+{
+    if(object.type == LABEL_SPHERE)
+    {
+        return 3.0f * static_cast<float>(M_PI) * object.radius * object.radius;
+    }
+    return object.sizeX * object.sizeY + 2.0f * (object.sizeX + object.sizeY) * object.height;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Converts a plane of the table frame to the camera frame
+ **********************************************************************************************************************/
+static void appendPlane(const Eigen::Affine3f &pose, const Eigen::Vector3f &normal, const Eigen::Vector3f &point,
+    std::vector<float> &coefficients)
+{
+    Eigen::Vector3f cameraNormal = pose.linear() * normal;
+    Eigen::Vector3f cameraPoint = pose * point;
+    coefficients.push_back(cameraNormal[0]);
+    coefficients.push_back(cameraNormal[1]);
+    coefficients.push_back(cameraNormal[2]);
+    coefficients.push_back(-cameraNormal.dot(cameraPoint));
+}
+
+/*******************************************************************************************************************//**
+ * @brief Spreads the points over the table and the objects in proportion to their areas, plus the outliers
+ * @param[in] params scene parameters
+ * @param[in] objects objects placed on the table
+ * @param[in] pose pose of the table frame in the camera frame
+ * @param[in,out] random random numbers of the scene
+ * @param[out] cloud unorganized cloud, in the camera frame
+ * @param[out] labels true label of every point
+ **********************************************************************************************************************/
+static void sampleScene(const SceneParams &params, const std::vector<SceneObject> &objects, const Eigen::Affine3f &pose,
+    SceneRandom &random, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, std::vector<int> &labels)
+{
+    // spread the surface points over the table and the objects in proportion to their areas
+    const int numObjects = static_cast<int>(objects.size());
+    const size_t numOutliers = static_cast<size_t>(params.outlierRatio * params.numPoints);
+    const size_t numSurface = params.numPoints - numOutliers;
+    std::vector<float> areas(numObjects + 1);
+    areas[0] = params.tableWidth * params.tableDepth;
+    for(int i = 0; i < numObjects; i++)
+    {
+        areas[i + 1] = objectArea(objects[i]);
+        areas[0] -= objects[i].type == LABEL_SPHERE ? static_cast<float>(M_PI) * objects[i].radius * objects[i].radius :
+            objects[i].sizeX * objects[i].sizeY;
+    }
+    double totalArea = 0;
+    for(int i = 0; i <= numObjects; i++)
+    {
+        totalArea += areas[i];
+    }
+
+    cloud.points.resize(params.numPoints);
+    cloud.width = static_cast<uint32_t>(params.numPoints);
+    cloud.height = 1;
+    cloud.is_dense = true;
+    labels.resize(params.numPoints);
+    size_t next = 0;
+    double cumulativeArea = 0;
+    for(int surface = 0; surface <= numObjects; surface++)
+    {
+        // cumulative rounding makes the counts add up to the number of surface points exactly
+        cumulativeArea += areas[surface];
+        size_t end = static_cast<size_t>(std::llround(numSurface * cumulativeArea / totalArea));
+        end = surface == numObjects ? numSurface : std::min(end, numSurface);
+        for(; next < end; next++)
+        {
+            Eigen::Vector3f point;
+            if(surface == 0)
+            {
+                do
+                {
+                    point = Eigen::Vector3f(random.uniform(-0.5f, 0.5f) * params.tableWidth,
+                        random.uniform(-0.5f, 0.5f) * params.tableDepth, 0.0f);
+                }
+                while(isUnderObject(objects, point[0], point[1]));
+            }
+            else
+            {
+                point = sampleObject(objects[surface - 1], random);
+            }
+            point += params.noise * Eigen::Vector3f(random.normal(), random.normal(), random.normal());
+            Eigen::Vector3f cameraPoint = pose * point;
+            pcl::PointXYZRGBA &cloudPoint = cloud.points[next];
+            cloudPoint.x = cameraPoint[0];
+            cloudPoint.y = cameraPoint[1];
+            cloudPoint.z = cameraPoint[2];
+            cloudPoint.rgba = SURFACE_COLORS[surface % 6];
+            labels[next] = surface + 1;
+        }
+    }
+
+    // scatter the outliers in the volume above the table
+    for(; next < params.numPoints; next++)
+    {
+        Eigen::Vector3f point(random.uniform(-0.5f, 0.5f) * params.tableWidth,
+            random.uniform(-0.5f, 0.5f) * params.tableDepth, random.uniform(0.0f, OUTLIER_HEIGHT));
+        Eigen::Vector3f cameraPoint = pose * point;
+        pcl::PointXYZRGBA &cloudPoint = cloud.points[next];
+        cloudPoint.x = cameraPoint[0];
+        cloudPoint.y = cameraPoint[1];
+        cloudPoint.z = cameraPoint[2];
+        cloudPoint.rgba = OUTLIER_COLOR;
+        labels[next] = 0;
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Distance along a ray to the visible surface of an object, in the table frame
+ * @param[in] object object placed on the table
+ * @param[in] origin origin of the ray
+ * @param[in] direction unit direction of the ray
+ * @return the distance, or infinity if the ray misses the object
+ **********************************************************************************************************************/
+static float intersectObject(const SceneObject &object, const Eigen::Vector3f &origin, const Eigen::Vector3f &direction)
+{
+    const float miss = std::numeric_limits<float>::infinity();
+    if(object.type == LABEL_SPHERE)
+    {
+        Eigen::Vector3f offset = origin - Eigen::Vector3f(object.x, object.y, object.radius);
+        float b = offset.dot(direction);
+        float discriminant = b * b - offset.squaredNorm() + object.radius * object.radius;
+        if(discriminant < 0)
+        {
+            return miss;
+        }
+        float distance = -b - std::sqrt(discriminant);
+        return distance > 0 ? distance : miss;
+    }
+
+    // intersect the slabs of the box, in the box frame
+    float c = std::cos(object.yaw);
+    float s = std::sin(object.yaw);
+    float dx = origin[0] - object.x;
+    float dy = origin[1] - object.y;
+    const float boxOrigin[3] = {c * dx + s * dy, -s * dx + c * dy, origin[2]};
+    const float boxDirection[3] = {c * direction[0] + s * direction[1], -s * direction[0] + c * direction[1],
+        direction[2]};
+    const float low[3] = {-0.5f * object.sizeX, -0.5f * object.sizeY, 0.0f};
+    const float high[3] = {0.5f * object.sizeX, 0.5f * object.sizeY, object.height};
+    float entry = 0;
+    float exit = miss;
+    for(int axis = 0; axis < 3; axis++)
+    {
+        if(std::fabs(boxDirection[axis]) < 1e-12f)
+        {
+            if(boxOrigin[axis] < low[axis] || boxOrigin[axis] > high[axis])
+            {
+                return miss;
+            }
+            continue;
+        }
+        float near = (low[axis] - boxOrigin[axis]) / boxDirection[axis];
+        float far = (high[axis] - boxOrigin[axis]) / boxDirection[axis];
+        if(near > far)
+        {
+            std::swap(near, far);
+        }
+        entry = std::max(entry, near);
+        exit = std::min(exit, far);
+    }
+    return entry > 0 && entry <= exit ? entry : miss;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Renders the scene as an organized cloud, casting a ray through every pixel of a 4:3 image grid
+ *
+ * The focal length frames the table in the image with a margin. Each pixel holds the first surface its ray hits, with
+ * the same noise as the sampled points, or NaN if the ray misses the table and the objects. Outliers are pixels moved
+ * to a random depth between the camera and their surface.
+ *
+ * @param[in] params scene parameters
+ * @param[in] objects objects placed on the table
+ * @param[in] pose pose of the table frame in the camera frame
+ * @param[in,out] random random numbers of the scene
+ * @param[out] cloud organized cloud, in the camera frame
+ * @param[out] labels true label of every pixel, 0 for the pixels of no object
+ **********************************************************************************************************************/
+static void renderScene(const SceneParams &params, const std::vector<SceneObject> &objects, const Eigen::Affine3f &pose,
+    SceneRandom &random, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, std::vector<int> &labels)
+{
+    const uint32_t width = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(params.numPoints * 4.0 / 3.0)));
+    const uint32_t height = std::max<uint32_t>(1, static_cast<uint32_t>(params.numPoints / width));
+    float extentX = 0;
+    float extentY = 0;
+    for(int corner = 0; corner < 4; corner++)
+    {
+        Eigen::Vector3f point = pose * Eigen::Vector3f((corner & 1 ? 0.5f : -0.5f) * params.tableWidth,
+            (corner & 2 ? 0.5f : -0.5f) * params.tableDepth, 0.0f);
+        extentX = std::max(extentX, std::fabs(point[0] / point[2]));
+        extentY = std::max(extentY, std::fabs(point[1] / point[2]));
+    }
+    const float focal = std::min(0.5f * width / extentX, 0.5f * height / extentY) / IMAGE_MARGIN;
+
+    const Eigen::Affine3f camera = pose.inverse();
+    const Eigen::Vector3f origin = camera.translation();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    cloud.points.resize(static_cast<size_t>(width) * height);
+    cloud.width = width;
+    cloud.height = height;
+    cloud.is_dense = false;
+    labels.assign(cloud.points.size(), 0);
+    for(uint32_t v = 0; v < height; v++)
+    {
+        for(uint32_t u = 0; u < width; u++)
+        {
+            Eigen::Vector3f direction = (camera.linear() * Eigen::Vector3f((u + 0.5f - 0.5f * width) / focal,
+                (v + 0.5f - 0.5f * height) / focal, 1.0f)).normalized();
+
+            // first surface along the ray, the table top or an object
+            int surface = -1;
+            float distance = std::numeric_limits<float>::infinity();
+            if(direction[2] < 0)
+            {
+                float tableDistance = -origin[2] / direction[2];
+                Eigen::Vector3f hit = origin + tableDistance * direction;
+                if(std::fabs(hit[0]) <= 0.5f * params.tableWidth && std::fabs(hit[1]) <= 0.5f * params.tableDepth)
+                {
+                    surface = 0;
+                    distance = tableDistance;
+                }
+            }
+            for(size_t i = 0; i < objects.size(); i++)
+            {
+                float objectDistance = intersectObject(objects[i], origin, direction);
+                if(objectDistance < distance)
+                {
+                    surface = static_cast<int>(i) + 1;
+                    distance = objectDistance;
+                }
+            }
+
+            const size_t index = static_cast<size_t>(v) * width + u;
+            pcl::PointXYZRGBA &cloudPoint = cloud.points[index];
+            if(surface < 0)
+            {
+                cloudPoint.x = nan;
+                cloudPoint.y = nan;
+                cloudPoint.z = nan;
+                cloudPoint.rgba = 0;
+                continue;
+            }
+            Eigen::Vector3f point;
+            if(random.uniform(0.0f, 1.0f) < params.outlierRatio)
+            {
+                point = origin + random.uniform(0.0f, distance) * direction;
+                cloudPoint.rgba = OUTLIER_COLOR;
+            }
+            else
+            {
+                point = origin + distance * direction;
+                point += params.noise * Eigen::Vector3f(random.normal(), random.normal(), random.normal());
+                cloudPoint.rgba = SURFACE_COLORS[surface % 6];
+                labels[index] = surface + 1;
+            }
+            Eigen::Vector3f cameraPoint = pose * point;
+            cloudPoint.x = cameraPoint[0];
+            cloudPoint.y = cameraPoint[1];
+            cloudPoint.z = cameraPoint[2];
+        }
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Default scene: a 1.2 m by 0.8 m table with three boxes, two spheres, 2 mm noise and 1% outliers
+ **********************************************************************************************************************/
+SceneParams::SceneParams():
+    numPoints(100000), numBoxes(3), numSpheres(2), tableWidth(1.2f), tableDepth(0.8f), noise(0.002f),
+    outlierRatio(0.01f), seed(12345), organized(false)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Generates a synthetic tabletop scene
+ * @param[in] params scene parameters
+ * @param[out] cloud generated cloud, in the camera frame
+ * @param[out] truth label of every point and model of every object, the table first (the input hash is left at 0)
+ * @return false if the objects do not fit on the table
+ **********************************************************************************************************************/
+bool generateScene(const SceneParams &params, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, LabelSidecar &truth)
+{
+    SceneRandom random(params.seed);
+    const int cellsX = static_cast<int>(params.tableWidth / CELL_SIZE);
+    const int cellsY = static_cast<int>(params.tableDepth / CELL_SIZE);
+    const int numObjects = params.numBoxes + params.numSpheres;
+    if(numObjects > cellsX * cellsY || params.numPoints == 0)
+    {
+        return false;
+    }
+
+    // place each object in its own cell of a grid shuffled over the table, away from the cell borders
+    std::vector<int> cells(cellsX * cellsY);
+    for(size_t i = 0; i < cells.size(); i++)
+    {
+        cells[i] = static_cast<int>(i);
+    }
+    for(size_t i = cells.size() - 1; i > 0; i--)
+    {
+        size_t j = static_cast<size_t>(random.uniform(0.0f, static_cast<float>(i + 1)));
+        std::swap(cells[i], cells[std::min(j, i)]);
+    }
+    std::vector<SceneObject> objects(numObjects);
+    for(int i = 0; i < numObjects; i++)
+    {
+        SceneObject &object = objects[i];
+        object.type = i < params.numBoxes ? LABEL_BOX : LABEL_SPHERE;
+        float jitter = 0.1f * CELL_SIZE;
+        object.x = (cells[i] % cellsX + 0.5f) * CELL_SIZE - 0.5f * cellsX * CELL_SIZE + random.uniform(-jitter, jitter);
+        object.y = (cells[i] / cellsX + 0.5f) * CELL_SIZE - 0.5f * cellsY * CELL_SIZE + random.uniform(-jitter, jitter);
+        object.yaw = random.uniform(0.0f, 0.5f * static_cast<float>(M_PI));
+        object.sizeX = random.uniform(BOX_MIN_SIDE, BOX_MAX_SIDE);
+        object.sizeY = random.uniform(BOX_MIN_SIDE, BOX_MAX_SIDE);
+        object.height = random.uniform(BOX_MIN_HEIGHT, BOX_MAX_HEIGHT);
+        object.radius = random.uniform(SPHERE_MIN_RADIUS, SPHERE_MAX_RADIUS);
+        if(object.type == LABEL_SPHERE)
+        {
+            object.height = 2.0f * object.radius;
+        }
+    }
+
+    // sample or render the surfaces, in the camera frame
+    const Eigen::Affine3f pose = Eigen::Translation3f(0.0f, 0.0f, CAMERA_DISTANCE) *
+        Eigen::AngleAxisf(static_cast<float>(M_PI) - CAMERA_TILT, Eigen::Vector3f::UnitX());
+    truth.inputHash = 0;
+    truth.inputSize = 0;
+    if(params.organized)
+    {
+        renderScene(params, objects, pose, random, cloud, truth.labels);
+    }
+    else
+    {
+        sampleScene(params, objects, pose, random, cloud, truth.labels);
+    }
+
+    // models of the table and the objects in the camera frame
+    truth.objects.assign(numObjects + 1, LabeledObject());
+    for(int surface = 0; surface <= numObjects; surface++)
+    {
+        LabeledObject &object = truth.objects[surface];
+        object.numPoints = 0;
+        object.inlierRatio = 1.0f;
+        object.rmse = params.noise;
+        if(surface == 0)
+        {
+            object.type = LABEL_TABLE;
+            object.height = 0;
+            appendPlane(pose, Eigen::Vector3f::UnitZ(), Eigen::Vector3f::Zero(), object.coefficients);
+            continue;
+        }
+        const SceneObject &sceneObject = objects[surface - 1];
+        object.type = sceneObject.type;
+        object.height = sceneObject.height;
+        if(sceneObject.type == LABEL_SPHERE)
+        {
+            Eigen::Vector3f center = pose * Eigen::Vector3f(sceneObject.x, sceneObject.y, sceneObject.radius);
+            object.coefficients.assign(center.data(), center.data() + 3);
+            object.coefficients.push_back(sceneObject.radius);
+            continue;
+        }
+        Eigen::Vector3f center(sceneObject.x, sceneObject.y, 0.0f);
+        Eigen::Vector3f axisX(std::cos(sceneObject.yaw), std::sin(sceneObject.yaw), 0.0f);
+        Eigen::Vector3f axisY(-axisX[1], axisX[0], 0.0f);
+        appendPlane(pose, Eigen::Vector3f::UnitZ(), center + sceneObject.height * Eigen::Vector3f::UnitZ(),
+            object.coefficients);
+        appendPlane(pose, axisX, center + 0.5f * sceneObject.sizeX * axisX, object.coefficients);
+        appendPlane(pose, -axisX, center - 0.5f * sceneObject.sizeX * axisX, object.coefficients);
+        appendPlane(pose, axisY, center + 0.5f * sceneObject.sizeY * axisY, object.coefficients);
+        appendPlane(pose, -axisY, center - 0.5f * sceneObject.sizeY * axisY, object.coefficients);
+    }
+    for(size_t i = 0; i < truth.labels.size(); i++)
+    {
+        if(truth.labels[i] > 0)
+        {
+            truth.objects[truth.labels[i] - 1].numPoints++;
+        }
+    }
+    return true;
+}
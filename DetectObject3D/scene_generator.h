@@ -0,0 +1,46 @@
+/***********************************************************************************************************************
+* @file scene_generator.h
+* @brief deterministic generator of synthetic tabletop scenes with ground truth labels
+*
+* A scene is a rectangular table top with boxes and spheres resting on it, seen by a camera above the table, plus
+* sensor noise and uniformly scattered outliers. Points are spread over the surfaces in proportion to their areas, so
+* the same scene can be generated at any number of points. The random numbers are drawn from std::mt19937, whose output
+* is fully specified, with hand written distributions, so a given seed produces the same scene on every platform.
+*
+* Organized scenes are rendered instead, as a depth camera sees them: a ray is cast through every pixel of an image grid,
+* and the pixel holds the first surface it hits, or NaN when it misses the table and the objects.
+**********************************************************************************************************************/
+
+#ifndef DETECT_SCENE_GENERATOR_H
+#define DETECT_SCENE_GENERATOR_H
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include "label_sidecar.h"
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of a synthetic scene
+ *
+ * Lengths are in meters. The noise is the standard deviation of the displacement of every point along each axis, and
+ * the outlier ratio the share of the points scattered in the volume above the table. Organized scenes use a 4:3 image
+ * grid of at most the given number of points, and their outliers are pixels moved to a random depth along their ray.
+ **********************************************************************************************************************/
+struct SceneParams
+{
+    size_t numPoints;
+    int numBoxes;
+    int numSpheres;
+    float tableWidth;
+    float tableDepth;
+    float noise;
+    float outlierRatio;
+    unsigned int seed;
+    bool organized;
+
+    SceneParams();
+};
+
+bool generateScene(const SceneParams &params, pcl::PointCloud<pcl::PointXYZRGBA> &cloud, LabelSidecar &truth);
+
+#endif
@@ -0,0 +1,121 @@
+/***********************************************************************************************************************
+* @file sequence_reader.cpp
+* @brief reads a directory of point cloud frames in order, loading the next frames on a background thread
+**********************************************************************************************************************/
+
+#include "sequence_reader.h"
+
+#include <algorithm>
+#include <dirent.h>
+
+/*******************************************************************************************************************//**
+ * @brief Lists the PCD and PLY files of a directory
+ * @param[in] directory path of the directory
+ * @param[out] fileNames paths of the files, sorted by name
+ * @return false if the directory cannot be read
+ **********************************************************************************************************************/
+bool listSequenceFrames(const std::string &directory, std::vector<std::string> &fileNames)
+{
+    fileNames.clear();
+    DIR *handle = opendir(directory.c_str());
+    if(handle == NULL)
+    {
+        return false;
+    }
+    for(struct dirent *entry = readdir(handle); entry != NULL; entry = readdir(handle))
+    {
+        std::string name(entry->d_name);
+        size_t dot = name.find_last_of(".");
+        if(dot == std::string::npos)
+        {
+            continue;
+        }
+        std::string fileExtension = name.substr(dot + 1);
+        if(fileExtension.compare("pcd") == 0 || fileExtension.compare("ply") == 0)
+        {
+            fileNames.push_back(directory + "/" + name);
+        }
+    }
+    closedir(handle);
+    std::sort(fileNames.begin(), fileNames.end());
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Starts loading the frames of a sequence
+ * @param[in] fileNames paths of the frames, in processing order
+ * @param[in] loader function loading a frame into a cloud
+ * @param[in] depth maximum number of frames loaded ahead
+ **********************************************************************************************************************/
+SequenceReader::SequenceReader(const std::vector<std::string> &fileNames, const Loader &loader, size_t depth):
+    _fileNames(fileNames), _loader(loader), _depth(std::max<size_t>(depth, 1)), _nextFrame(0), _stop(false)
+{
+    _thread = std::thread(&SequenceReader::run, this);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Stops the loader thread, discarding the frames loaded ahead
+ **********************************************************************************************************************/
+SequenceReader::~SequenceReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _spaceAvailable.notify_all();
+    _thread.join();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the next frame, waiting for it to be loaded
+ * @param[out] fileName path of the frame
+ * @param[out] cloud loaded point cloud
+ * @param[out] loaded false if the frame could not be loaded
+ * @return false once every frame has been returned
+ **********************************************************************************************************************/
+bool SequenceReader::next(std::string &fileName, CloudPtr &cloud, bool &loaded)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_nextFrame >= _fileNames.size())
+    {
+        return false;
+    }
+    _frameReady.wait(lock, [this]() { return !_frames.empty(); });
+    fileName = _frames.front().fileName;
+    cloud = _frames.front().cloud;
+    loaded = _frames.front().loaded;
+    _frames.pop_front();
+    _nextFrame++;
+    lock.unlock();
+    _spaceAvailable.notify_one();
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Loads the frames in order, staying at most the prefetch depth ahead of the processing
+ **********************************************************************************************************************/
+void SequenceReader::run()
+{
+    for(size_t i = 0; i < _fileNames.size(); i++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _spaceAvailable.wait(lock, [this]() { return _stop || _frames.size() < _depth; });
+            if(_stop)
+            {
+                return;
+            }
+        }
+
+        // load outside of the lock so the processing thread can take the frames already loaded
+        Frame frame;
+        frame.fileName = _fileNames[i];
+        frame.cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+        frame.loaded = _loader(frame.fileName, frame.cloud);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _frames.push_back(frame);
+        }
+        _frameReady.notify_one();
+    }
+}
@@ -0,0 +1,63 @@
+/***********************************************************************************************************************
+* @file sequence_reader.h
+* @brief reads a directory of point cloud frames in order, loading the next frames on a background thread
+**********************************************************************************************************************/
+
+#ifndef DETECT_SEQUENCE_READER_H
+#define DETECT_SEQUENCE_READER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+bool listSequenceFrames(const std::string &directory, std::vector<std::string> &fileNames);
+
+/*******************************************************************************************************************//**
+ * @brief Loads the frames of a sequence ahead of their processing
+ *
+ * A loader thread keeps up to a given number of frames ready, so reading and parsing the next files overlaps with the
+ * processing of the current one.
+ **********************************************************************************************************************/
+class SequenceReader
+{
+    public:
+        typedef pcl::PointCloud<pcl::PointXYZRGBA>::Ptr CloudPtr;
+        typedef std::function<bool(const std::string &, CloudPtr &)> Loader;
+
+        SequenceReader(const std::vector<std::string> &fileNames, const Loader &loader, size_t depth);
+        ~SequenceReader();
+        bool next(std::string &fileName, CloudPtr &cloud, bool &loaded);
+
+    private:
+        SequenceReader(const SequenceReader &);
+        SequenceReader &operator=(const SequenceReader &);
+
+        // a loaded frame waiting to be processed
+        struct Frame
+        {
+            std::string fileName;
+            CloudPtr cloud;
+            bool loaded;
+        };
+
+        void run();
+
+        std::vector<std::string> _fileNames;
+        Loader _loader;
+        size_t _depth;
+        size_t _nextFrame;
+        bool _stop;
+        std::deque<Frame> _frames;
+        std::mutex _mutex;
+        std::condition_variable _frameReady;
+        std::condition_variable _spaceAvailable;
+        std::thread _thread;
+};
+
+#endif
@@ -0,0 +1,794 @@
+/***********************************************************************************************************************
+* @file tabletop_pipeline.cpp
+* @brief detection of the table, boxes and spheres of a point cloud, shared by the application and the benchmarks
+**********************************************************************************************************************/
+
+#include "tabletop_pipeline.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+#include <pcl/common/time.h>
+#include <pcl/filters/extract_indices.h>
+
+#include "cluster_fitting.h"
+#include "euclidean_clustering.h"
+#include "file_hash.h"
+#include "geometry_kernels.h"
+#include "mapped_cloud.h"
+#include "organized_segmentation.h"
+#include "task_pool.h"
+#include "voxel_index.h"
+
+// share of the inlier ratio of the last full search (PlaneTracker::referenceRatio) a warm started plane must keep to
+// skip the full RANSAC search
+const double WARM_START_MIN_RATIO = 0.9;
+
+// number of points whose distance to the plane is computed at once by the labeling at full resolution
+static const size_t KERNEL_BLOCK = 1024;
+
+/***********************************************************************************************************************
+* @brief Default parameters of the pipeline, at full resolution
+**********************************************************************************************************************/
+PipelineParams::PipelineParams():
+    voxelSize(0), distanceThreshold(0.0254f), maxIterations(5000), clusterDistance(0.02f), minClusterSize(50),
+    maxClusterSize(100000)
+{
+}
+
+/***********************************************************************************************************************
+* @brief Reads the time elapsed on a stop watch and restarts it
+* @param[in,out] watch stop watch timing the current stage
+* @return the time of the stage in seconds
+**********************************************************************************************************************/
+static double lapSeconds(pcl::StopWatch &watch)
+{
+    double seconds = watch.getTimeSeconds();
+    watch.reset();
+    return seconds;
+}
+
+/***********************************************************************************************************************
+* @brief Opens a point cloud file
+*
+* Opens a point cloud file in either PCD or PLY format. Uncompressed binary files are memory mapped and converted in a
+* single parallel pass, other files are read through PCL.
+*
+* @param[out] cloudOut pointer to opened point cloud
+* @param[in] filename path and name of input file
+* @return false if an error occurred while opening file
+* @author Christopher D. McMurrough
+**********************************************************************************************************************/
+bool openCloud(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudOut, std::string fileName)
+{
+    // fast path for binary files
+    MappedCloud mappedCloud;
+    if(mappedCloud.open(fileName) && mappedCloud.toPointCloud(*cloudOut))
+    {
+        return true;
+    }
+
+    // handle various file types
+    std::string fileExtension = fileName.substr(fileName.find_last_of(".") + 1);
+    if(fileExtension.compare("pcd") == 0)
+    {
+        // attempt to open the file
+        if(pcl::io::loadPCDFile<pcl::PointXYZRGBA>(fileName, *cloudOut) == -1)
+        {
+            PCL_ERROR("error while attempting to read pcd file: %s \n", fileName.c_str());
+            return false;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    else if(fileExtension.compare("ply") == 0)
+    {
+        // attempt to open the file
+        if(pcl::io::loadPLYFile<pcl::PointXYZRGBA>(fileName, *cloudOut) == -1)
+        {
+            PCL_ERROR("error while attempting to read pcl file: %s \n", fileName.c_str());
+            return false;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    else
+    {
+        PCL_ERROR("error while attempting to read unsupported file: %s \n", fileName.c_str());
+        return false;
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Saves a point cloud to file
+ *
+ * Saves a given point cloud to disk in PCD format
+ *
+ * @param[in] cloudIn pointer to output point cloud
+ * @param[in] filename path and name of output file
+ * @param[in] binaryMode saves the file in binary form if true (default:false)
+ * @param[in] compressed saves the file in compressed binary form if true, regardless of the binary mode
+ * @return false if an error occured while writing file
+ * @author Christopher D. McMurrough
+ **********************************************************************************************************************/
+bool saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn, std::string fileName, bool binaryMode,
+    bool compressed)
+{
+    // if the input cloud is empty, return
+    if(cloudIn->points.size() == 0)
+    {
+        return false;
+    }
+
+    // attempt to save the file
+    int status = compressed ? pcl::io::savePCDFileBinaryCompressed<pcl::PointXYZRGBA>(fileName, *cloudIn) :
+        pcl::io::savePCDFile<pcl::PointXYZRGBA>(fileName, *cloudIn, binaryMode);
+    if(status == -1)
+    {
+        PCL_ERROR("error while attempting to save pcd file: %s \n", fileName.c_str());
+        return false;
+    }
+    else
+    {
+        return true;
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Locate a plane in the cloud
+ *
+ * Perform planar segmentation using RANSAC, returning the plane parameters and point indices. When a tracker holds the
+ * plane of a previous frame, that plane is refined on the cloud first, and the full search only runs if the refined
+ * plane lost too many inliers compared with the last full search.
+ *
+ * @param[in] cloudIn pointer to input point cloud
+ * @param[out] inliers list containing the point indices of inliers
+ * @param[in] distanceThreshold maximum distance of a point to the planar model to be considered an inlier
+ * @param[in] maxIterations maximum number of iterations to attempt before returning
+ * @param[in] weights optional weight of each point in the consensus score
+ * @param[in,out] tracker optional plane of the previous frame, updated with the plane found
+ * @return the number of inliers
+ * @author Christopher D. McMurrough
+ **********************************************************************************************************************/
+void segmentPlane(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn,
+    std::vector<pcl::ModelCoefficients::Ptr> &allPlanes,
+    std::vector<pcl::PointIndices::Ptr> &allindices,
+    double distanceThreshold, 
+    int maxIterations, TypeModel type_model, const std::vector<float> *weights,
+    PlaneTracker *tracker)
+{
+    // store the model coefficients
+    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
+    pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
+
+    RansacParams params;
+    params.distanceThreshold = distanceThreshold;
+    params.maxIterations = maxIterations;
+    params.weights = weights;
+    RansacResult result;
+
+    // warm start from the plane of the previous frame, as long as it keeps most of the inliers of the last full search
+    bool found = false;
+    if(tracker != NULL)
+    {
+        tracker->warmStarted = false;
+        if(tracker->valid && trackModel(*cloudIn, NULL, type_model, tracker->coefficients, params,
+            WARM_START_MIN_RATIO * tracker->referenceRatio, result))
+        {
+            tracker->warmStarted = true;
+            found = true;
+        }
+    }
+
+    // otherwise run the multi-threaded RANSAC search, refining the best model by least squares
+    if(!found)
+    {
+        found = ransacSegment(*cloudIn, NULL, type_model, params, result);
+    }
+    if(found)
+    {
+        coefficients->values = result.coefficients;
+        inliers->indices.swap(result.inliers);
+    }
+    if(tracker != NULL)
+    {
+        tracker->valid = found;
+        tracker->coefficients = coefficients->values;
+        tracker->inlierRatio = result.inlierRatio;
+        if(!tracker->warmStarted)
+        {
+            tracker->referenceRatio = result.inlierRatio;
+        }
+    }
+    allPlanes.push_back(coefficients);
+    allindices.push_back(inliers);
+    // std::cout<<"Distance:"<<coefficients->values[3]<<std::endl;
+}
+
+
+
+
+/***********************************************************************************************************************
+* @brief Colors the points of a cloud according to the type of their objects
+* @param[in,out] cloud point cloud to color
+* @param[in] labels one label per point, 0 or the index of the object plus one
+* @param[in] objects objects found in the cloud
+**********************************************************************************************************************/
+void colorLabels(pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> &labels,
+    const std::vector<LabeledObject> &objects)
+{
+    // none keeps the original color, the table is blue, boxes are green and spheres are red
+    const uint32_t typeColors[] = {0xffffffffu, 0x0000ffu, 0x00ff00u, 0xff0000u};
+    if(cloud.points.empty())
+    {
+        return;
+    }
+    std::vector<uint32_t> palette(objects.size() + 1, typeColors[LABEL_NONE]);
+    for(size_t i = 0; i < objects.size(); i++)
+    {
+        palette[i + 1] = typeColors[objects[i].type];
+    }
+    recolorLabels(&cloud.points[0], labels.data(), cloud.points.size(), palette.data(),
+        static_cast<int>(palette.size()));
+}
+
+/***********************************************************************************************************************
+* @brief Saves the result of the processing of a cloud
+*
+* Either the cloud is recolored and saved, or only the labels and objects are saved in a label file tied to the input
+* file, which is much smaller and faster to write.
+*
+* @param[in,out] cloud processed point cloud, recolored unless only the labels are saved
+* @param[in] inputFileName path of the file the cloud was loaded from
+* @param[in] result objects found in the cloud
+* @param[in] outputFileName path of the output file
+* @param[in] outputMode content of the output file
+* @return false if an error occurred while writing the file
+**********************************************************************************************************************/
+bool saveOutput(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const std::string &inputFileName,
+    const FrameResult &result, const std::string &outputFileName, OutputMode outputMode)
+{
+    if(outputMode != OUTPUT_LABELS)
+    {
+        colorLabels(*cloud, result.labels, result.objects);
+        return saveCloud(cloud, outputFileName, true, outputMode == OUTPUT_COMPRESSED);
+    }
+
+    LabelSidecar sidecar;
+    if(!hashFile(inputFileName, sidecar.inputHash, sidecar.inputSize))
+    {
+        PCL_ERROR("error while attempting to hash input file: %s \n", inputFileName.c_str());
+        return false;
+    }
+    sidecar.labels = result.labels;
+    sidecar.objects = result.objects;
+    if(!writeLabelSidecar(outputFileName, sidecar))
+    {
+        PCL_ERROR("error while attempting to save label file: %s \n", outputFileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+/***********************************************************************************************************************
+* @brief Loads the voxel index of a cloud from the cache, or builds it and stores it into the cache
+* @param[in] cloud PCL cloud or mapped file the index is built from
+* @param[in] numPoints number of points of the cloud
+* @param[in] voxelSize edge length of the voxels
+* @param[in,out] cache optional cache of the input file
+* @param[in] verbose prints the number of points before and after downsampling if true
+* @param[out] voxelIndex voxel index of the cloud
+* @return false if the voxel size is invalid for the cloud
+**********************************************************************************************************************/
+template<typename Cloud>
+static bool prepareVoxelIndex(const Cloud &cloud, size_t numPoints, float voxelSize, IndexCache *cache, bool verbose,
+    VoxelIndex &voxelIndex)
+{
+    const bool cached = cache != NULL && cache->loadVoxelIndex(voxelSize, numPoints, voxelIndex);
+    if(!cached && !voxelIndex.build(cloud, voxelSize))
+    {
+        PCL_ERROR("invalid voxel size: %f \n", voxelSize);
+        return false;
+    }
+    if(!cached && cache != NULL)
+    {
+        cache->storeVoxelIndex(voxelIndex);
+    }
+    if(verbose)
+    {
+        if(cached)
+        {
+            std::cout << "Voxel index loaded from " << cache->fileName() << std::endl;
+        }
+        std::cout << "Points before downsampling: " << numPoints << std::endl;
+        std::cout << "Points after downsampling: " << voxelIndex.numVoxels() << std::endl;
+    }
+    return true;
+}
+
+/***********************************************************************************************************************
+* @brief Segments the table, clusters the objects on it and classifies them, on the cloud the pipeline works on
+*
+* Organized clouds at full resolution are segmented on their image grid. Other clouds are segmented by RANSAC and
+* clustered on a spatial hash. With a cache, the plane is loaded from it when available, and stored into it otherwise.
+*
+* @param[in] workCloud full cloud, or voxel centroids when downsampling
+* @param[in] organized segments the cloud on its image grid if true
+* @param[in] numPoints number of points of the full cloud
+* @param[in] voxelWeights number of points in each voxel when downsampling, otherwise empty
+* @param[in] params pipeline parameters
+* @param[in,out] tracker optional plane of the previous frame, used to warm start the plane segmentation
+* @param[in,out] cache optional cache of the input file, not used when tracking a plane
+* @param[in] verbose prints the objects found if true
+* @param[in,out] stageWatch stop watch timing the stages
+* @param[out] result objects found, and processing time of the stages
+* @param[out] labels label of every point of the work cloud
+* @return false if no plane was found or the clustering parameters are invalid
+**********************************************************************************************************************/
+static bool detectObjects(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &workCloud, bool organized, size_t numPoints,
+    const std::vector<float> &voxelWeights, const PipelineParams &params, PlaneTracker *tracker, IndexCache *cache,
+    bool verbose, pcl::StopWatch &stageWatch, FrameResult &result, std::vector<int> &labels)
+{
+    const float voxelSize = params.voxelSize;
+    labels.assign(workCloud->points.size(), 0);
+
+    // 
+    std::vector<pcl::ModelCoefficients::Ptr> allPlanes;
+    std::vector<pcl::PointIndices::Ptr> allindices;
+    std::vector<pcl::PointIndices> clusterIndices;
+
+    // organized clouds at full resolution are segmented on their image grid
+    if(organized)
+    {
+        OrganizedParams organizedParams;
+        organizedParams.distanceThreshold = params.distanceThreshold;
+        organizedParams.clusterDistance = params.clusterDistance;
+        organizedParams.minClusterSize = params.minClusterSize;
+        organizedParams.maxClusterSize = params.maxClusterSize;
+        OrganizedResult organizedResult;
+        if(!organizedSegment(workCloud, organizedParams, organizedResult))
+        {
+            PCL_ERROR("unable to locate a plane in the cloud \n");
+            return false;
+        }
+        pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
+        pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
+        coefficients->values = organizedResult.tablePlane;
+        inliers->indices.swap(organizedResult.tableInliers.indices);
+        allPlanes.push_back(coefficients);
+        allindices.push_back(inliers);
+        clusterIndices.swap(organizedResult.clusters);
+        if(verbose)
+        {
+            std::cout << "Planes found in the organized cloud: " << organizedResult.numPlanes << std::endl;
+        }
+
+        // there is no plane to warm start the next frame from
+        if(tracker != NULL)
+        {
+            tracker->valid = false;
+            tracker->warmStarted = false;
+            tracker->inlierRatio = static_cast<double>(inliers->indices.size()) / numPoints;
+        }
+        result.timings.plane = lapSeconds(stageWatch);
+    }
+    else
+    {
+        // reuse the plane cached with the same parameters, or warm start from the one cached with a smaller threshold
+        const std::vector<float> *weights = voxelWeights.empty() ? NULL : &voxelWeights;
+        PlaneTracker cacheTracker;
+        CachedPlane cachedPlane;
+        bool exactPlane = false;
+        if(cache != NULL && tracker == NULL && cache->findPlane(voxelSize, params.distanceThreshold,
+            params.maxIterations, cachedPlane, exactPlane))
+        {
+            cacheTracker.valid = true;
+            cacheTracker.coefficients = cachedPlane.coefficients;
+            cacheTracker.inlierRatio = cachedPlane.inlierRatio;
+            cacheTracker.referenceRatio = cachedPlane.inlierRatio;
+        }
+        if(exactPlane)
+        {
+            // the plane was refined on the same points, so only its inliers are selected again
+            RansacParams ransacParams;
+            ransacParams.distanceThreshold = params.distanceThreshold;
+            ransacParams.weights = weights;
+            RansacResult ransacResult;
+            exactPlane = refineModel(*workCloud, NULL, BOX, cachedPlane.coefficients, ransacParams, ransacResult, 0);
+            if(exactPlane)
+            {
+                pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
+                pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
+                coefficients->values = ransacResult.coefficients;
+                inliers->indices.swap(ransacResult.inliers);
+                allPlanes.push_back(coefficients);
+                allindices.push_back(inliers);
+            }
+        }
+
+        // segment a plane
+        if(!exactPlane)
+        {
+            segmentPlane(workCloud,allPlanes,allindices, params.distanceThreshold, params.maxIterations,BOX,
+                weights, tracker != NULL ? tracker : cache != NULL ? &cacheTracker : NULL);
+        }
+        if(allPlanes.at(0)->values.size() != 4)
+        {
+            PCL_ERROR("unable to locate a plane in the cloud \n");
+            return false;
+        }
+        if(cache != NULL && tracker == NULL && !exactPlane)
+        {
+            cachedPlane.voxelSize = voxelSize;
+            cachedPlane.distanceThreshold = params.distanceThreshold;
+            cachedPlane.maxIterations = params.maxIterations;
+            cachedPlane.inlierRatio = cacheTracker.inlierRatio;
+            cachedPlane.coefficients = allPlanes.at(0)->values;
+            cache->storePlane(cachedPlane);
+        }
+        if(verbose && cache != NULL && tracker == NULL)
+        {
+            std::cout << (exactPlane ? "Plane loaded from " : cacheTracker.warmStarted ? "Plane refined from " :
+                "Plane searched, cached in ") << cache->fileName() << std::endl;
+        }
+        result.timings.plane = lapSeconds(stageWatch);
+
+        // filtered the planes
+        pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudFiltered(new pcl::PointCloud<pcl::PointXYZRGBA>);
+        pcl::ExtractIndices<pcl::PointXYZRGBA> extract;
+        extract.setInputCloud(workCloud);
+        extract.setIndices (allindices.at(0));
+        extract.setNegative (true);
+        extract.setKeepOrganized(true);
+        extract.filter (*cloudFiltered);
+        result.timings.extraction = lapSeconds(stageWatch);
+
+        // create the vector of indices lists (each element contains a list of imultiple indices)
+        float clusterDistance = params.clusterDistance;
+        int minClusterSize = params.minClusterSize;
+        int maxClusterSize = params.maxClusterSize;
+        if(voxelSize > 0)
+        {
+            // centroids of neighboring voxels can be up to two leaves apart, and clusters shrink with the downsampling
+            clusterDistance = std::max(clusterDistance, 2.0f * voxelSize);
+            minClusterSize = std::max(1,
+                static_cast<int>(minClusterSize * workCloud->points.size() / numPoints));
+        }
+
+        // perform the clustering on a spatial hash, the removed plane points are NaN and ignored
+        if(!euclideanClusters(*cloudFiltered, clusterDistance, minClusterSize, maxClusterSize, 0, clusterIndices))
+        {
+            PCL_ERROR("invalid cluster tolerance: %f \n", clusterDistance);
+            return false;
+        }
+        //std::cout << "Clusters identified: " << clusterIndices.size() << std::endl;
+        result.timings.clustering = lapSeconds(stageWatch);
+    }
+
+    // label the plane inliers as the table, the first object
+    LabeledObject table;
+    table.type = LABEL_TABLE;
+    table.numPoints = 0;
+    table.height = 0;
+    table.inlierRatio = 0;
+    table.rmse = 0;
+    table.coefficients = allPlanes.at(0)->values;
+    result.objects.push_back(table);
+    for(size_t i = 0; i < allindices.at(0)->indices.size(); i++)
+    {
+        labels[allindices.at(0)->indices[i]] = 1;
+    }
+
+    // fit sphere and box primitives to every cluster in parallel, and label the clusters resting on the table
+    ClusterFitParams fitParams;
+    std::vector<ClusterFit> fits;
+    fitClusters(*workCloud, clusterIndices, allPlanes.at(0)->values, fitParams, fits);
+
+    for(size_t i = 0; i < clusterIndices.size(); i++)
+    {
+        const ClusterFit &fit = fits[i];
+        if(!fit.isObject)
+        {
+            continue;
+        }
+        LabeledObject object;
+        object.numPoints = 0;
+        object.height = static_cast<float>(fit.height);
+        if(fit.type == SPHERE)
+        {
+            object.type = LABEL_SPHERE;
+            object.inlierRatio = static_cast<float>(fit.sphereInlierRatio);
+            object.rmse = static_cast<float>(fit.sphereRmse);
+            object.coefficients = fit.sphere;
+            result.spherical++;
+            if(verbose)
+            {
+                std::printf("Sphere: center (%.3f, %.3f, %.3f) radius %.3f, %.0f%% inliers, rmse %.4f \n",
+                    fit.sphere[0], fit.sphere[1], fit.sphere[2], fit.sphere[3], 100.0 * fit.sphereInlierRatio,
+                    fit.sphereRmse);
+            }
+        }
+        else
+        {
+            object.type = LABEL_BOX;
+            object.inlierRatio = static_cast<float>(fit.boxInlierRatio);
+            object.rmse = static_cast<float>(fit.boxRmse);
+            for(size_t f = 0; f < fit.faces.size(); f++)
+            {
+                object.coefficients.insert(object.coefficients.end(), fit.faces[f].begin(), fit.faces[f].end());
+            }
+            result.boxes++;
+            if(verbose)
+            {
+                std::printf("Box: %d faces, %.0f%% inliers, rmse %.4f \n", static_cast<int>(fit.faces.size()),
+                    100.0 * fit.boxInlierRatio, fit.boxRmse);
+            }
+        }
+        result.objects.push_back(object);
+
+        const int label = static_cast<int>(result.objects.size());
+        for(size_t j = 0; j < clusterIndices.at(i).indices.size(); j++)
+        {
+            labels[clusterIndices.at(i).indices.at(j)] = label;
+        }
+    }
+    result.timings.classification = lapSeconds(stageWatch);
+    return true;
+}
+
+/***********************************************************************************************************************
+* @brief Labels the table points of a range of the full resolution cloud by their own distance to the plane
+*
+* The labels of the voxels are projected back onto their points, so a voxel straddling the edge of the table or the base
+* of an object gives all its points the same label. As in the segmentation at full resolution, the points within the
+* distance threshold of the plane are table points, and the other points of the table voxels belong to no object.
+*
+* @param[in] xyz pointer to the x coordinate of the first point of the range
+* @param[in] stride number of floats between consecutive points
+* @param[in] count number of points of the range
+* @param[in] plane coefficients of the table plane
+* @param[in] threshold distance threshold of the plane
+* @param[in,out] labels labels of the points of the range, projected back from the voxels
+**********************************************************************************************************************/
+static void labelTablePoints(const float *xyz, size_t stride, size_t count, const std::vector<float> &plane,
+    float threshold, int *labels)
+{
+    float distances[KERNEL_BLOCK];
+    for(size_t block = 0; block < count; block += KERNEL_BLOCK)
+    {
+        const size_t blockCount = std::min(KERNEL_BLOCK, count - block);
+        planeDistances(xyz + block * stride, stride, blockCount, plane.data(), distances);
+        for(size_t i = 0; i < blockCount; i++)
+        {
+            int &label = labels[block + i];
+            if(distances[i] <= threshold)
+            {
+                label = 1;
+            }
+            else if(label == 1)
+            {
+                label = 0;
+            }
+        }
+    }
+}
+
+/***********************************************************************************************************************
+* @brief Labels the table points of a mapped file by their distance to the plane, reading the mapped columns
+*
+* The coordinates are read in place when they are consecutive aligned floats, as in binary PCD files starting with the
+* x, y and z fields, and copied one block at a time otherwise. The file is streamed chunk by chunk.
+*
+* @param[in] cloud mapped point cloud file
+* @param[in] plane coefficients of the table plane
+* @param[in] threshold distance threshold of the plane
+* @param[in,out] labels labels of every point, projected back from the voxels
+**********************************************************************************************************************/
+static void labelMappedTablePoints(const MappedCloud &cloud, const std::vector<float> &plane, float threshold,
+    std::vector<int> &labels)
+{
+    StridedView<float> x, y, z;
+    if(!cloud.positionColumns(x, y, z))
+    {
+        return;
+    }
+    // the vectorized kernels read a fourth float after z, which must still lie within the point
+    const size_t xOffset = cloud.field("x")->offset;
+    const bool inPlace = y.data == x.data + sizeof(float) && z.data == x.data + 2 * sizeof(float) &&
+        x.stride % sizeof(float) == 0 && reinterpret_cast<uintptr_t>(x.data) % sizeof(float) == 0 &&
+        (x.stride < 4 * sizeof(float) || xOffset + 4 * sizeof(float) <= x.stride);
+    cloud.forEachChunk(MAPPED_CHUNK_POINTS, [&](size_t begin, size_t end)
+    {
+        parallelRanges(0, end - begin, [&](size_t first, size_t last, int)
+        {
+            // blocks copied out of the file are laid out four floats per point, for the vectorized kernels
+            float xyz[4 * KERNEL_BLOCK];
+            for(size_t block = begin + first; block < begin + last; block += KERNEL_BLOCK)
+            {
+                const size_t count = std::min(KERNEL_BLOCK, begin + last - block);
+                if(inPlace)
+                {
+                    labelTablePoints(reinterpret_cast<const float *>(x.data + block * x.stride),
+                        x.stride / sizeof(float), count, plane, threshold, &labels[block]);
+                    continue;
+                }
+                for(size_t i = 0; i < count; i++)
+                {
+                    xyz[4 * i] = x[block + i];
+                    xyz[4 * i + 1] = y[block + i];
+                    xyz[4 * i + 2] = z[block + i];
+                    xyz[4 * i + 3] = 0.0f;
+                }
+                labelTablePoints(xyz, 4, count, plane, threshold, &labels[block]);
+            }
+        });
+    });
+}
+
+/***********************************************************************************************************************
+* @brief Counts the points of each object at full resolution and stores the labels into the result
+* @param[in,out] labels label of every point of the full cloud, moved into the result
+* @param[in,out] result objects found, whose number of points is set
+**********************************************************************************************************************/
+static void countObjectPoints(std::vector<int> &labels, FrameResult &result)
+{
+    for(size_t i = 0; i < labels.size(); i++)
+    {
+        if(labels[i] > 0)
+        {
+            result.objects[labels[i] - 1].numPoints++;
+        }
+    }
+    result.objects[0].inlierRatio = labels.empty() ? 0.0f :
+        static_cast<float>(result.objects[0].numPoints) / labels.size();
+    result.labels.swap(labels);
+}
+
+/***********************************************************************************************************************
+* @brief Detects the table, boxes and spheres of a cloud and labels their points
+*
+* Organized clouds are segmented on their image grid, unless they are downsampled. Other clouds are segmented by
+* RANSAC and clustered on a spatial hash. When downsampling, the labels of the voxels are projected back onto their
+* points, and the table points are then selected by their own distance to the plane. With a cache, the voxel index and
+* the plane are loaded from it when available, and stored into it otherwise.
+*
+* @param[in] cloud point cloud to process
+* @param[in] params pipeline parameters
+* @param[in,out] tracker optional plane of the previous frame, used to warm start the plane segmentation
+* @param[in,out] cache optional cache of the input file, not used when tracking a plane
+* @param[in] verbose prints the objects found if true
+* @param[out] result objects found, label of every point, and processing time of each stage
+* @return false if the cloud could not be processed
+**********************************************************************************************************************/
+bool processCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const PipelineParams &params,
+    PlaneTracker *tracker, IndexCache *cache, bool verbose, FrameResult &result)
+{
+    result.boxes = 0;
+    result.spherical = 0;
+    result.seconds = 0;
+    result.timings = PipelineTimings();
+    result.objects.clear();
+    const float voxelSize = params.voxelSize;
+
+    // create stop watches for measuring the total time and the time of each stage
+    pcl::StopWatch watch;
+    pcl::StopWatch stageWatch;
+
+    // run the segmentation on the voxel centroids if downsampling is enabled, otherwise on the full cloud
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr workCloud = cloud;
+    VoxelIndex voxelIndex;
+    std::vector<float> voxelWeights;
+    if(voxelSize > 0)
+    {
+        if(!prepareVoxelIndex(*cloud, cloud->points.size(), voxelSize, cache, verbose, voxelIndex))
+        {
+            return false;
+        }
+        workCloud = voxelIndex.centroids();
+
+        // weight each voxel by its number of points, so the plane with the most points at full resolution still wins
+        voxelIndex.voxelWeights(voxelWeights);
+    }
+    result.timings.downsampling = lapSeconds(stageWatch);
+
+    std::vector<int> labels;
+    if(!detectObjects(workCloud, voxelSize <= 0 && cloud->isOrganized(), cloud->points.size(), voxelWeights, params,
+        tracker, cache, verbose, stageWatch, result, labels))
+    {
+        return false;
+    }
+
+    // project the labels back onto every original point, then select the table points at full resolution
+    if(voxelSize > 0)
+    {
+        std::vector<int> pointLabels;
+        voxelIndex.backProject(labels, 0, pointLabels);
+        labels.swap(pointLabels);
+        const std::vector<float> &plane = result.objects[0].coefficients;
+        parallelRanges(0, labels.size(), [&](size_t begin, size_t end, int)
+        {
+            if(end > begin)
+            {
+                labelTablePoints(&cloud->points[begin].x, POINT_STRIDE, end - begin, plane, params.distanceThreshold,
+                    &labels[begin]);
+            }
+        });
+    }
+    countObjectPoints(labels, result);
+    result.timings.labeling = lapSeconds(stageWatch);
+
+    // get the elapsed time
+    result.seconds = watch.getTimeSeconds();
+    return true;
+}
+
+/***********************************************************************************************************************
+* @brief Detects the table, boxes and spheres of a mapped file and labels its points, without converting the file
+*
+* The voxel index is built from the mapped columns and the table points are selected on them, streaming the file chunk
+* by chunk, so the points are never held in a PCL cloud and files larger than memory can be processed. The labels are
+* the ones processCloud gives for the converted cloud. Only downsampled runs are supported, as the segmentation works on
+* the voxel centroids.
+*
+* @param[in] cloud mapped point cloud file
+* @param[in] params pipeline parameters, with a voxel size above 0
+* @param[in,out] cache optional cache of the input file
+* @param[in] verbose prints the objects found if true
+* @param[out] result objects found, label of every point, and processing time of each stage
+* @return false if the file could not be processed
+**********************************************************************************************************************/
+bool processMappedCloud(const MappedCloud &cloud, const PipelineParams &params, IndexCache *cache, bool verbose,
+    FrameResult &result)
+{
+    result.boxes = 0;
+    result.spherical = 0;
+    result.seconds = 0;
+    result.timings = PipelineTimings();
+    result.objects.clear();
+    StridedView<float> x, y, z;
+    if(params.voxelSize <= 0 || !cloud.positionColumns(x, y, z))
+    {
+        PCL_ERROR("a mapped cloud requires a voxel size and x, y and z fields \n");
+        return false;
+    }
+
+    // create stop watches for measuring the total time and the time of each stage
+    pcl::StopWatch watch;
+    pcl::StopWatch stageWatch;
+
+    // downsample straight from the mapped columns
+    VoxelIndex voxelIndex;
+    if(!prepareVoxelIndex(cloud, cloud.size(), params.voxelSize, cache, verbose, voxelIndex))
+    {
+        return false;
+    }
+    std::vector<float> voxelWeights;
+    voxelIndex.voxelWeights(voxelWeights);
+    result.timings.downsampling = lapSeconds(stageWatch);
+
+    std::vector<int> labels;
+    if(!detectObjects(voxelIndex.centroids(), false, cloud.size(), voxelWeights, params, NULL, cache, verbose,
+        stageWatch, result, labels))
+    {
+        return false;
+    }
+
+    // project the labels back onto every point, then select the table points at full resolution
+    std::vector<int> pointLabels;
+    voxelIndex.backProject(labels, 0, pointLabels);
+    labels.swap(pointLabels);
+    labelMappedTablePoints(cloud, result.objects[0].coefficients, params.distanceThreshold, labels);
+    countObjectPoints(labels, result);
+    result.timings.labeling = lapSeconds(stageWatch);
+
+    // get the elapsed time
+    result.seconds = watch.getTimeSeconds();
+    return true;
+}
@@ -0,0 +1,111 @@
+/***********************************************************************************************************************
+* @file tabletop_pipeline.h
+* @brief detection of the table, boxes and spheres of a point cloud, shared by the application and the benchmarks
+*
+* A cloud goes through the stages: optional voxel downsampling, table plane segmentation, removal of the table points,
+* clustering of the remaining points, classification of the clusters, and labeling of every point. Organized clouds at
+* full resolution are segmented and clustered on their image grid instead.
+**********************************************************************************************************************/
+
+#ifndef DETECT_TABLETOP_PIPELINE_H
+#define DETECT_TABLETOP_PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+#include "index_cache.h"
+#include "label_sidecar.h"
+#include "mapped_cloud.h"
+#include "ransac.h"
+
+// content of the output file: the recolored cloud, the recolored cloud compressed, or only the labels
+enum OutputMode {OUTPUT_CLOUD, OUTPUT_COMPRESSED, OUTPUT_LABELS};
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of the pipeline
+ *
+ * A voxel size of 0 segments the full cloud. When downsampling, the cluster distance and minimum cluster size are
+ * adapted to the voxel size.
+ **********************************************************************************************************************/
+struct PipelineParams
+{
+    float voxelSize;
+    float distanceThreshold;
+    int maxIterations;
+    float clusterDistance;
+    int minClusterSize;
+    int maxClusterSize;
+
+    PipelineParams();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Time spent in each stage of the pipeline, in seconds
+ *
+ * On organized clouds the plane stage covers the whole grid segmentation, including the normal estimation and the
+ * connected components, and the extraction and clustering stages are empty.
+ **********************************************************************************************************************/
+struct PipelineTimings
+{
+    double downsampling;
+    double plane;
+    double extraction;
+    double clustering;
+    double classification;
+    double labeling;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Plane found in the previous frame of a sequence, used to warm start the segmentation of the next one
+ *
+ * The inlier ratio is the one of the last frame, the reference ratio the one of the last full search. Warm started
+ * frames are compared against the reference, so the ratio cannot drift down a little on every frame.
+ **********************************************************************************************************************/
+struct PlaneTracker
+{
+    std::vector<float> coefficients;
+    double inlierRatio;
+    double referenceRatio;
+    bool valid;
+    bool warmStarted;
+
+    PlaneTracker(): inlierRatio(0), referenceRatio(0), valid(false), warmStarted(false)
+    {
+    }
+};
+
+/*******************************************************************************************************************//**
+ * @brief Objects found in a cloud
+ *
+ * The table is the first object. Each point is labeled 0 if it belongs to no object, or with its object index plus one.
+ **********************************************************************************************************************/
+struct FrameResult
+{
+    int boxes;
+    int spherical;
+    double seconds;
+    PipelineTimings timings;
+    std::vector<int> labels;
+    std::vector<LabeledObject> objects;
+};
+
+bool openCloud(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudOut, std::string fileName);
+bool saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn, std::string fileName, bool binaryMode=true,
+    bool compressed=false);
+void segmentPlane(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloudIn,
+    std::vector<pcl::ModelCoefficients::Ptr> &allPlanes, std::vector<pcl::PointIndices::Ptr> &allindices,
+    double distanceThreshold, int maxIterations, TypeModel type_model, const std::vector<float> *weights = NULL,
+    PlaneTracker *tracker = NULL);
+void colorLabels(pcl::PointCloud<pcl::PointXYZRGBA> &cloud, const std::vector<int> &labels,
+    const std::vector<LabeledObject> &objects);
+bool saveOutput(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const std::string &inputFileName,
+    const FrameResult &result, const std::string &outputFileName, OutputMode outputMode);
+bool processCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const PipelineParams &params,
+    PlaneTracker *tracker, IndexCache *cache, bool verbose, FrameResult &result);
+bool processMappedCloud(const MappedCloud &cloud, const PipelineParams &params, IndexCache *cache, bool verbose,
+    FrameResult &result);
+
+#endif
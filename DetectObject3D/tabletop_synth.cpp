@@ -0,0 +1,100 @@
+/***********************************************************************************************************************
+* @file tabletop_synth.cpp
+* @brief writes a synthetic tabletop scene as a binary PCD file, with its ground truth as a label file
+*
+* The ground truth is written next to the cloud, with the extension replaced by ".truth.labels", in the format of the
+* label output of pcl_headless, so the two can be compared point by point.
+**********************************************************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include "file_hash.h"
+#include "label_sidecar.h"
+#include "scene_generator.h"
+#include "tabletop_pipeline.h"
+
+/*******************************************************************************************************************//**
+ * @brief program entry point
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @return return code (0 for normal termination)
+ **********************************************************************************************************************/
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        std::printf("USAGE: %s <output_file> [--points <count>] [--boxes <count>] [--spheres <count>] "
+            "[--noise <meters>] [--outliers <ratio>] [--seed <seed>] [--organized] \n", argv[0]);
+        return 0;
+    }
+    std::string outputFilePath(argv[1]);
+    SceneParams params;
+    for(int i = 2; i < argc; i++)
+    {
+        std::string option(argv[i]);
+        if(option == "--organized")
+        {
+            params.organized = true;
+        }
+        else if(i + 1 >= argc)
+        {
+            std::printf("missing value for option: %s \n", argv[i]);
+            return 1;
+        }
+        else if(option == "--points")
+        {
+            params.numPoints = static_cast<size_t>(std::atoll(argv[++i]));
+        }
+        else if(option == "--boxes")
+        {
+            params.numBoxes = std::atoi(argv[++i]);
+        }
+        else if(option == "--spheres")
+        {
+            params.numSpheres = std::atoi(argv[++i]);
+        }
+        else if(option == "--noise")
+        {
+            params.noise = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--outliers")
+        {
+            params.outlierRatio = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if(option == "--seed")
+        {
+            params.seed = static_cast<unsigned int>(std::strtoul(argv[++i], NULL, 10));
+        }
+        else
+        {
+            std::printf("unknown option: %s \n", argv[i]);
+            return 1;
+        }
+    }
+
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    LabelSidecar truth;
+    if(!generateScene(params, *cloud, truth))
+    {
+        std::printf("the objects do not fit on the table, or the scene has no points \n");
+        return 1;
+    }
+    if(!saveCloud(cloud, outputFilePath))
+    {
+        return 1;
+    }
+
+    // tie the ground truth to the file just written
+    std::string truthFilePath = outputFilePath.substr(0, outputFilePath.find_last_of(".")) + ".truth.labels";
+    if(!hashFile(outputFilePath, truth.inputHash, truth.inputSize) || !writeLabelSidecar(truthFilePath, truth))
+    {
+        std::printf("error while attempting to save the ground truth: %s \n", truthFilePath.c_str());
+        return 1;
+    }
+    std::printf("%zu points, %d boxes, %d spheres written to %s, ground truth in %s \n", cloud->points.size(),
+        params.numBoxes, params.numSpheres, outputFilePath.c_str(), truthFilePath.c_str());
+    return 0;
+}
@@ -0,0 +1,442 @@
+/***********************************************************************************************************************
+* @file voxel_index.cpp
+* @brief voxel grid downsampling that keeps the mapping between voxels and the original points
+**********************************************************************************************************************/
+
+#include "voxel_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+/*******************************************************************************************************************//**
+ * @brief Creates an empty index
+ **********************************************************************************************************************/
+VoxelIndex::VoxelIndex():
+    _leafSize(0), _centroids(new pcl::PointCloud<pcl::PointXYZRGBA>)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Points of a PCL cloud, read as a single chunk
+ **********************************************************************************************************************/
+struct CloudPoints
+{
+    const pcl::PointCloud<pcl::PointXYZRGBA> &cloud;
+
+    size_t size() const
+    {
+        return cloud.points.size();
+    }
+
+    template<typename Function>
+    void forEachChunk(Function function) const
+    {
+        function(static_cast<size_t>(0), size());
+    }
+
+    void position(size_t i, float coordinates[3]) const
+    {
+        const pcl::PointXYZRGBA &point = cloud.points[i];
+        coordinates[0] = point.x;
+        coordinates[1] = point.y;
+        coordinates[2] = point.z;
+    }
+
+    uint32_t rgba(size_t i) const
+    {
+        return cloud.points[i].rgba;
+    }
+};
+
+/*******************************************************************************************************************//**
+ * @brief Points of a mapped file, read from its columns one chunk at a time
+ **********************************************************************************************************************/
+struct MappedPoints
+{
+    const MappedCloud &cloud;
+    StridedView<float> x;
+    StridedView<float> y;
+    StridedView<float> z;
+    ColorColumns colors;
+
+    explicit MappedPoints(const MappedCloud &mappedCloud): cloud(mappedCloud)
+    {
+    }
+
+    size_t size() const
+    {
+        return cloud.size();
+    }
+
+    template<typename Function>
+    void forEachChunk(Function function) const
+    {
+        cloud.forEachChunk(MAPPED_CHUNK_POINTS, function);
+    }
+
+    void position(size_t i, float coordinates[3]) const
+    {
+        coordinates[0] = x[i];
+        coordinates[1] = y[i];
+        coordinates[2] = z[i];
+    }
+
+    uint32_t rgba(size_t i) const
+    {
+        return colors.rgba(i);
+    }
+};
+
+/*******************************************************************************************************************//**
+ * @brief Assigns every point to a voxel and computes the voxel centroids
+ *
+ * Points are sorted by their packed voxel coordinates, so the voxels of the downsampled cloud are ordered and each
+ * voxel owns a contiguous range of point indices. The points are read in three sequential passes, for the bounds, the
+ * voxel keys and the centroids, so a mapped file only needs one chunk resident at a time. The centroids are summed in
+ * point order, which is also the order of the points within each voxel.
+ *
+ * @param[in] points input points
+ * @param[in] leafSize edge length of the voxels
+ * @return false if the leaf size is too small for the extent of the points
+ **********************************************************************************************************************/
+template<typename Points>
+bool VoxelIndex::buildFrom(const Points &points, float leafSize)
+{
+    _leafSize = leafSize;
+    _centroids.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    _pointVoxel.assign(points.size(), -1);
+    _voxelStart.clear();
+    _voxelPoints.clear();
+    if(leafSize <= 0)
+    {
+        return false;
+    }
+
+    // compute the bounds of the finite points
+    float minBound[3] = {INFINITY, INFINITY, INFINITY};
+    float maxBound[3] = {-INFINITY, -INFINITY, -INFINITY};
+    points.forEachChunk([&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            float coordinates[3];
+            points.position(i, coordinates);
+            if(!std::isfinite(coordinates[0]) || !std::isfinite(coordinates[1]) || !std::isfinite(coordinates[2]))
+            {
+                continue;
+            }
+            for(int k = 0; k < 3; k++)
+            {
+                minBound[k] = std::min(minBound[k], coordinates[k]);
+                maxBound[k] = std::max(maxBound[k], coordinates[k]);
+            }
+        }
+    });
+
+    // each voxel coordinate is packed into 21 bits of the key
+    const float inverseLeaf = 1.0f / leafSize;
+    for(int k = 0; k < 3; k++)
+    {
+        if(maxBound[k] >= minBound[k] && (maxBound[k] - minBound[k]) * inverseLeaf >= float(1 << 21))
+        {
+            return false;
+        }
+    }
+
+    // sort the finite points by voxel key
+    std::vector<std::pair<uint64_t, int> > keys;
+    keys.reserve(points.size());
+    points.forEachChunk([&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            float coordinates[3];
+            points.position(i, coordinates);
+            if(!std::isfinite(coordinates[0]) || !std::isfinite(coordinates[1]) || !std::isfinite(coordinates[2]))
+            {
+                continue;
+            }
+            uint64_t ix = static_cast<uint64_t>((coordinates[0] - minBound[0]) * inverseLeaf);
+            uint64_t iy = static_cast<uint64_t>((coordinates[1] - minBound[1]) * inverseLeaf);
+            uint64_t iz = static_cast<uint64_t>((coordinates[2] - minBound[2]) * inverseLeaf);
+            keys.push_back(std::make_pair((ix << 42) | (iy << 21) | iz, static_cast<int>(i)));
+        }
+    });
+    std::sort(keys.begin(), keys.end());
+
+    // build the voxel to point map
+    _voxelPoints.resize(keys.size());
+    for(size_t begin = 0; begin < keys.size();)
+    {
+        size_t end = begin;
+        int voxel = static_cast<int>(_voxelStart.size());
+        _voxelStart.push_back(static_cast<int>(begin));
+        while(end < keys.size() && keys[end].first == keys[begin].first)
+        {
+            _voxelPoints[end] = keys[end].second;
+            _pointVoxel[keys[end].second] = voxel;
+            end++;
+        }
+        begin = end;
+    }
+    _voxelStart.push_back(static_cast<int>(keys.size()));
+    std::vector<std::pair<uint64_t, int> >().swap(keys);
+
+    // average the points of each voxel
+    const size_t voxels = _voxelStart.size() - 1;
+    std::vector<double> sums(3 * voxels, 0.0);
+    std::vector<unsigned int> colors(3 * voxels, 0);
+    points.forEachChunk([&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            const int voxel = _pointVoxel[i];
+            if(voxel < 0)
+            {
+                continue;
+            }
+            float coordinates[3];
+            points.position(i, coordinates);
+            const uint32_t rgba = points.rgba(i);
+            for(int k = 0; k < 3; k++)
+            {
+                sums[3 * voxel + k] += coordinates[k];
+            }
+            colors[3 * voxel] += (rgba >> 16) & 0xff;
+            colors[3 * voxel + 1] += (rgba >> 8) & 0xff;
+            colors[3 * voxel + 2] += rgba & 0xff;
+        }
+    });
+    _centroids->points.resize(voxels);
+    for(size_t v = 0; v < voxels; v++)
+    {
+        const unsigned int count = static_cast<unsigned int>(_voxelStart[v + 1] - _voxelStart[v]);
+        pcl::PointXYZRGBA &centroid = _centroids->points[v];
+        centroid.x = static_cast<float>(sums[3 * v] / count);
+        centroid.y = static_cast<float>(sums[3 * v + 1] / count);
+        centroid.z = static_cast<float>(sums[3 * v + 2] / count);
+        centroid.r = static_cast<uint8_t>(colors[3 * v] / count);
+        centroid.g = static_cast<uint8_t>(colors[3 * v + 1] / count);
+        centroid.b = static_cast<uint8_t>(colors[3 * v + 2] / count);
+        centroid.a = 255;
+    }
+
+    _centroids->width = static_cast<uint32_t>(_centroids->points.size());
+    _centroids->height = 1;
+    _centroids->is_dense = true;
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Assigns every point of a cloud to a voxel and computes the voxel centroids
+ * @param[in] cloud input point cloud
+ * @param[in] leafSize edge length of the voxels
+ * @return false if the leaf size is too small for the extent of the cloud
+ **********************************************************************************************************************/
+bool VoxelIndex::build(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, float leafSize)
+{
+    CloudPoints points = {cloud};
+    return buildFrom(points, leafSize);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Assigns every point of a mapped file to a voxel and computes the voxel centroids, without converting the file
+ *
+ * The positions and colors are read from the mapped columns, and the pages of each chunk are released once it has been
+ * read, so the file itself is never resident as a whole. The index gives the same voxels and centroids as the one built
+ * from the converted cloud.
+ *
+ * @param[in] cloud mapped point cloud file
+ * @param[in] leafSize edge length of the voxels
+ * @return false if the file has no x, y and z fields or the leaf size is too small for the extent of the cloud
+ **********************************************************************************************************************/
+bool VoxelIndex::build(const MappedCloud &cloud, float leafSize)
+{
+    MappedPoints points(cloud);
+    if(!cloud.positionColumns(points.x, points.y, points.z))
+    {
+        _leafSize = 0;
+        _centroids.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+        _pointVoxel.clear();
+        _voxelStart.clear();
+        _voxelPoints.clear();
+        return false;
+    }
+    cloud.colorColumns(points.colors);
+    return buildFrom(points, leafSize);
+}
+
+const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &VoxelIndex::centroids() const
+{
+    return _centroids;
+}
+
+size_t VoxelIndex::numVoxels() const
+{
+    return _centroids->points.size();
+}
+
+size_t VoxelIndex::numPoints() const
+{
+    return _pointVoxel.size();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the voxel containing a point of the original cloud
+ * @param[in] pointIndex index of the point in the original cloud
+ * @return the voxel index, or -1 if the point is not finite
+ **********************************************************************************************************************/
+int VoxelIndex::voxelOf(int pointIndex) const
+{
+    return _pointVoxel[pointIndex];
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the original points contained in a voxel
+ * @param[in] voxel voxel index
+ * @param[out] begin first point index
+ * @param[out] end one past the last point index
+ **********************************************************************************************************************/
+void VoxelIndex::voxelPoints(int voxel, const int *&begin, const int *&end) const
+{
+    begin = _voxelPoints.data() + _voxelStart[voxel];
+    end = _voxelPoints.data() + _voxelStart[voxel + 1];
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of original points in each voxel, for weighting the voxels in the segmentation
+ * @param[out] weights one weight per voxel
+ **********************************************************************************************************************/
+void VoxelIndex::voxelWeights(std::vector<float> &weights) const
+{
+    weights.resize(numVoxels());
+    for(size_t v = 0; v < weights.size(); v++)
+    {
+        weights[v] = static_cast<float>(_voxelStart[v + 1] - _voxelStart[v]);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Appends the index to a buffer, for caching it on disk
+ *
+ * The leaf size and array sizes are followed by the centroids, as x, y, z and rgba, and the point arrays, so loading
+ * the index back is a few bulk copies.
+ *
+ * @param[out] buffer buffer the index is appended to
+ **********************************************************************************************************************/
+void VoxelIndex::serialize(std::vector<unsigned char> &buffer) const
+{
+    const uint32_t sizes[4] = {static_cast<uint32_t>(_pointVoxel.size()), static_cast<uint32_t>(numVoxels()),
+        static_cast<uint32_t>(_voxelStart.size()), static_cast<uint32_t>(_voxelPoints.size())};
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(_leafSize) + sizeof(sizes) + 4 * sizeof(uint32_t) * sizes[1] +
+        sizeof(int) * (_pointVoxel.size() + _voxelStart.size() + _voxelPoints.size()));
+    unsigned char *out = &buffer[offset];
+    std::memcpy(out, &_leafSize, sizeof(_leafSize));
+    out += sizeof(_leafSize);
+    std::memcpy(out, sizes, sizeof(sizes));
+    out += sizeof(sizes);
+    for(size_t v = 0; v < numVoxels(); v++)
+    {
+        const pcl::PointXYZRGBA &point = _centroids->points[v];
+        const float position[3] = {point.x, point.y, point.z};
+        std::memcpy(out, position, sizeof(position));
+        std::memcpy(out + sizeof(position), &point.rgba, sizeof(uint32_t));
+        out += sizeof(position) + sizeof(uint32_t);
+    }
+    const std::vector<int> *arrays[3] = {&_pointVoxel, &_voxelStart, &_voxelPoints};
+    for(int a = 0; a < 3; a++)
+    {
+        if(!arrays[a]->empty())
+        {
+            std::memcpy(out, arrays[a]->data(), sizeof(int) * arrays[a]->size());
+            out += sizeof(int) * arrays[a]->size();
+        }
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Loads an index written by serialize
+ * @param[in] data serialized index, with no alignment requirement
+ * @param[in] size size of the data in bytes
+ * @return false if the data is truncated or inconsistent, leaving the index empty
+ *
+ * Every index stored in the data is range checked, so a corrupt file cannot make backProject or voxelPoints access
+ * memory outside the arrays.
+ **********************************************************************************************************************/
+bool VoxelIndex::deserialize(const unsigned char *data, size_t size)
+{
+    _leafSize = 0;
+    _centroids.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    _pointVoxel.clear();
+    _voxelStart.clear();
+    _voxelPoints.clear();
+
+    uint32_t sizes[4];
+    if(size < sizeof(_leafSize) + sizeof(sizes))
+    {
+        return false;
+    }
+    float leafSize;
+    std::memcpy(&leafSize, data, sizeof(leafSize));
+    std::memcpy(sizes, data + sizeof(leafSize), sizeof(sizes));
+    const uint64_t expected = sizeof(leafSize) + sizeof(sizes) + 4 * sizeof(uint32_t) * static_cast<uint64_t>(sizes[1]) +
+        sizeof(int) * (static_cast<uint64_t>(sizes[0]) + sizes[2] + sizes[3]);
+    if(expected != size || sizes[2] != sizes[1] + 1 || sizes[3] > sizes[0])
+    {
+        return false;
+    }
+    const unsigned char *in = data + sizeof(leafSize) + sizeof(sizes);
+
+    _centroids->points.resize(sizes[1]);
+    for(size_t v = 0; v < sizes[1]; v++)
+    {
+        float position[3];
+        std::memcpy(position, in, sizeof(position));
+        pcl::PointXYZRGBA &point = _centroids->points[v];
+        point.x = position[0];
+        point.y = position[1];
+        point.z = position[2];
+        std::memcpy(&point.rgba, in + sizeof(position), sizeof(uint32_t));
+        in += sizeof(position) + sizeof(uint32_t);
+    }
+    std::vector<int> *arrays[3] = {&_pointVoxel, &_voxelStart, &_voxelPoints};
+    const uint32_t arraySizes[3] = {sizes[0], sizes[2], sizes[3]};
+    for(int a = 0; a < 3; a++)
+    {
+        arrays[a]->resize(arraySizes[a]);
+        if(arraySizes[a] > 0)
+        {
+            std::memcpy(arrays[a]->data(), in, sizeof(int) * arraySizes[a]);
+            in += sizeof(int) * arraySizes[a];
+        }
+    }
+    bool valid = _voxelStart.front() == 0 && _voxelStart.back() == static_cast<int>(_voxelPoints.size());
+    for(size_t v = 0; valid && v + 1 < _voxelStart.size(); v++)
+    {
+        valid = _voxelStart[v] < _voxelStart[v + 1];
+    }
+    for(size_t i = 0; valid && i < _voxelPoints.size(); i++)
+    {
+        valid = _voxelPoints[i] >= 0 && static_cast<uint32_t>(_voxelPoints[i]) < sizes[0];
+    }
+    for(size_t i = 0; valid && i < _pointVoxel.size(); i++)
+    {
+        valid = _pointVoxel[i] >= -1 && (_pointVoxel[i] < 0 || static_cast<uint32_t>(_pointVoxel[i]) < sizes[1]);
+    }
+    if(!valid)
+    {
+        _centroids->points.clear();
+        _pointVoxel.clear();
+        _voxelStart.clear();
+        _voxelPoints.clear();
+        return false;
+    }
+    _leafSize = leafSize;
+    _centroids->width = sizes[1];
+    _centroids->height = 1;
+    _centroids->is_dense = true;
+    return true;
+}
@@ -0,0 +1,71 @@
+/***********************************************************************************************************************
+* @file voxel_index.h
+* @brief voxel grid downsampling that keeps the mapping between voxels and the original points
+*
+* Unlike pcl::VoxelGrid, the index remembers which voxel every input point fell into, so results computed on the
+* downsampled cloud can be projected back onto the full resolution cloud. The index is built either from a PCL cloud or
+* straight from the columns of a mapped file, streamed chunk by chunk.
+**********************************************************************************************************************/
+
+#ifndef DETECT_VOXEL_INDEX_H
+#define DETECT_VOXEL_INDEX_H
+
+#include <cstdint>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include "mapped_cloud.h"
+
+/*******************************************************************************************************************//**
+ * @brief Maps the points of a cloud to the cells of a regular voxel grid
+ **********************************************************************************************************************/
+class VoxelIndex
+{
+    public:
+        VoxelIndex();
+        bool build(const pcl::PointCloud<pcl::PointXYZRGBA> &cloud, float leafSize);
+        bool build(const MappedCloud &cloud, float leafSize);
+        const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &centroids() const;
+        size_t numVoxels() const;
+        size_t numPoints() const;
+        int voxelOf(int pointIndex) const;
+        void voxelPoints(int voxel, const int *&begin, const int *&end) const;
+        void voxelWeights(std::vector<float> &weights) const;
+        void serialize(std::vector<unsigned char> &buffer) const;
+        bool deserialize(const unsigned char *data, size_t size);
+
+        /***************************************************************************************************************
+         * @brief Copies a per-voxel value to every point of the voxel
+         * @param[in] voxelValues one value per voxel
+         * @param[in] emptyValue value given to the points that belong to no voxel (non-finite points)
+         * @param[out] pointValues one value per point of the original cloud
+         **************************************************************************************************************/
+        template<typename T>
+        void backProject(const std::vector<T> &voxelValues, const T &emptyValue, std::vector<T> &pointValues) const
+        {
+            pointValues.assign(_pointVoxel.size(), emptyValue);
+            for(size_t v = 0; v + 1 < _voxelStart.size(); v++)
+            {
+                for(int i = _voxelStart[v]; i < _voxelStart[v + 1]; i++)
+                {
+                    pointValues[_voxelPoints[i]] = voxelValues[v];
+                }
+            }
+        }
+
+    private:
+        template<typename Points>
+        bool buildFrom(const Points &points, float leafSize);
+
+        float _leafSize;
+        pcl::PointCloud<pcl::PointXYZRGBA>::Ptr _centroids;
+
+        // voxel of each original point (-1 if the point is not finite)
+        std::vector<int> _pointVoxel;
+
+        // points of voxel v are _voxelPoints[_voxelStart[v]] to _voxelPoints[_voxelStart[v + 1] - 1]
+        std::vector<int> _voxelStart;
+        std::vector<int> _voxelPoints;
+};
+
+#endif
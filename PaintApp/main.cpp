@@ -2,7 +2,10 @@
 // include necessary dependencies
 #include <iostream>
 #include <string>
+#include <vector>
 #include "opencv2/opencv.hpp"
+#include "opencv_task_pool.h"
+#include "task_pool.h"
 
 // configuration parameters
 #define NUM_COMNMAND_LINE_ARGUMENTS 1
@@ -100,42 +103,68 @@ void PaintProgram::cropImage()
 }
 void PaintProgram::painBucket(int pointx, int pointy)
 {
-    // get the neighbouring point from each direction.
-    int east = pointx + 1;
-    int west = pointx - 1;
-    int south = pointy + 1;
-    int north = pointy - 1;
-
-    /*  leftmost point can't be less than zero,
-        upmost value can't be less than zero,
-        righmost value can't be greater than number of column
-        bottonmost value can't be greater than number of row
-        check if the pixel value is the inital color value
-        recursively call the function 
+    // fill the region of the inital color connected to the point (4-connected) with the eyedropper color.
+    // the rows are compared and recolored in parallel, only the walk over the region is serial.
+    const uchar candidate = 1, filled = 2;
+    cv::Mat region(_imageIn.rows, _imageIn.cols, CV_8UC1);
+    TaskPool::global().parallelFor(0, _imageIn.rows, 16, [&](size_t begin, size_t end)
+    {
+        for(int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+        {
+            const cv::Vec3b *pixels = _imageIn.ptr<cv::Vec3b>(y);
+            uchar *mask = region.ptr<uchar>(y);
+            for(int x = 0; x < _imageIn.cols; x++)
+            {
+                mask[x] = pixels[x] == initalColor ? candidate : 0;
+            }
+        }
+    });
 
+    /*  scanline fill: take a point from the stack, extend it to the whole span of candidates on its row,
+        mark the span and push the start of every candidate run in the rows above and below it.
+        an explicit stack replaces the recursion, which overflowed on large regions
     */
-    if(west >= 0 && _imageIn.at<cv::Vec3b>(cv::Point(west,pointy)) == initalColor)
+    std::vector<cv::Point> stack(1, cv::Point(pointx, pointy));
+    while(!stack.empty())
     {
-        _imageIn.at<cv::Vec3b>(cv::Point(west,pointy)) = eyedropper;
-        painBucket(west,pointy);
+        cv::Point point = stack.back();
+        stack.pop_back();
+        uchar *mask = region.ptr<uchar>(point.y);
+        if(mask[point.x] != candidate)
+            continue;
+        int west = point.x, east = point.x;
+        while(west > 0 && mask[west - 1] == candidate)
+            west--;
+        while(east + 1 < region.cols && mask[east + 1] == candidate)
+            east++;
+        for(int x = west; x <= east; x++)
+            mask[x] = filled;
+        for(int y = point.y - 1; y <= point.y + 1; y += 2)
+        {
+            if(y < 0 || y >= region.rows)
+                continue;
+            const uchar *neighbour = region.ptr<uchar>(y);
+            for(int x = west; x <= east; x++)
+            {
+                if(neighbour[x] == candidate && (x == west || neighbour[x - 1] != candidate))
+                    stack.push_back(cv::Point(x, y));
+            }
+        }
     }
 
-    if (north >=0 && _imageIn.at<cv::Vec3b>(cv::Point(pointx, north)) == initalColor)
+    TaskPool::global().parallelFor(0, _imageIn.rows, 16, [&](size_t begin, size_t end)
     {
-        _imageIn.at<cv::Vec3b>(cv::Point(pointx, north)) = eyedropper;
-        painBucket(pointx,north);
-    }
-    if( east < _imageIn.cols && _imageIn.at<cv::Vec3b>(cv::Point(east,pointy)) == initalColor)
-    {
-        _imageIn.at<cv::Vec3b>(cv::Point(east,pointy)) = eyedropper;
-        painBucket(east,pointy);
-    }
-    if( south < _imageIn.rows && _imageIn.at<cv::Vec3b>(cv::Point(pointx, south)) == initalColor)
-    {
-        _imageIn.at<cv::Vec3b>(cv::Point(pointx, south)) = eyedropper;
-        painBucket(pointx,south);
-    }
-
+        for(int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+        {
+            cv::Vec3b *pixels = _imageIn.ptr<cv::Vec3b>(y);
+            const uchar *mask = region.ptr<uchar>(y);
+            for(int x = 0; x < _imageIn.cols; x++)
+            {
+                if(mask[x] == filled)
+                    pixels[x] = eyedropper;
+            }
+        }
+    });
 }
 // function to print which tool selected.
 void PaintProgram::toolsSelected()
@@ -186,7 +215,6 @@ void PaintProgram::runCommand(MouseButton flag)
             if(flag == LDown)
             {
                 initalColor = _imageIn.at<cv::Vec3b> (inital_pointy,inital_pointx);
-                _imageIn.at<cv::Vec3b> (inital_pointy,inital_pointx) = eyedropper;
                 painBucket(inital_pointx,inital_pointy);
                 cv::imshow("imageIn", _imageIn);
             }
@@ -246,14 +274,22 @@ void PaintProgram::clickCallback(int event, int x, int y, int flags, void* userd
 int main(int argc, char **argv)
 {
 
-    // validate and parse the command line arguments
-    if(argc != NUM_COMNMAND_LINE_ARGUMENTS + 1)
+    // validate and parse the command line arguments, the arguments after the image configure the threads
+    PoolConfig poolConfig;
+    bool validArguments = argc > NUM_COMNMAND_LINE_ARGUMENTS;
+    for(int i = NUM_COMNMAND_LINE_ARGUMENTS + 1; validArguments && i < argc; i++)
+        validArguments = parsePoolOption(argc, argv, i, poolConfig);
+    if(!validArguments)
     {
-        std::printf("USAGE: %s <image_path> \n", argv[0]);
+        std::printf("USAGE: %s <image_path> %s \n", argv[0], poolOptionsUsage());
         return 0;
     }
     else
     {
+        // the fill and the OpenCV filters share the same threads
+        TaskPool::configureGlobal(poolConfig);
+        useTaskPoolInOpenCV();
+
         cv::Mat imageIn, initalImageIn;
         imageIn = cv::imread(argv[1], cv::IMREAD_COLOR);
         
@@ -0,0 +1,150 @@
+/***********************************************************************************************************************
+* @file background_seed.cpp
+* @brief saves the background image of a MOG2 model and seeds a new model with it
+**********************************************************************************************************************/
+
+#include "background_seed.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+// seed file identification
+static const char SEED_MAGIC[4] = {'T', 'C', 'B', 'G'};
+static const uint32_t SEED_VERSION = 1;
+
+// fixed size header preceding the raw background image
+struct SeedHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t type;
+    int32_t history;
+    double varThreshold;
+    int32_t detectShadows;
+    int32_t reserved;
+    int64_t framesLearned;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Saves the background image of a model to a seed file
+ *
+ * The file is written to a temporary path and renamed, so a crash while saving never corrupts the last seed
+ *
+ * @param[in] model background model whose background image is saved
+ * @param[in] fileName path and name of the seed file
+ * @param[in] framesLearned number of frames the model has learned from
+ * @return false if the model is empty or an error occurred while writing the file
+ **********************************************************************************************************************/
+bool saveBackgroundSeed(const cv::Ptr<cv::BackgroundSubtractorMOG2> &model, const std::string &fileName,
+    long long framesLearned)
+{
+    // the background image is only defined once the model has seen a frame
+    if(framesLearned <= 0)
+    {
+        return false;
+    }
+    cv::Mat background;
+    model->getBackgroundImage(background);
+    if(background.empty())
+    {
+        return false;
+    }
+    if(!background.isContinuous())
+    {
+        background = background.clone();
+    }
+
+    SeedHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SEED_MAGIC, sizeof(header.magic));
+    header.version = SEED_VERSION;
+    header.width = background.cols;
+    header.height = background.rows;
+    header.type = background.type();
+    header.history = model->getHistory();
+    header.varThreshold = model->getVarThreshold();
+    header.detectShadows = model->getDetectShadows() ? 1 : 0;
+    header.framesLearned = framesLearned;
+
+    std::string tempName = fileName + ".tmp";
+    {
+        std::ofstream file(tempName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!file)
+        {
+            std::printf("Unable to write background seed %s \n", tempName.c_str());
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(background.data), background.total() * background.elemSize());
+        if(!file)
+        {
+            std::printf("Unable to write background seed %s \n", tempName.c_str());
+            return false;
+        }
+    }
+    if(std::rename(tempName.c_str(), fileName.c_str()) != 0)
+    {
+        std::printf("Unable to write background seed %s \n", fileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Seeds a background model with the background image of a seed file
+ *
+ * The seed is rejected if it was learned at a different frame size or with different model parameters. On success the
+ * model is reinitialized with a single background mode per pixel, at the stored background value and the default
+ * variance, and the caller should use the steady state learning rate (1 / history) for subsequent frames.
+ *
+ * @param[in] model background model to seed
+ * @param[in] fileName path and name of the seed file
+ * @param[in] frameSize size of the frames the model will be applied to
+ * @param[out] framesLearned number of frames the model that saved the seed had learned from
+ * @return false if the seed does not exist, is invalid or does not match the model
+ **********************************************************************************************************************/
+bool seedBackgroundModel(const cv::Ptr<cv::BackgroundSubtractorMOG2> &model, const std::string &fileName,
+    const cv::Size &frameSize, long long &framesLearned)
+{
+    std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+    if(!file)
+    {
+        return false;
+    }
+
+    // validate the header against the current model
+    SeedHeader header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if(!file || std::memcmp(header.magic, SEED_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SEED_VERSION)
+    {
+        std::printf("Ignoring invalid background seed %s \n", fileName.c_str());
+        return false;
+    }
+    if(header.width != frameSize.width || header.height != frameSize.height || header.type != CV_8UC1 ||
+        header.history != model->getHistory() || header.varThreshold != model->getVarThreshold() ||
+        (header.detectShadows != 0) != model->getDetectShadows())
+    {
+        std::printf("Ignoring background seed %s learned with different parameters \n", fileName.c_str());
+        return false;
+    }
+
+    // read the background image
+    cv::Mat background(header.height, header.width, header.type);
+    file.read(reinterpret_cast<char *>(background.data), background.total() * background.elemSize());
+    if(!file)
+    {
+        std::printf("Ignoring truncated background seed %s \n", fileName.c_str());
+        return false;
+    }
+
+    // a learning rate of 1 reinitializes the model from the given frame
+    cv::Mat seedMask;
+    model->apply(background, seedMask, 1.0);
+    framesLearned = header.framesLearned;
+    return true;
+}
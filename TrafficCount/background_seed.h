@@ -0,0 +1,24 @@
+/***********************************************************************************************************************
+* @file background_seed.h
+* @brief saves the background image of a MOG2 model and seeds a new model with it
+*
+* A seed file stores the background image of a learned model along with the model parameters it was learned with.
+* OpenCV does not expose the Gaussian mixture of MOG2, so the seed is not the model itself: seeding a fresh model gives
+* every pixel a single mode at the stored background value with the default variance. Pixels with several background
+* modes, e.g. foliage or flicker, have to relearn their other modes. For a mostly static road this still skips the
+* warmup of several hundred frames.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_BACKGROUND_SEED_H
+#define TRAFFIC_BACKGROUND_SEED_H
+
+#include <string>
+#include "opencv2/opencv.hpp"
+
+bool saveBackgroundSeed(const cv::Ptr<cv::BackgroundSubtractorMOG2> &model, const std::string &fileName,
+    long long framesLearned);
+
+bool seedBackgroundModel(const cv::Ptr<cv::BackgroundSubtractorMOG2> &model, const std::string &fileName,
+    const cv::Size &frameSize, long long &framesLearned);
+
+#endif
@@ -0,0 +1,90 @@
+/***********************************************************************************************************************
+* @file frame_pool.cpp
+* @brief pool of reusable frame buffers
+**********************************************************************************************************************/
+
+#include "frame_pool.h"
+
+/*******************************************************************************************************************//**
+ * @brief Creates a frame pool
+ * @param[in] size size of the frames
+ * @param[in] type OpenCV type of the frames
+ * @param[in] initialFrames number of frames allocated up front
+ **********************************************************************************************************************/
+FramePool::FramePool(const cv::Size &size, int type, int initialFrames):
+    _size(size), _type(type), _allocations(0)
+{
+    for(int i = 0; i < initialFrames; i++)
+    {
+        _frames.push_back(cv::Mat(_size, _type));
+        _freeSlots.push_back(i);
+    }
+    _freeSlots.reserve(initialFrames * 2);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Takes a frame out of the pool, allocating a new one if all frames are in use
+ * @return the slot of the acquired frame
+ **********************************************************************************************************************/
+int FramePool::acquire()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!_freeSlots.empty())
+    {
+        int slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        return slot;
+    }
+
+    // the deque keeps references to existing frames valid while growing
+    _frames.push_back(cv::Mat(_size, _type));
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<int>(_frames.size()) - 1;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the frame buffer of an acquired slot
+ * @param[in] slot slot returned by acquire()
+ * @return the frame buffer, valid until the slot is released
+ **********************************************************************************************************************/
+cv::Mat &FramePool::frame(int slot)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _frames[slot];
+}
+
+/*******************************************************************************************************************//**
+ * @brief Returns a frame to the pool
+ * @param[in] slot slot returned by acquire()
+ **********************************************************************************************************************/
+void FramePool::release(int slot)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _freeSlots.push_back(slot);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of frames allocated after construction
+ * @return the number of allocations
+ **********************************************************************************************************************/
+long long FramePool::allocations() const
+{
+    return _allocations.load(std::memory_order_relaxed);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Makes sure a workspace buffer has the given size and type
+ * @param[in,out] buffer workspace buffer
+ * @param[in] size required size
+ * @param[in] type required OpenCV type
+ * @return true if the buffer had to be (re)allocated
+ **********************************************************************************************************************/
+bool ensureBuffer(cv::Mat &buffer, const cv::Size &size, int type)
+{
+    if(buffer.size() == size && buffer.type() == type && !buffer.empty())
+    {
+        return false;
+    }
+    buffer.create(size, type);
+    return true;
+}
@@ -0,0 +1,41 @@
+/***********************************************************************************************************************
+* @file frame_pool.h
+* @brief pool of reusable frame buffers
+*
+* Frames are acquired from and released back to the pool instead of being allocated per iteration. The pool only
+* allocates when every buffer is in use, and counts those allocations so steady state behaviour can be verified.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_FRAME_POOL_H
+#define TRAFFIC_FRAME_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+/*******************************************************************************************************************//**
+ * @brief Thread-safe pool of equally sized frame buffers
+ **********************************************************************************************************************/
+class FramePool
+{
+    public:
+        FramePool(const cv::Size &size, int type, int initialFrames);
+        int acquire();
+        cv::Mat &frame(int slot);
+        void release(int slot);
+        long long allocations() const;
+
+    private:
+        cv::Size _size;
+        int _type;
+        std::mutex _mutex;
+        std::deque<cv::Mat> _frames;
+        std::vector<int> _freeSlots;
+        std::atomic<long long> _allocations;
+};
+
+bool ensureBuffer(cv::Mat &buffer, const cv::Size &size, int type);
+
+#endif
@@ -0,0 +1,129 @@
+/***********************************************************************************************************************
+* @file heap_counter.cpp
+* @brief counts the heap allocations made by the process while counting is enabled
+**********************************************************************************************************************/
+
+#include "heap_counter.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+// number of live counting scopes and heap allocations counted while at least one was alive
+static std::atomic<int> countingScopes(0);
+static std::atomic<long long> heapAllocations(0);
+
+static inline void countAllocation()
+{
+    if(countingScopes.load(std::memory_order_relaxed) > 0)
+    {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#ifdef __GLIBC__
+// the definitions below take precedence over the ones of glibc, and forward to its allocator
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+
+void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    if(alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+    countAllocation();
+    void *allocated = __libc_memalign(alignment, size);
+    if(allocated == NULL)
+    {
+        return ENOMEM;
+    }
+    *pointer = allocated;
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    countAllocation();
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size)
+{
+    countAllocation();
+    return __libc_pvalloc(size);
+}
+}
+#endif
+
+/*******************************************************************************************************************//**
+ * @brief Tells whether allocations can be counted, which requires glibc
+ **********************************************************************************************************************/
+bool HeapCounter::available()
+{
+#ifdef __GLIBC__
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of heap allocations counted so far, by every thread
+ **********************************************************************************************************************/
+long long HeapCounter::allocations()
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+ScopedHeapCounting::ScopedHeapCounting()
+{
+    countingScopes.fetch_add(1, std::memory_order_relaxed);
+}
+
+ScopedHeapCounting::~ScopedHeapCounting()
+{
+    countingScopes.fetch_sub(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,40 @@
+/***********************************************************************************************************************
+* @file heap_counter.h
+* @brief counts the heap allocations made by the process while counting is enabled
+*
+* On glibc the malloc family is interposed: malloc, calloc, realloc, free, memalign, aligned_alloc, posix_memalign, valloc
+* and pvalloc are defined here and forward to the allocator of glibc. The operator new of libstdc++ and cv::fastMalloc
+* allocate through these functions, so their allocations are counted too. Allocations made by a library that brings
+* its own allocator, or that calls into the kernel with mmap directly, are not seen.
+*
+* Counting is global: while at least one ScopedHeapCounting is alive, the allocations of every thread are counted.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_HEAP_COUNTER_H
+#define TRAFFIC_HEAP_COUNTER_H
+
+/*******************************************************************************************************************//**
+ * @brief Total number of heap allocations counted so far
+ **********************************************************************************************************************/
+class HeapCounter
+{
+    public:
+        static bool available();
+        static long long allocations();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Enables the counting of heap allocations for its lifetime
+ **********************************************************************************************************************/
+class ScopedHeapCounting
+{
+    public:
+        ScopedHeapCounting();
+        ~ScopedHeapCounting();
+
+    private:
+        ScopedHeapCounting(const ScopedHeapCounting &);
+        ScopedHeapCounting &operator=(const ScopedHeapCounting &);
+};
+
+#endif
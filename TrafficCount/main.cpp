@@ -3,9 +3,18 @@
 // include necessary dependencies
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
+#include <sstream>
 #include "opencv2/opencv.hpp"
 #include <opencv2/tracking.hpp>
 #include <opencv2/core/ocl.hpp>
+#include "stage_metrics.h"
+#include "background_seed.h"
+#include "traffic_counter.h"
+#include "frame_pool.h"
+#include "video_sink.h"
+#include "opencv_task_pool.h"
+#include "task_pool.h"
 
 // configuration parameters
 #define NUM_COMNMAND_LINE_ARGUMENTS 1
@@ -22,16 +31,110 @@ int main(int argc, char **argv)
     // store video capture parameters
     std::string fileName;
 
+    // store metrics export parameters
+    std::string metricsPath;
+    MetricsFormat metricsFormat = METRICS_PROMETHEUS;
+    double metricsInterval = 10.0;
+
+    // store background seed parameters
+    std::string seedPath;
+    int seedInterval = 1000;
+
+    // store output parameters
+    std::string outputPath;
+    int outputQueue = 16;
+    bool outputDrop = false;
+    double logInterval = 1.0;
+
+    // store pipeline parameters
+    CounterConfig counterConfig;
+
+    // store thread pool parameters
+    PoolConfig poolConfig;
+
     // validate and parse the command line arguments
-    if(argc != NUM_COMNMAND_LINE_ARGUMENTS + 1)
+    if(argc < NUM_COMNMAND_LINE_ARGUMENTS + 1)
     {
-        std::printf("USAGE: %s <file_path> \n", argv[0]);
+        std::printf("USAGE: %s <file_path> [--metrics <metrics_path>] [--metrics-format prometheus|json] "
+            "[--metrics-interval <seconds>] [--background-seed <seed_path>] [--background-seed-interval <frames>] "
+            "[--motion-gate] [--output <video_path>] [--output-queue <frames>] [--output-drop] "
+            "[--log-interval <seconds>] [--geometry <truth_path>] %s \n", argv[0], poolOptionsUsage());
         return 0;
     }
     else
     {
         fileName = argv[1];
     }
+    for(int i = NUM_COMNMAND_LINE_ARGUMENTS + 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if(parsePoolOption(argc, argv, i, poolConfig))
+        {
+            continue;
+        }
+        if(option == "--metrics" && i + 1 < argc)
+        {
+            metricsPath = argv[++i];
+        }
+        else if(option == "--metrics-format" && i + 1 < argc)
+        {
+            if(!MetricsExporter::parseFormat(argv[++i], metricsFormat))
+            {
+                std::printf("Unknown metrics format %s, terminating program! \n", argv[i]);
+                return 0;
+            }
+        }
+        else if(option == "--metrics-interval" && i + 1 < argc)
+        {
+            metricsInterval = std::atof(argv[++i]);
+        }
+        else if(option == "--background-seed" && i + 1 < argc)
+        {
+            seedPath = argv[++i];
+        }
+        else if(option == "--background-seed-interval" && i + 1 < argc)
+        {
+            seedInterval = std::atoi(argv[++i]);
+        }
+        else if(option == "--motion-gate")
+        {
+            counterConfig.motionGate = true;
+        }
+        else if(option == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if(option == "--output-queue" && i + 1 < argc)
+        {
+            outputQueue = std::atoi(argv[++i]);
+        }
+        else if(option == "--output-drop")
+        {
+            outputDrop = true;
+        }
+        else if(option == "--log-interval" && i + 1 < argc)
+        {
+            logInterval = std::atof(argv[++i]);
+        }
+        else if(option == "--geometry" && i + 1 < argc)
+        {
+            // counting lines of a synthetic clip, scaled to its resolution
+            if(!readCounterGeometry(argv[++i], counterConfig))
+            {
+                std::printf("Unable to read the counting geometry from %s, terminating program! \n", argv[i]);
+                return 0;
+            }
+        }
+        else
+        {
+            std::printf("Unknown option %s, terminating program! \n", option.c_str());
+            return 0;
+        }
+    }
+
+    // run the OpenCV filters and the background subtraction on the shared pool
+    TaskPool::configureGlobal(poolConfig);
+    useTaskPoolInOpenCV();
 
     // open the video file
     cv::VideoCapture capture(fileName);
@@ -51,25 +154,46 @@ int main(int argc, char **argv)
     cv::namedWindow("captureFrame", cv::WINDOW_AUTOSIZE);
     
 
-    // set background filtering parameters
-    const int bgHistory = 400;
-    const float bgThreshold = 100;
-    const bool bgShadowDetection = false;
-    cv::Mat fgMask; //fg mask generated by MOG2 method
-    cv::Ptr<cv::BackgroundSubtractor> pMOG2; //MOG2 Background subtractor
-    pMOG2 = cv::createBackgroundSubtractorMOG2(bgHistory, bgThreshold, bgShadowDetection);
-    //pMOG2 = cv::createBackgroundSubtractorMOG2();
+    // per-stage latency instrumentation
+    StageMetrics metrics;
+    MetricsExporter metricsExporter(metrics, metricsPath, metricsFormat, metricsInterval, fileName);
+
+    // create the counting pipeline
+    TrafficCounter counter(counterConfig, metrics);
+
+    // seed the background model with the background image of a previous run if one is available
+    long long framesLearned = 0;
+    if(!seedPath.empty() && seedBackgroundModel(counter.backgroundModel(), seedPath,
+        cv::Size(captureWidth, captureHeight), framesLearned))
+    {
+        // continue with the steady state learning rate of the model that saved the seed
+        counter.setLearningRate(1.0 / counterConfig.bgHistory);
+        std::cout << "Background model seeded from " << seedPath << " (" << framesLearned << " frames)" << std::endl;
+    }
+
+    // capture frames are recycled through a pool instead of being allocated every iteration
+    const int pooledFrames = 2;
+    const int queuedFrames = outputPath.empty() ? 0 : outputQueue;
+    FramePool framePool(cv::Size(captureWidth, captureHeight), CV_8UC3, pooledFrames + queuedFrames);
+
+    // annotated frames are encoded on a separate thread, which takes over their pool slots
+    AsyncVideoWriter *videoWriter = NULL;
+    if(!outputPath.empty())
+    {
+        videoWriter = new AsyncVideoWriter(framePool, outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
+            captureFPS > 0 ? captureFPS : 30, cv::Size(captureWidth, captureHeight), outputQueue, outputDrop);
+        if(!videoWriter->isOpened())
+        {
+            std::printf("Unable to open output video %s, terminating program! \n", outputPath.c_str());
+            delete videoWriter;
+            return 0;
+        }
+    }
+    RateLimitedLogger countLogger(std::cout, logInterval);
 
-    // pMOG2->setDetectShadows(false);
     // process data until program termination
     bool doCapture = true;
     int frameCount = 0;
-    cv::Mat lastFrame;
-    int xCordinate = 1060;
-    int yCordinate = 450;
-    int leftBoundVehicle = 0;
-    int rightBoundVehicle = 0;
-    int deltaX = 100;
     
     while(doCapture)
     {
@@ -77,145 +201,49 @@ int main(int argc, char **argv)
         double startTicks = static_cast<double>(cv::getTickCount());
 
         // attempt to acquire and process an image frame
-        cv::Mat captureFrame;
-        cv::Mat grayFrame;
-        std::vector<std::vector<cv::Point> > contours;
-
-        //cv::Mat processedFrame;
-        bool captureSuccess = capture.read(captureFrame);
-        //cv::line(captureFrame, cv::Point(0,350), cv::Point(1920, 350), cv::Scalar(0, 0, 255), 3, cv::LINE_AA);
-        
-        // upper
-        // cv::line(captureFrame,cv::Point(xCordinate,0),cv::Point(xCordinate,350),cv::Scalar(0, 0, 255), 3, cv::LINE_AA);
-        // // buttom 
-        // cv::line(captureFrame,cv::Point(xCordinate + deltaX,450),cv::Point(xCordinate+deltaX,1980),cv::Scalar(0, 0, 255), 3, cv::LINE_AA);
+        int frameSlot = framePool.acquire();
+        cv::Mat &captureFrame = framePool.frame(frameSlot);
+        bool captureSuccess;
+        {
+            ScopedStageTimer timer(metrics, STAGE_DECODE);
+            captureSuccess = capture.read(captureFrame);
+        }
         if(captureSuccess)
         {
-            // pre-process the raw image frame
-            const int rangeMin = 0;
-            const int rangeMax = 255;
-            cv::cvtColor(captureFrame, grayFrame, cv::COLOR_BGR2GRAY);
-            cv::normalize(grayFrame, grayFrame, rangeMin, rangeMax, cv::NORM_MINMAX, CV_8UC1);
-
-            // cv::Canny(grayFrame,grayFrame,25,200,3);
-            
-            pMOG2->apply(grayFrame, fgMask);
-            // extract the foreground mask from image
-            double thresh = 30;
-            double maxval = 255;
-            int thresholdType = 0;
-            cv::threshold(fgMask,fgMask, thresh, maxval, thresholdType);
-
-            cv::imshow("fgMask",fgMask);
-            
+            counter.process(captureFrame);
+
             // increment the frame counter
             frameCount++;
+            framesLearned++;
+
+            // periodically save the background image as the seed of the next run
+            if(!seedPath.empty() && seedInterval > 0 && frameCount % seedInterval == 0)
+            {
+                saveBackgroundSeed(counter.backgroundModel(), seedPath, framesLearned);
+            }
         }
         else
         {
             std::printf("Unable to acquire image frame! \n");
+            framePool.release(frameSlot);
             break;
         }
 
         // update the GUI window if necessary
         if(captureSuccess)
         {
-
-            int morphologySize = 1;
-            int morph_size = 2;
-  
-        // Create structuring element
-            // cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT,cv::Size(2 * morph_size + 1,2 * morph_size + 1),cv::Point(morph_size, morph_size));
-            // cv::morphologyEx(fgMask,fgMask,cv::MORPH_CLOSE,element,cv::Point(-1, -1), 3);
-            // cv::morphologyEx(fgMask,fgMask,cv::MORPH_OPEN,element,cv::Point(-1,-1),1);
-
-            for(int i=0;i<2;i++)
-            {
-                cv::dilate(fgMask, fgMask, cv::Mat(), cv::Point(-1, -1), morphologySize);
-                cv::dilate(fgMask, fgMask, cv::Mat(), cv::Point(-1, -1), morphologySize);
-                cv::erode(fgMask, fgMask, cv::Mat(), cv::Point(-1, -1), morphologySize);
-            }
-            
-
-
-
-            
-            cv::findContours(fgMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, cv::Point(0, 0));
-            cv::Mat imageContours = cv::Mat::zeros(grayFrame.size(), CV_8UC3);
-            cv::RNG rand(12345);
-            double contourAreaLimit= 10000;
-            for(int i = 0; i < contours.size(); i++)
-            {
-                cv::Scalar color = cv::Scalar(rand.uniform(0, 256), rand.uniform(0,256), rand.uniform(0,256));
-                if(cv::contourArea(contours[i])>contourAreaLimit){
-                    cv::drawContours(imageContours, contours, i, color);
-
-                }
-            }
-           
-
-            
-            // compute minimum area bounding rectangles
-            std::vector<cv::RotatedRect> minAreaRectangles;
-            for(int i = 0; i < contours.size(); i++)
+            ScopedStageTimer displayTimer(metrics, STAGE_DISPLAY);
+            counter.drawVehicles(captureFrame);
+            counter.drawCounts(captureFrame);
+            cv::imshow("fgMask", counter.foregroundMask());
+            cv::imshow("captureFrame", captureFrame);
+            if(countLogger.due())
             {
-                // compute a minimum area bounding rectangle for the contour
-                if(cv::contourArea(contours[i])>contourAreaLimit){
-                    minAreaRectangles.push_back(cv::minAreaRect(contours[i]));
-                    // std::cout<<contourArea(contours[i])<<std::endl;
-                }
+                std::ostringstream message;
+                message << "Frame " << frameCount << " WestBound: " << counter.westBound() << " EastBound: "
+                    << counter.eastBound();
+                countLogger.log(message.str());
             }
-
-            // draw the rectangles
-            cv::Mat imageRectangles = cv::Mat::zeros(grayFrame.size(), CV_8UC3);
-            for(int i = 0; i < minAreaRectangles.size(); i++)
-            {
-                cv::Scalar color;
-                cv::Rect drawRect = minAreaRectangles[i].boundingRect();
-                //drawRect.points(rectanglePoints);
-                
-                
-                
-                // std::cout<<midpoint<<std::endl;
-
-                cv::Point topLeftCorner = cv::Point(drawRect.x,drawRect.y);
-                cv::Point buttomLeftCorner = cv::Point(drawRect.x + drawRect.width, drawRect.y + drawRect.height);
-                cv::Point midpoint = (topLeftCorner+buttomLeftCorner)/2;
-
-                // cv::line(captureFrame,topLeftCorner,buttomLeftCorner,cv::Scalar(0, 0, 255), 3, cv::LINE_AA);
-                if(midpoint.x > xCordinate && midpoint.x < xCordinate + 32)
-                {
-                    if(midpoint.y < yCordinate){
-                        leftBoundVehicle++;
-                    }
-                    
-                }
-                if(midpoint.x > xCordinate+deltaX && midpoint.x < xCordinate + deltaX+ 32){
-                    if(midpoint.y > yCordinate){
-                        rightBoundVehicle++;
-                    }
-                }
-                if(midpoint.y>350)
-                {
-                    color = cv::Scalar(0,0,255);
-                }
-                else
-                {
-                    color = cv::Scalar(0,255,0);
-                }
-                // std::cout<<midpoint<<std::endl;
-                cv::rectangle(captureFrame,drawRect,color);
-                
-            }
-            //cv::imshow("imageRectangles",imageRectangles);
-
-            
-
-            cv::imshow("captureFrame", captureFrame);
-            // cv::imshow("fgMask", fgMask);
-            // cv::imshow("imageContours",imageContours);
-            std::cout<<"WestBound: "<<leftBoundVehicle << std::endl;
-            std::cout<<"EastBound: "<< rightBoundVehicle << std::endl;
             // // get the number of milliseconds per frame
             int delayMs = (1.0 / captureFPS) * 1000;
 
@@ -226,11 +254,39 @@ int main(int argc, char **argv)
                 
             }
         }
+        if(videoWriter != NULL)
+        {
+            videoWriter->submit(frameSlot);
+        }
+        else
+        {
+            framePool.release(frameSlot);
+        }
 
         // compute the frame processing time
         double endTicks = static_cast<double>(cv::getTickCount());
         double elapsedTime = (endTicks - startTicks) / cv::getTickFrequency();
         // std::cout << "Frame processing time: " << elapsedTime << std::endl;
+        metrics.record(STAGE_FRAME, static_cast<uint64_t>(elapsedTime * 1e9));
+        metricsExporter.maybeExport();
+    }
+
+    // report the final counts and finish the output video
+    std::cout << "WestBound: " << counter.westBound() << std::endl;
+    std::cout << "EastBound: " << counter.eastBound() << std::endl;
+    if(videoWriter != NULL)
+    {
+        videoWriter->close();
+        std::cout << "Output video: " << videoWriter->writtenFrames() << " frames written, "
+            << videoWriter->droppedFrames() << " dropped, " << videoWriter->stallSeconds() << " seconds stalled" << std::endl;
+        delete videoWriter;
+    }
+
+    // write the final metrics and background seed
+    metricsExporter.exportNow();
+    if(!seedPath.empty())
+    {
+        saveBackgroundSeed(counter.backgroundModel(), seedPath, framesLearned);
     }
 
     // release program resources before returning
@@ -0,0 +1,346 @@
+/***********************************************************************************************************************
+* @file stage_metrics.cpp
+* @brief low overhead per-stage latency histograms for the traffic counting loop
+**********************************************************************************************************************/
+
+#include "stage_metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+/*******************************************************************************************************************//**
+ * @brief Creates an empty histogram
+ **********************************************************************************************************************/
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Records a single sample
+ * @param[in] valueNs sample value in nanoseconds
+ **********************************************************************************************************************/
+void LatencyHistogram::record(uint64_t valueNs)
+{
+    _buckets[bucketIndex(valueNs)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sumNs.fetch_add(valueNs, std::memory_order_relaxed);
+
+    // update the maximum value
+    uint64_t currentMax = _maxNs.load(std::memory_order_relaxed);
+    while(valueNs > currentMax && !_maxNs.compare_exchange_weak(currentMax, valueNs, std::memory_order_relaxed))
+    {
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Discards all recorded samples
+ **********************************************************************************************************************/
+void LatencyHistogram::reset()
+{
+    for(int i = 0; i < NUM_BUCKETS; i++)
+    {
+        _buckets[i].store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _sumNs.store(0, std::memory_order_relaxed);
+    _maxNs.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return _count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::sumNs() const
+{
+    return _sumNs.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::maxNs() const
+{
+    return _maxNs.load(std::memory_order_relaxed);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Estimates a percentile of the recorded samples
+ * @param[in] percentile requested percentile in the range [0, 100]
+ * @return the estimated value in nanoseconds, or 0 if no samples were recorded
+ **********************************************************************************************************************/
+uint64_t LatencyHistogram::percentileNs(double percentile) const
+{
+    // take a snapshot of the bucket counts, since writers may be active
+    uint64_t snapshot[NUM_BUCKETS];
+    uint64_t total = 0;
+    for(int i = 0; i < NUM_BUCKETS; i++)
+    {
+        snapshot[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    // find the bucket containing the requested rank
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+    if(rank < 1)
+    {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < NUM_BUCKETS; i++)
+    {
+        seen += snapshot[i];
+        if(seen >= rank)
+        {
+            uint64_t value = bucketMidpoint(i);
+            uint64_t maxValue = maxNs();
+            return value < maxValue ? value : maxValue;
+        }
+    }
+    return maxNs();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Maps a value to its bucket
+ * @param[in] value sample value
+ * @return the bucket index
+ **********************************************************************************************************************/
+int LatencyHistogram::bucketIndex(uint64_t value)
+{
+    if(value < (1u << SUB_BUCKET_BITS))
+    {
+        return static_cast<int>(value);
+    }
+
+    // position of the most significant bit, followed by the next mantissa bits
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - SUB_BUCKET_BITS + 1;
+    int mantissa = static_cast<int>(value >> shift);
+    return (exponent - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF + (mantissa - SUB_BUCKET_HALF);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Computes the representative value of a bucket
+ * @param[in] index bucket index
+ * @return the midpoint of the value range covered by the bucket
+ **********************************************************************************************************************/
+uint64_t LatencyHistogram::bucketMidpoint(int index)
+{
+    if(index < (1 << SUB_BUCKET_BITS))
+    {
+        return static_cast<uint64_t>(index);
+    }
+    int exponent = index / SUB_BUCKET_HALF + SUB_BUCKET_BITS - 2;
+    int shift = exponent - SUB_BUCKET_BITS + 1;
+    uint64_t mantissa = static_cast<uint64_t>(index % SUB_BUCKET_HALF + SUB_BUCKET_HALF);
+    uint64_t lower = mantissa << shift;
+    uint64_t width = uint64_t(1) << shift;
+    return lower + width / 2;
+}
+
+void StageMetrics::record(Stage stage, uint64_t valueNs)
+{
+    _histograms[stage].record(valueNs);
+}
+
+const LatencyHistogram &StageMetrics::histogram(Stage stage) const
+{
+    return _histograms[stage];
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the name used for a stage in the exported metrics
+ * @param[in] stage processing stage
+ * @return the stage name
+ **********************************************************************************************************************/
+const char *StageMetrics::stageName(Stage stage)
+{
+    switch(stage)
+    {
+        case STAGE_DECODE:
+            return "decode";
+        case STAGE_GATE:
+            return "gate";
+        case STAGE_PREPROCESS:
+            return "preprocess";
+        case STAGE_MOG2:
+            return "mog2";
+        case STAGE_MORPHOLOGY:
+            return "morphology";
+        case STAGE_CONTOURS:
+            return "contours";
+        case STAGE_COUNTING:
+            return "counting";
+        case STAGE_DISPLAY:
+            return "display";
+        case STAGE_FRAME:
+            return "frame";
+        default:
+            return "unknown";
+    }
+}
+
+ScopedStageTimer::ScopedStageTimer(StageMetrics &metrics, Stage stage):
+    _metrics(metrics), _stage(stage), _start(std::chrono::steady_clock::now())
+{
+}
+
+ScopedStageTimer::~ScopedStageTimer()
+{
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - _start;
+    _metrics.record(_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+/*******************************************************************************************************************//**
+ * @brief Creates a metrics exporter
+ * @param[in] metrics stage metrics to export
+ * @param[in] filePath path of the output file (exporting is disabled if empty)
+ * @param[in] format output file format
+ * @param[in] intervalSeconds minimum time between two exports
+ * @param[in] camera name of the video source, added as a label to every metric
+ **********************************************************************************************************************/
+MetricsExporter::MetricsExporter(const StageMetrics &metrics, const std::string &filePath, MetricsFormat format,
+    double intervalSeconds, const std::string &camera):
+    _metrics(metrics), _filePath(filePath), _format(format),
+    _interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(intervalSeconds))),
+    _lastExport(std::chrono::steady_clock::now()), _camera(camera)
+{
+    // escape the camera name so it can be embedded in quoted strings
+    std::string escaped;
+    for(size_t i = 0; i < _camera.size(); i++)
+    {
+        if(_camera[i] == '"' || _camera[i] == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += _camera[i];
+    }
+    _camera = escaped;
+}
+
+bool MetricsExporter::enabled() const
+{
+    return !_filePath.empty();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Exports the metrics if the export interval has elapsed
+ * @return false if an error occurred while writing the file
+ **********************************************************************************************************************/
+bool MetricsExporter::maybeExport()
+{
+    if(!enabled() || std::chrono::steady_clock::now() - _lastExport < _interval)
+    {
+        return true;
+    }
+    return exportNow();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Exports the metrics immediately
+ * @return false if an error occurred while writing the file
+ **********************************************************************************************************************/
+bool MetricsExporter::exportNow()
+{
+    if(!enabled())
+    {
+        return true;
+    }
+    _lastExport = std::chrono::steady_clock::now();
+
+    // write to a temporary file and move it into place
+    std::string tempPath = _filePath + ".tmp";
+    {
+        std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::trunc);
+        if(!file)
+        {
+            std::printf("Unable to write metrics file %s \n", tempPath.c_str());
+            return false;
+        }
+        file << (_format == METRICS_JSON ? formatJson() : formatPrometheus());
+    }
+    if(std::rename(tempPath.c_str(), _filePath.c_str()) != 0)
+    {
+        std::printf("Unable to write metrics file %s \n", _filePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Parses the name of a metrics format
+ * @param[in] name format name ("prometheus" or "json")
+ * @param[out] format parsed format
+ * @return false if the name is not recognized
+ **********************************************************************************************************************/
+bool MetricsExporter::parseFormat(const std::string &name, MetricsFormat &format)
+{
+    if(name == "prometheus" || name == "prom")
+    {
+        format = METRICS_PROMETHEUS;
+        return true;
+    }
+    else if(name == "json")
+    {
+        format = METRICS_JSON;
+        return true;
+    }
+    return false;
+}
+
+std::string MetricsExporter::formatPrometheus() const
+{
+    const double quantiles[] = {0.5, 0.95, 0.99};
+    std::ostringstream out;
+    out << "# HELP traffic_stage_latency_seconds Processing latency of each stage of the counting loop\n";
+    out << "# TYPE traffic_stage_latency_seconds summary\n";
+    for(int s = 0; s < NUM_STAGES; s++)
+    {
+        const LatencyHistogram &histogram = _metrics.histogram(static_cast<Stage>(s));
+        std::string labels = std::string("camera=\"") + _camera + "\",stage=\"" +
+            StageMetrics::stageName(static_cast<Stage>(s)) + "\"";
+        for(int q = 0; q < 3; q++)
+        {
+            out << "traffic_stage_latency_seconds{" << labels << ",quantile=\"" << quantiles[q] << "\"} "
+                << histogram.percentileNs(quantiles[q] * 100.0) * 1e-9 << "\n";
+        }
+        out << "traffic_stage_latency_seconds_sum{" << labels << "} " << histogram.sumNs() * 1e-9 << "\n";
+        out << "traffic_stage_latency_seconds_count{" << labels << "} " << histogram.count() << "\n";
+    }
+    out << "# HELP traffic_stage_latency_max_seconds Largest observed latency of each stage\n";
+    out << "# TYPE traffic_stage_latency_max_seconds gauge\n";
+    for(int s = 0; s < NUM_STAGES; s++)
+    {
+        const LatencyHistogram &histogram = _metrics.histogram(static_cast<Stage>(s));
+        out << "traffic_stage_latency_max_seconds{camera=\"" << _camera << "\",stage=\""
+            << StageMetrics::stageName(static_cast<Stage>(s)) << "\"} " << histogram.maxNs() * 1e-9 << "\n";
+    }
+    return out.str();
+}
+
+std::string MetricsExporter::formatJson() const
+{
+    std::ostringstream out;
+    out << "{\"camera\":\"" << _camera << "\",\"stages\":{";
+    for(int s = 0; s < NUM_STAGES; s++)
+    {
+        const LatencyHistogram &histogram = _metrics.histogram(static_cast<Stage>(s));
+        if(s > 0)
+        {
+            out << ",";
+        }
+        out << "\"" << StageMetrics::stageName(static_cast<Stage>(s)) << "\":{"
+            << "\"count\":" << histogram.count()
+            << ",\"p50_ms\":" << histogram.percentileNs(50.0) * 1e-6
+            << ",\"p95_ms\":" << histogram.percentileNs(95.0) * 1e-6
+            << ",\"p99_ms\":" << histogram.percentileNs(99.0) * 1e-6
+            << ",\"max_ms\":" << histogram.maxNs() * 1e-6
+            << ",\"sum_ms\":" << histogram.sumNs() * 1e-6 << "}";
+    }
+    out << "}}\n";
+    return out.str();
+}
@@ -0,0 +1,114 @@
+/***********************************************************************************************************************
+* @file stage_metrics.h
+* @brief low overhead per-stage latency histograms for the traffic counting loop
+*
+* Each processing stage records its duration into a lock-free log-linear (HDR style) histogram. The histograms can be
+* exported periodically as p50/p95/p99 summaries in Prometheus text format or JSON.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_STAGE_METRICS_H
+#define TRAFFIC_STAGE_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// processing stages of the counting loop
+enum Stage {STAGE_DECODE, STAGE_GATE, STAGE_PREPROCESS, STAGE_MOG2, STAGE_MORPHOLOGY, STAGE_CONTOURS,
+    STAGE_COUNTING, STAGE_DISPLAY, STAGE_FRAME, NUM_STAGES};
+
+// supported metrics export formats
+enum MetricsFormat {METRICS_PROMETHEUS, METRICS_JSON};
+
+/*******************************************************************************************************************//**
+ * @brief Lock-free latency histogram with log-linear buckets
+ *
+ * Values are recorded in nanoseconds. Values below 32 get exact buckets, larger values are bucketed by their power of
+ * two and their next four mantissa bits, which bounds the relative error of any reported quantile to about 3%.
+ **********************************************************************************************************************/
+class LatencyHistogram
+{
+    public:
+        static const int SUB_BUCKET_BITS = 5;
+        static const int SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+        static const int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF;
+
+        LatencyHistogram();
+        void record(uint64_t valueNs);
+        void reset();
+        uint64_t count() const;
+        uint64_t sumNs() const;
+        uint64_t maxNs() const;
+        uint64_t percentileNs(double percentile) const;
+
+    private:
+        static int bucketIndex(uint64_t value);
+        static uint64_t bucketMidpoint(int index);
+
+        std::atomic<uint64_t> _buckets[NUM_BUCKETS];
+        std::atomic<uint64_t> _count;
+        std::atomic<uint64_t> _sumNs;
+        std::atomic<uint64_t> _maxNs;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Collection of latency histograms, one for each processing stage
+ **********************************************************************************************************************/
+class StageMetrics
+{
+    public:
+        void record(Stage stage, uint64_t valueNs);
+        const LatencyHistogram &histogram(Stage stage) const;
+        static const char *stageName(Stage stage);
+
+    private:
+        LatencyHistogram _histograms[NUM_STAGES];
+};
+
+/*******************************************************************************************************************//**
+ * @brief Records the lifetime of the object into a stage histogram
+ **********************************************************************************************************************/
+class ScopedStageTimer
+{
+    public:
+        ScopedStageTimer(StageMetrics &metrics, Stage stage);
+        ~ScopedStageTimer();
+
+    private:
+        ScopedStageTimer(const ScopedStageTimer &);
+        ScopedStageTimer &operator=(const ScopedStageTimer &);
+
+        StageMetrics &_metrics;
+        Stage _stage;
+        std::chrono::steady_clock::time_point _start;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Periodically writes the stage metrics to a Prometheus text file or a JSON file
+ *
+ * The file is written to a temporary path and renamed, so scrapers never observe a partially written file.
+ **********************************************************************************************************************/
+class MetricsExporter
+{
+    public:
+        MetricsExporter(const StageMetrics &metrics, const std::string &filePath, MetricsFormat format,
+            double intervalSeconds, const std::string &camera);
+        bool maybeExport();
+        bool exportNow();
+        bool enabled() const;
+        static bool parseFormat(const std::string &name, MetricsFormat &format);
+
+    private:
+        std::string formatPrometheus() const;
+        std::string formatJson() const;
+
+        const StageMetrics &_metrics;
+        std::string _filePath;
+        MetricsFormat _format;
+        std::chrono::steady_clock::duration _interval;
+        std::chrono::steady_clock::time_point _lastExport;
+        std::string _camera;
+};
+
+#endif
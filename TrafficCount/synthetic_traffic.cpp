@@ -0,0 +1,301 @@
+/***********************************************************************************************************************
+* @file synthetic_traffic.cpp
+* @brief deterministic synthetic traffic footage with known vehicle counts
+**********************************************************************************************************************/
+
+#include "synthetic_traffic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// number of precomputed sensor noise patterns cycled through the frames
+#define NUM_NOISE_PATTERNS 4
+
+/*******************************************************************************************************************//**
+ * @brief Creates the default scene configuration (one minute of 1080p footage at 25 fps)
+ **********************************************************************************************************************/
+SceneConfig::SceneConfig():
+    width(1920), height(1080), numFrames(1500), warmupFrames(100), density(0.05), noiseSigma(4.0), seed(12345)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Creates a synthetic scene
+ * @param[in] config scene parameters
+ **********************************************************************************************************************/
+SyntheticTrafficScene::SyntheticTrafficScene(const SceneConfig &config):
+    _config(config), _rng(config.seed), _frameIndex(0), _westBound(0), _eastBound(0)
+{
+    // scale the counting geometry of the 1920x1080 configuration to the scene resolution
+    const double scaleX = _config.width / 1920.0;
+    const double scaleY = _config.height / 1080.0;
+    CounterConfig defaults;
+    _counterConfig.xCordinate = static_cast<int>(std::floor(defaults.xCordinate * scaleX + 0.5));
+    _counterConfig.yCordinate = static_cast<int>(std::floor(defaults.yCordinate * scaleY + 0.5));
+    _counterConfig.deltaX = static_cast<int>(std::floor(defaults.deltaX * scaleX + 0.5));
+    _counterConfig.bandWidth = std::max(4, static_cast<int>(std::floor(defaults.bandWidth * scaleX + 0.5)));
+    _counterConfig.colorSplitY = static_cast<int>(std::floor(defaults.colorSplitY * scaleY + 0.5));
+    _counterConfig.contourAreaLimit = defaults.contourAreaLimit * scaleX * scaleY;
+
+    // moving one band per frame puts every vehicle on its counting line exactly once
+    _speed = _counterConfig.bandWidth;
+
+    // two west bound lanes above the divider and two east bound lanes below it
+    const double laneFractions[] = {0.20, 0.33, 0.55, 0.70};
+    const int laneDirections[] = {-1, -1, 1, 1};
+    for(int i = 0; i < 4; i++)
+    {
+        _laneY.push_back(static_cast<int>(laneFractions[i] * _config.height));
+        _laneDirection.push_back(laneDirections[i]);
+    }
+
+    // render the static road with some texture and lane markings
+    _background = cv::Mat(_config.height, _config.width, CV_8UC3, cv::Scalar(95, 95, 95));
+    cv::Mat texture(_background.size(), CV_16SC3);
+    _rng.fill(texture, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(6));
+    cv::add(_background, texture, _background, cv::noArray(), CV_8UC3);
+    const int markingThickness = std::max(1, _config.height / 270);
+    const int dashLength = std::max(4, _config.width / 48);
+    const int markingY[] = {(_laneY[0] + _laneY[1]) / 2, (_laneY[2] + _laneY[3]) / 2};
+    for(int i = 0; i < 2; i++)
+    {
+        for(int x = 0; x < _config.width; x += 2 * dashLength)
+        {
+            cv::line(_background, cv::Point(x, markingY[i]), cv::Point(x + dashLength, markingY[i]),
+                cv::Scalar(220, 220, 220), markingThickness);
+        }
+    }
+    const int dividerY = (_laneY[1] + _laneY[2]) / 2;
+    cv::line(_background, cv::Point(0, dividerY), cv::Point(_config.width, dividerY), cv::Scalar(40, 200, 230),
+        markingThickness);
+
+    // precompute the sensor noise patterns
+    for(int i = 0; i < NUM_NOISE_PATTERNS && _config.noiseSigma > 0; i++)
+    {
+        cv::Mat noise(_background.size(), CV_16SC3);
+        _rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(_config.noiseSigma));
+        _noise.push_back(noise);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Renders the next frame of the scene and updates the ground truth counts
+ * @param[out] frame rendered BGR frame
+ * @return false once all frames of the scene have been rendered
+ **********************************************************************************************************************/
+bool SyntheticTrafficScene::render(cv::Mat &frame)
+{
+    if(_frameIndex >= _config.numFrames)
+    {
+        return false;
+    }
+
+    // advance the vehicles and drop the ones that left the frame at their exit side
+    std::vector<Vehicle> remaining;
+    for(int i = 0; i < _vehicles.size(); i++)
+    {
+        Vehicle vehicle = _vehicles[i];
+        vehicle.centerX += _laneDirection[vehicle.lane] * _speed;
+        bool exited = _laneDirection[vehicle.lane] < 0 ? vehicle.centerX + vehicle.length / 2 < 0 :
+            vehicle.centerX - vehicle.length / 2 >= _config.width;
+        if(!exited)
+        {
+            remaining.push_back(vehicle);
+        }
+    }
+    _vehicles.swap(remaining);
+    if(_frameIndex >= _config.warmupFrames)
+    {
+        spawnVehicles();
+    }
+
+    // draw the vehicles over the road
+    _background.copyTo(frame);
+    for(int i = 0; i < _vehicles.size(); i++)
+    {
+        const Vehicle &vehicle = _vehicles[i];
+        cv::Rect body(vehicle.centerX - vehicle.length / 2, _laneY[vehicle.lane] - vehicle.height / 2,
+            vehicle.length, vehicle.height);
+        cv::Rect cabin(body.x + body.width / 4, body.y + body.height / 6, body.width / 3, body.height * 2 / 3);
+        cv::rectangle(frame, body, vehicle.bodyColor, cv::FILLED);
+        cv::rectangle(frame, cabin, vehicle.cabinColor, cv::FILLED);
+        countVehicle(body, vehicle.lane);
+    }
+
+    // add sensor noise
+    if(!_noise.empty())
+    {
+        cv::add(frame, _noise[_frameIndex % _noise.size()], frame, cv::noArray(), CV_8UC3);
+    }
+
+    _frameIndex++;
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Randomly adds vehicles to the lanes that have room at their entry side
+ **********************************************************************************************************************/
+void SyntheticTrafficScene::spawnVehicles()
+{
+    const double scaleX = _config.width / 1920.0;
+    const double scaleY = _config.height / 1080.0;
+    const int gap = static_cast<int>(60 * scaleX) + 2 * _speed;
+
+    for(int lane = 0; lane < _laneY.size(); lane++)
+    {
+        // check whether the last vehicle of the lane has cleared the entry side
+        bool clear = true;
+        for(int i = 0; i < _vehicles.size(); i++)
+        {
+            const Vehicle &vehicle = _vehicles[i];
+            if(vehicle.lane != lane)
+            {
+                continue;
+            }
+            int rearX = vehicle.centerX - _laneDirection[lane] * vehicle.length / 2;
+            if((_laneDirection[lane] < 0 && rearX > _config.width - gap) || (_laneDirection[lane] > 0 && rearX < gap))
+            {
+                clear = false;
+            }
+        }
+        if(!clear || _rng.uniform(0.0, 1.0) >= _config.density)
+        {
+            continue;
+        }
+
+        Vehicle vehicle;
+        vehicle.lane = lane;
+        vehicle.length = static_cast<int>(_rng.uniform(200, 280) * scaleX);
+        vehicle.height = static_cast<int>(_rng.uniform(90, 120) * scaleY);
+
+        // start just outside of the frame, in phase with the center of the counting band
+        const int lineX = _laneDirection[lane] < 0 ? _counterConfig.xCordinate :
+            _counterConfig.xCordinate + _counterConfig.deltaX;
+        const int target = lineX + _counterConfig.bandWidth / 2;
+        if(_laneDirection[lane] < 0)
+        {
+            int distance = _config.width + vehicle.length / 2 - target;
+            vehicle.centerX = target + _speed * ((distance + _speed - 1) / _speed);
+        }
+        else
+        {
+            int distance = target + vehicle.length / 2;
+            vehicle.centerX = target - _speed * ((distance + _speed - 1) / _speed);
+        }
+
+        // dark or bright vehicles stand out from the road in grayscale
+        int level = _rng.uniform(0, 2) == 0 ? _rng.uniform(20, 50) : _rng.uniform(170, 240);
+        vehicle.bodyColor = cv::Scalar(std::min(255, std::max(0, level + _rng.uniform(-20, 20))),
+            std::min(255, std::max(0, level + _rng.uniform(-20, 20))),
+            std::min(255, std::max(0, level + _rng.uniform(-20, 20))));
+        vehicle.cabinColor = cv::Scalar(vehicle.bodyColor[0] * 0.6, vehicle.bodyColor[1] * 0.6,
+            vehicle.bodyColor[2] * 0.6);
+        _vehicles.push_back(vehicle);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Applies the counting rule of the pipeline to the true position of a vehicle
+ * @param[in] rect true bounding box of the vehicle
+ * @param[in] lane lane of the vehicle
+ **********************************************************************************************************************/
+void SyntheticTrafficScene::countVehicle(const cv::Rect &rect, int lane)
+{
+    cv::Point midpoint = (cv::Point(rect.x, rect.y) + cv::Point(rect.x + rect.width, rect.y + rect.height)) / 2;
+    const int xCordinate = _counterConfig.xCordinate;
+    const int deltaX = _counterConfig.deltaX;
+    const int bandWidth = _counterConfig.bandWidth;
+    if(_laneDirection[lane] < 0 && midpoint.x > xCordinate && midpoint.x < xCordinate + bandWidth &&
+        midpoint.y < _counterConfig.yCordinate)
+    {
+        _westBound++;
+    }
+    if(_laneDirection[lane] > 0 && midpoint.x > xCordinate + deltaX && midpoint.x < xCordinate + deltaX + bandWidth &&
+        midpoint.y > _counterConfig.yCordinate)
+    {
+        _eastBound++;
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the counting pipeline configuration matching the scene geometry
+ * @return the pipeline configuration
+ **********************************************************************************************************************/
+const CounterConfig &SyntheticTrafficScene::counterConfig() const
+{
+    return _counterConfig;
+}
+
+int SyntheticTrafficScene::frameIndex() const
+{
+    return _frameIndex;
+}
+
+int SyntheticTrafficScene::westBound() const
+{
+    return _westBound;
+}
+
+int SyntheticTrafficScene::eastBound() const
+{
+    return _eastBound;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Parses a scene option from the command line
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @param[in,out] index index of the option, advanced past its value if the option was consumed
+ * @param[in,out] config scene configuration receiving the option value
+ * @return false if the argument is not a scene option
+ **********************************************************************************************************************/
+bool SyntheticTrafficScene::parseOption(int argc, char **argv, int &index, SceneConfig &config)
+{
+    std::string option = argv[index];
+    if(index + 1 >= argc)
+    {
+        return false;
+    }
+    const char *value = argv[index + 1];
+    if(option == "--width")
+    {
+        config.width = std::atoi(value);
+    }
+    else if(option == "--height")
+    {
+        config.height = std::atoi(value);
+    }
+    else if(option == "--frames")
+    {
+        config.numFrames = std::atoi(value);
+    }
+    else if(option == "--warmup")
+    {
+        config.warmupFrames = std::atoi(value);
+    }
+    else if(option == "--density")
+    {
+        config.density = std::atof(value);
+    }
+    else if(option == "--noise")
+    {
+        config.noiseSigma = std::atof(value);
+    }
+    else if(option == "--seed")
+    {
+        config.seed = static_cast<unsigned int>(std::strtoul(value, NULL, 10));
+    }
+    else
+    {
+        return false;
+    }
+    index++;
+    return true;
+}
+
+const char *SyntheticTrafficScene::optionsUsage()
+{
+    return "[--width <pixels>] [--height <pixels>] [--frames <count>] [--warmup <frames>] "
+        "[--density <probability>] [--noise <sigma>] [--seed <seed>]";
+}
@@ -0,0 +1,77 @@
+/***********************************************************************************************************************
+* @file synthetic_traffic.h
+* @brief deterministic synthetic traffic footage with known vehicle counts
+*
+* Renders vehicle-like blobs moving west bound in the upper lanes and east bound in the lower lanes of a static road
+* scene. The counting geometry of the scene is scaled from the default 1920x1080 configuration, and vehicles move
+* exactly one counting band per frame so that each of them is seen on its counting line in exactly one frame.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_SYNTHETIC_TRAFFIC_H
+#define TRAFFIC_SYNTHETIC_TRAFFIC_H
+
+#include <string>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "traffic_counter.h"
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of a synthetic scene
+ **********************************************************************************************************************/
+struct SceneConfig
+{
+    int width;
+    int height;
+    int numFrames;
+    int warmupFrames;
+    double density;
+    double noiseSigma;
+    unsigned int seed;
+
+    SceneConfig();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Generates the frames of a synthetic traffic scene along with the ground truth counts
+ **********************************************************************************************************************/
+class SyntheticTrafficScene
+{
+    public:
+        SyntheticTrafficScene(const SceneConfig &config);
+        bool render(cv::Mat &frame);
+        const CounterConfig &counterConfig() const;
+        int frameIndex() const;
+        int westBound() const;
+        int eastBound() const;
+        static bool parseOption(int argc, char **argv, int &index, SceneConfig &config);
+        static const char *optionsUsage();
+
+    private:
+        struct Vehicle
+        {
+            int lane;
+            int centerX;
+            int length;
+            int height;
+            cv::Scalar bodyColor;
+            cv::Scalar cabinColor;
+        };
+
+        void spawnVehicles();
+        void countVehicle(const cv::Rect &rect, int lane);
+
+        SceneConfig _config;
+        CounterConfig _counterConfig;
+        cv::RNG _rng;
+        cv::Mat _background;
+        std::vector<cv::Mat> _noise;
+        std::vector<int> _laneY;
+        std::vector<int> _laneDirection;
+        std::vector<Vehicle> _vehicles;
+        int _speed;
+        int _frameIndex;
+        int _westBound;
+        int _eastBound;
+};
+
+#endif
@@ -0,0 +1,279 @@
+/***********************************************************************************************************************
+* @file traffic_bench.cpp
+* @brief throughput and accuracy regression benchmark of the counting pipeline on synthetic footage
+*
+* Frames are rendered in memory and only the counting pipeline is timed. The program returns a non-zero code if the
+* count error or the throughput violates the given limits, so it can guard against regressions offline. With a list of
+* thread counts, the scene is processed once per count, with the task pool and the OpenCV backend reconfigured in
+* between, and the speedup of the processing time is reported.
+*
+* Heap allocations are counted with heap_counter.h, which sees the allocations of malloc, operator new and
+* cv::fastMalloc on glibc. Only the allocations made while a frame is processed and drawn are counted, on every thread,
+* so the pool workers running OpenCV stripes are included, and with --output so is the encoder thread.
+**********************************************************************************************************************/
+
+// include necessary dependencies
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "stage_metrics.h"
+#include "synthetic_traffic.h"
+#include "traffic_counter.h"
+#include "frame_pool.h"
+#include "heap_counter.h"
+#include "video_sink.h"
+#include "opencv_task_pool.h"
+#include "scaling_report.h"
+#include "task_pool.h"
+
+/*******************************************************************************************************************//**
+ * @brief Regression limits of a run, negative to disable a limit
+ **********************************************************************************************************************/
+struct BenchLimits
+{
+    int maxError;
+    double minFps;
+    long long maxSteadyAllocations;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Runs the pipeline over the synthetic scene and prints its latencies, throughput and accuracy
+ * @param[in] sceneConfig parameters of the synthetic scene
+ * @param[in] motionGate skip the frames without motion
+ * @param[in] outputPath path of the annotated output video, or empty for none
+ * @param[in] limits regression limits
+ * @param[out] processingSeconds time spent processing the frames
+ * @return true if the run met all limits
+ **********************************************************************************************************************/
+static bool runBenchmark(const SceneConfig &sceneConfig, bool motionGate, const std::string &outputPath,
+    const BenchLimits &limits, double &processingSeconds)
+{
+    // run the pipeline over the synthetic scene, timing only the processing
+    SyntheticTrafficScene scene(sceneConfig);
+    StageMetrics metrics;
+    CounterConfig counterConfig = scene.counterConfig();
+    counterConfig.motionGate = motionGate;
+    TrafficCounter counter(counterConfig, metrics);
+    processingSeconds = 0;
+    long long warmupAllocations = 0;
+    long long countedAllocations = 0;
+
+    // optionally write the annotated frames, so the cost of the output sink is included in the timing
+    const int outputQueue = 16;
+    FramePool framePool(cv::Size(sceneConfig.width, sceneConfig.height), CV_8UC3, outputQueue + 2);
+    AsyncVideoWriter *videoWriter = NULL;
+    if(!outputPath.empty())
+    {
+        videoWriter = new AsyncVideoWriter(framePool, outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), 25,
+            cv::Size(sceneConfig.width, sceneConfig.height), outputQueue, false);
+    }
+
+    int frameSlot = framePool.acquire();
+    while(scene.render(framePool.frame(frameSlot)))
+    {
+        cv::Mat &frame = framePool.frame(frameSlot);
+        // allocations made while the scene is still empty are the warmup of the workspace
+        if(scene.frameIndex() == sceneConfig.warmupFrames + 1)
+        {
+            warmupAllocations = countedAllocations;
+        }
+
+        double startTicks = static_cast<double>(cv::getTickCount());
+        const long long allocationsBefore = HeapCounter::allocations();
+        {
+            ScopedHeapCounting counting;
+            counter.process(frame);
+            if(videoWriter != NULL)
+            {
+                counter.drawVehicles(frame);
+                counter.drawCounts(frame);
+                videoWriter->submit(frameSlot);
+                frameSlot = framePool.acquire();
+            }
+        }
+        countedAllocations += HeapCounter::allocations() - allocationsBefore;
+        double elapsedTime = (static_cast<double>(cv::getTickCount()) - startTicks) / cv::getTickFrequency();
+        metrics.record(STAGE_FRAME, static_cast<uint64_t>(elapsedTime * 1e9));
+        processingSeconds += elapsedTime;
+    }
+    framePool.release(frameSlot);
+    if(videoWriter != NULL)
+    {
+        videoWriter->close();
+        std::cout << "Output video: " << videoWriter->writtenFrames() << " frames written, "
+            << videoWriter->stallSeconds() << " seconds stalled" << std::endl;
+        delete videoWriter;
+    }
+
+    // report the per-stage latencies
+    int frames = scene.frameIndex();
+    double fps = processingSeconds > 0 ? frames / processingSeconds : 0;
+    std::cout << "Scene: " << sceneConfig.width << "x" << sceneConfig.height << ", " << frames << " frames, density "
+        << sceneConfig.density << ", noise " << sceneConfig.noiseSigma << ", seed " << sceneConfig.seed << std::endl;
+    std::cout << std::setw(12) << "stage" << std::setw(12) << "p50 ms" << std::setw(12) << "p95 ms"
+        << std::setw(12) << "p99 ms" << std::setw(12) << "max ms" << std::endl;
+    for(int s = 0; s < NUM_STAGES; s++)
+    {
+        const LatencyHistogram &histogram = metrics.histogram(static_cast<Stage>(s));
+        if(histogram.count() == 0)
+        {
+            continue;
+        }
+        std::cout << std::setw(12) << StageMetrics::stageName(static_cast<Stage>(s)) << std::fixed << std::setprecision(3)
+            << std::setw(12) << histogram.percentileNs(50.0) * 1e-6
+            << std::setw(12) << histogram.percentileNs(95.0) * 1e-6
+            << std::setw(12) << histogram.percentileNs(99.0) * 1e-6
+            << std::setw(12) << histogram.maxNs() * 1e-6 << std::endl;
+    }
+
+    // report the throughput and accuracy
+    int error = std::abs(counter.westBound() - scene.westBound()) + std::abs(counter.eastBound() - scene.eastBound());
+    std::cout << std::setprecision(1) << "FPS: " << fps << std::endl;
+    std::cout << "Frames skipped by motion gate: " << counter.skippedFrames() << " of " << frames << std::endl;
+    std::cout << "WestBound: " << counter.westBound() << " (truth " << scene.westBound() << ")" << std::endl;
+    std::cout << "EastBound: " << counter.eastBound() << " (truth " << scene.eastBound() << ")" << std::endl;
+    std::cout << "Count error: " << error << std::endl;
+    long long steadyAllocations = countedAllocations - warmupAllocations;
+    if(HeapCounter::available())
+    {
+        std::cout << "Heap allocations: " << warmupAllocations << " warmup, " << steadyAllocations << " steady state ("
+            << (frames > sceneConfig.warmupFrames ? static_cast<double>(steadyAllocations) /
+            (frames - sceneConfig.warmupFrames) : 0.0) << " per frame)" << std::endl;
+    }
+    else
+    {
+        std::cout << "Heap allocations: not counted (requires glibc)" << std::endl;
+    }
+
+    // check the regression limits
+    bool passed = true;
+    if(limits.maxError >= 0 && error > limits.maxError)
+    {
+        std::printf("FAIL: count error %d exceeds %d \n", error, limits.maxError);
+        passed = false;
+    }
+    if(limits.minFps >= 0 && fps < limits.minFps)
+    {
+        std::printf("FAIL: throughput %.1f fps is below %.1f fps \n", fps, limits.minFps);
+        passed = false;
+    }
+    if(HeapCounter::available() && limits.maxSteadyAllocations >= 0 && steadyAllocations > limits.maxSteadyAllocations)
+    {
+        std::printf("FAIL: %lld steady state heap allocations exceed %lld \n", steadyAllocations,
+            limits.maxSteadyAllocations);
+        passed = false;
+    }
+    return passed;
+}
+
+/*******************************************************************************************************************//**
+ * @brief program entry point
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @return return code (0 if the benchmark met all limits)
+ **********************************************************************************************************************/
+int main(int argc, char **argv)
+{
+    SceneConfig sceneConfig;
+    BenchLimits limits;
+    limits.maxError = -1;
+    limits.minFps = -1;
+    limits.maxSteadyAllocations = -1;
+    bool motionGate = false;
+    std::string outputPath;
+    PoolConfig poolConfig;
+    std::vector<int> threadCounts;
+
+    // parse the command line arguments
+    for(int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if(SyntheticTrafficScene::parseOption(argc, argv, i, sceneConfig))
+        {
+            continue;
+        }
+        else if(option == "--threads" && i + 1 < argc)
+        {
+            if(!parseThreadCounts(argv[++i], threadCounts))
+            {
+                std::printf("Invalid thread counts %s \n", argv[i]);
+                return 1;
+            }
+        }
+        else if(parsePoolOption(argc, argv, i, poolConfig))
+        {
+            continue;
+        }
+        else if(option == "--max-error" && i + 1 < argc)
+        {
+            limits.maxError = std::atoi(argv[++i]);
+        }
+        else if(option == "--min-fps" && i + 1 < argc)
+        {
+            limits.minFps = std::atof(argv[++i]);
+        }
+        else if(option == "--max-steady-allocations" && i + 1 < argc)
+        {
+            limits.maxSteadyAllocations = std::atoll(argv[++i]);
+        }
+        else if(option == "--motion-gate")
+        {
+            motionGate = true;
+        }
+        else if(option == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else
+        {
+            std::printf("USAGE: %s [--max-error <count>] [--min-fps <fps>] [--max-steady-allocations <count>] [--motion-gate] "
+                "[--output <video_path>] [--threads <count,count,...>] [--affinity none|compact|scatter] "
+                "[--numa-node <node>] %s \n", argv[0], SyntheticTrafficScene::optionsUsage());
+            return 1;
+        }
+    }
+
+    // run the scene once per thread count, or once with the pool as configured
+    ScalingReport report("the counting pipeline");
+    bool passed = true;
+    const size_t numRuns = std::max<size_t>(threadCounts.size(), 1);
+    for(size_t run = 0; run < numRuns; run++)
+    {
+        PoolConfig config = poolConfig;
+        if(!threadCounts.empty())
+        {
+            config.numThreads = threadCounts[run];
+        }
+        TaskPool::configureGlobal(config);
+        useTaskPoolInOpenCV();
+        std::cout << "Threads: " << TaskPool::global().numThreads() << std::endl;
+
+        // every thread count writes its own video, named after the count, e.g. out.mp4 becomes out.threads4.mp4
+        std::string runOutputPath = outputPath;
+        if(threadCounts.size() > 1 && !outputPath.empty())
+        {
+            size_t extension = outputPath.find_last_of('.');
+            size_t directory = outputPath.find_last_of('/');
+            if(extension == std::string::npos || (directory != std::string::npos && extension < directory))
+            {
+                extension = outputPath.size();
+            }
+            runOutputPath = outputPath.substr(0, extension) + ".threads" + std::to_string(config.numThreads) +
+                outputPath.substr(extension);
+        }
+
+        double processingSeconds = 0;
+        passed = runBenchmark(sceneConfig, motionGate, runOutputPath, limits, processingSeconds) && passed;
+        report.add(TaskPool::global().numThreads(), processingSeconds);
+    }
+    if(threadCounts.size() > 1)
+    {
+        report.print();
+    }
+    return passed ? 0 : 1;
+}
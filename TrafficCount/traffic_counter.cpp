@@ -0,0 +1,700 @@
+/***********************************************************************************************************************
+* @file traffic_counter.cpp
+* @brief vehicle counting pipeline shared by the TrafficCount application and its benchmark
+**********************************************************************************************************************/
+
+#include "traffic_counter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include "frame_pool.h"
+#include "heap_counter.h"
+#include "task_pool.h"
+
+// marks left on the traced border pixels of the padded blob image, as by cv::findContours: a traced pixel whose east
+// neighbour was examined while following the border is the right end of a run
+static const signed char BORDER_PIXEL = 2;
+static const signed char BORDER_RIGHT_END = -126;
+
+// combines a row of a mask into another one, pixel by pixel, with the maximum or the minimum
+template<bool Dilate>
+static void combineRows(uchar *destination, const uchar *source, int count)
+{
+    for(int x = 0; x < count; x++)
+    {
+        destination[x] = Dilate ? std::max(destination[x], source[x]) : std::min(destination[x], source[x]);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Applies a square dilation or erosion to a mask, as two separable passes through a row buffer
+ *
+ * Gives the result of cv::dilate or cv::erode with the default 3x3 kernel and radius iterations: the maximum or minimum
+ * over the (2 radius + 1) square window, ignoring the pixels outside of the image.
+ *
+ * @param[in] source mask to filter
+ * @param[out] rowBuffer buffer of the size of the mask, receiving the horizontal pass
+ * @param[out] destination filtered mask, of the size of the mask
+ * @param[in] radius half width of the window (iterations of the 3x3 kernel)
+ **********************************************************************************************************************/
+template<bool Dilate>
+static void filterMask(const cv::Mat &source, cv::Mat &rowBuffer, cv::Mat &destination, int radius)
+{
+    if(radius <= 0)
+    {
+        source.copyTo(destination);
+        return;
+    }
+    const int rows = source.rows;
+    const int cols = source.cols;
+
+    // horizontal pass into the row buffer, then vertical pass into the destination
+    TaskPool::global().parallelFor(0, rows, 16, [&](size_t begin, size_t end)
+    {
+        for(int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+        {
+            const uchar *in = source.ptr<uchar>(y);
+            uchar *out = rowBuffer.ptr<uchar>(y);
+            std::copy(in, in + cols, out);
+            for(int k = 1; k <= radius && k < cols; k++)
+            {
+                combineRows<Dilate>(out, in + k, cols - k);
+                combineRows<Dilate>(out + k, in, cols - k);
+            }
+        }
+    });
+    TaskPool::global().parallelFor(0, rows, 16, [&](size_t begin, size_t end)
+    {
+        for(int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+        {
+            uchar *out = destination.ptr<uchar>(y);
+            const uchar *center = rowBuffer.ptr<uchar>(y);
+            std::copy(center, center + cols, out);
+            for(int neighbour = std::max(0, y - radius); neighbour <= std::min(rows - 1, y + radius); neighbour++)
+            {
+                combineRows<Dilate>(out, rowBuffer.ptr<uchar>(neighbour), cols);
+            }
+        }
+    });
+}
+
+/*******************************************************************************************************************//**
+ * @brief Follows the outer border of a blob, marking its pixels, and measures the polygon it forms
+ *
+ * This is the border following of Suzuki and Abe as implemented by cv::findContours, without storing the points: the
+ * area is the one cv::contourArea gives for the contour, and the box is the one cv::boundingRect gives.
+ *
+ * @param[in,out] start first pixel of the border in the padded blob image, whose west neighbour is background
+ * @param[in] step row step of the padded blob image in bytes
+ * @param[in] origin coordinates of the first pixel in the mask
+ * @param[out] box bounding box of the border
+ * @return the area enclosed by the border
+ **********************************************************************************************************************/
+static double traceOuterBorder(signed char *start, int step, const cv::Point &origin, cv::Rect &box)
+{
+    // the eight neighbours, counterclockwise from east, listed twice so searches can run past the last one
+    static const int codeX[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    static const int codeY[8] = {0, -1, -1, -1, 0, 1, 1, 1};
+    int deltas[16];
+    for(int i = 0; i < 16; i++)
+    {
+        deltas[i] = codeX[i & 7] + codeY[i & 7] * step;
+    }
+
+    // the last pixel of the border is the first blob pixel found clockwise from the west neighbour
+    int s = 4;
+    signed char *last;
+    do
+    {
+        s = (s - 1) & 7;
+        last = start + deltas[s];
+    }
+    while(*last == 0 && s != 4);
+    box = cv::Rect(origin.x, origin.y, 1, 1);
+    if(s == 4)
+    {
+        *start = BORDER_RIGHT_END;
+        return 0;
+    }
+
+    // follow the border counterclockwise until it closes
+    cv::Point point = origin;
+    cv::Point minCorner = origin;
+    cv::Point maxCorner = origin;
+    long long twiceArea = 0;
+    signed char *current = start;
+    for(;;)
+    {
+        const int searchEnd = s;
+        signed char *next = current;
+        while(s < 15)
+        {
+            next = current + deltas[++s];
+            if(*next != 0)
+            {
+                break;
+            }
+        }
+        s &= 7;
+        if(static_cast<unsigned>(s - 1) < static_cast<unsigned>(searchEnd))
+        {
+            *current = BORDER_RIGHT_END;
+        }
+        else if(*current == 1)
+        {
+            *current = BORDER_PIXEL;
+        }
+
+        const cv::Point following(point.x + codeX[s], point.y + codeY[s]);
+        twiceArea += static_cast<long long>(point.x) * following.y - static_cast<long long>(following.x) * point.y;
+        minCorner.x = std::min(minCorner.x, point.x);
+        minCorner.y = std::min(minCorner.y, point.y);
+        maxCorner.x = std::max(maxCorner.x, point.x);
+        maxCorner.y = std::max(maxCorner.y, point.y);
+        point = following;
+        if(next == start && current == last)
+        {
+            break;
+        }
+        current = next;
+        s = (s + 4) & 7;
+    }
+    box = cv::Rect(minCorner.x, minCorner.y, maxCorner.x - minCorner.x + 1, maxCorner.y - minCorner.y + 1);
+    return std::abs(static_cast<double>(twiceArea)) * 0.5;
+}
+
+// adds a row of bytes to a row of sums
+static void accumulateRow(int *sums, const uchar *row, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        sums[i] += row[i];
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Averages blocks of a BGR frame into a smaller grayscale image
+ *
+ * Stands in for cv::resize with INTER_AREA followed by cv::cvtColor. The blocks are the largest that fit the size
+ * ratio, and the weights are the fixed point luma weights of cv::cvtColor. The rows of each block are summed first, so
+ * most of the work runs over whole rows.
+ *
+ * @param[in] frame BGR frame
+ * @param[out] columnSums buffer of the height of the small image and three times the width of the frame, in CV_32SC1
+ * @param[out] small grayscale image, whose size sets the blocks
+ **********************************************************************************************************************/
+static void subsampleGray(const cv::Mat &frame, cv::Mat &columnSums, cv::Mat &small)
+{
+    const int blockWidth = std::max(1, frame.cols / small.cols);
+    const int blockHeight = std::max(1, frame.rows / small.rows);
+    const int width = 3 * small.cols * blockWidth;
+    const long long divisor = static_cast<long long>(blockWidth) * blockHeight << 14;
+    TaskPool::global().parallelFor(0, small.rows, 1, [&](size_t begin, size_t end)
+    {
+        for(int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+        {
+            int *sums = columnSums.ptr<int>(y);
+            std::fill(sums, sums + width, 0);
+            for(int dy = 0; dy < blockHeight; dy++)
+            {
+                accumulateRow(sums, frame.ptr<uchar>(y * blockHeight + dy), width);
+            }
+            uchar *out = small.ptr<uchar>(y);
+            for(int x = 0; x < small.cols; x++)
+            {
+                const int *block = sums + 3 * x * blockWidth;
+                int sumB = 0;
+                int sumG = 0;
+                int sumR = 0;
+                for(int dx = 0; dx < blockWidth; dx++, block += 3)
+                {
+                    sumB += block[0];
+                    sumG += block[1];
+                    sumR += block[2];
+                }
+                const long long weighted = 1868LL * sumB + 9617LL * sumG + 4899LL * sumR;
+                out[x] = static_cast<uchar>((weighted + divisor / 2) / divisor);
+            }
+        }
+    });
+}
+
+/*******************************************************************************************************************//**
+ * @brief Creates the default configuration, tuned for the 1920x1080 highway footage
+ **********************************************************************************************************************/
+CounterConfig::CounterConfig():
+    bgHistory(400), bgThreshold(100), bgShadowDetection(false), maskThreshold(30),
+    morphologySize(1), contourAreaLimit(10000),
+    xCordinate(1060), yCordinate(450), deltaX(100), bandWidth(32), colorSplitY(350),
+    motionGate(false), gateScale(8), gateMargin(300), gateDiffThreshold(25), gateMinPixels(4), gateHangover(10),
+    idleUpdateInterval(8)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Writes the counting line geometry as "key value" lines, e.g. into the ground truth file of a synthetic clip
+ * @param[in] stream output stream
+ * @param[in] config configuration holding the geometry
+ **********************************************************************************************************************/
+void writeCounterGeometry(std::ostream &stream, const CounterConfig &config)
+{
+    stream << "line_x " << config.xCordinate << "\n";
+    stream << "line_y " << config.yCordinate << "\n";
+    stream << "line_delta_x " << config.deltaX << "\n";
+    stream << "band_width " << config.bandWidth << "\n";
+    stream << "color_split_y " << config.colorSplitY << "\n";
+    const std::streamsize precision = stream.precision(17);
+    stream << "contour_area_limit " << config.contourAreaLimit << "\n";
+    stream.precision(precision);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Reads the counting line geometry written by writeCounterGeometry, ignoring the other keys of the file
+ * @param[in] fileName path of the file
+ * @param[in,out] config configuration receiving the geometry
+ * @return false if the file cannot be read or does not hold the complete geometry
+ **********************************************************************************************************************/
+bool readCounterGeometry(const std::string &fileName, CounterConfig &config)
+{
+    std::ifstream file(fileName.c_str());
+    if(!file)
+    {
+        return false;
+    }
+    CounterConfig geometry = config;
+    int found = 0;
+    std::string key;
+    double value;
+    while(file >> key >> value)
+    {
+        int *target = key == "line_x" ? &geometry.xCordinate : key == "line_y" ? &geometry.yCordinate :
+            key == "line_delta_x" ? &geometry.deltaX : key == "band_width" ? &geometry.bandWidth :
+            key == "color_split_y" ? &geometry.colorSplitY : NULL;
+        if(target != NULL)
+        {
+            *target = static_cast<int>(value);
+            found++;
+        }
+        else if(key == "contour_area_limit")
+        {
+            geometry.contourAreaLimit = value;
+            found++;
+        }
+    }
+    if(found != 6)
+    {
+        return false;
+    }
+    config = geometry;
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Creates a counting pipeline
+ * @param[in] config pipeline parameters
+ * @param[in] metrics histograms receiving the latency of each processing stage
+ **********************************************************************************************************************/
+TrafficCounter::TrafficCounter(const CounterConfig &config, StageMetrics &metrics):
+    _config(config), _metrics(metrics), _learningRate(-1), _leftBoundVehicle(0), _rightBoundVehicle(0),
+    _framesProcessed(0), _skippedFrames(0), _idleFrames(0), _hangoverFrames(0), _heapAllocations(0)
+{
+    _pMOG2 = cv::createBackgroundSubtractorMOG2(_config.bgHistory, _config.bgThreshold, _config.bgShadowDetection);
+
+    // reserve room for a busy frame so the per-frame results do not grow in steady state
+    const int reservedVehicles = 64;
+    _blobs.reserve(reservedVehicles);
+    _vehicles.reserve(reservedVehicles);
+    updateCountText();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Processes a frame, updating the background model and the vehicle counts
+ *
+ * The heap allocations made while the frame is processed, by any thread, are added to heapAllocations().
+ *
+ * @param[in] captureFrame BGR input frame
+ **********************************************************************************************************************/
+void TrafficCounter::process(const cv::Mat &captureFrame)
+{
+    const long long allocationsBefore = HeapCounter::allocations();
+    {
+        ScopedHeapCounting counting;
+        processFrame(captureFrame);
+    }
+    _heapAllocations += HeapCounter::allocations() - allocationsBefore;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs the stages of the pipeline on a frame
+ * @param[in] captureFrame BGR input frame
+ **********************************************************************************************************************/
+void TrafficCounter::processFrame(const cv::Mat &captureFrame)
+{
+    // make sure the workspace matches the frame size (only allocates on the first frame)
+    ensureBuffer(_grayFrame, captureFrame.size(), CV_8UC1);
+    ensureBuffer(_fgMask, captureFrame.size(), CV_8UC1);
+    ensureBuffer(_morphBuffer, captureFrame.size(), CV_8UC1);
+    ensureBuffer(_morphRows, captureFrame.size(), CV_8UC1);
+    if(ensureBuffer(_borderImage, cv::Size(captureFrame.cols + 2, captureFrame.rows + 2), CV_8SC1))
+    {
+        _borderImage.setTo(cv::Scalar(0));
+    }
+
+    // skip the expensive stages while nothing moves near the counting lines
+    bool active;
+    {
+        ScopedStageTimer timer(_metrics, STAGE_GATE);
+        active = detectMotion(captureFrame);
+    }
+    _framesProcessed++;
+    if(!active)
+    {
+        _skippedFrames++;
+        _vehicles.clear();
+        _fgMask.setTo(cv::Scalar(0));
+        updateIdleBackground(captureFrame);
+        return;
+    }
+    _idleFrames = 0;
+
+    // pre-process the raw image frame
+    const int rangeMin = 0;
+    const int rangeMax = 255;
+    {
+        ScopedStageTimer timer(_metrics, STAGE_PREPROCESS);
+        cv::cvtColor(captureFrame, _grayFrame, cv::COLOR_BGR2GRAY);
+        cv::normalize(_grayFrame, _grayFrame, rangeMin, rangeMax, cv::NORM_MINMAX, CV_8UC1);
+    }
+
+    // extract the foreground mask from image
+    {
+        ScopedStageTimer timer(_metrics, STAGE_MOG2);
+        _pMOG2->apply(_grayFrame, _fgMask, _learningRate);
+        double maxval = 255;
+        int thresholdType = 0;
+        cv::threshold(_fgMask, _fgMask, _config.maskThreshold, maxval, thresholdType);
+    }
+
+    // close gaps in the foreground blobs, alternating between the two mask buffers
+    {
+        ScopedStageTimer timer(_metrics, STAGE_MORPHOLOGY);
+        cv::Mat *source = &_fgMask;
+        cv::Mat *destination = &_morphBuffer;
+        for(int i = 0; i < 2; i++)
+        {
+            filterMask<true>(*source, _morphRows, *destination, _config.morphologySize);
+            std::swap(source, destination);
+            filterMask<true>(*source, _morphRows, *destination, _config.morphologySize);
+            std::swap(source, destination);
+            filterMask<false>(*source, _morphRows, *destination, _config.morphologySize);
+            std::swap(source, destination);
+        }
+    }
+
+    // compute the bounding boxes of the large blobs
+    {
+        ScopedStageTimer timer(_metrics, STAGE_CONTOURS);
+        findBlobs();
+    }
+
+    // count the vehicles whose midpoint lies on a counting line
+    const int previousWestBound = _leftBoundVehicle;
+    const int previousEastBound = _rightBoundVehicle;
+    {
+        ScopedStageTimer timer(_metrics, STAGE_COUNTING);
+        _vehicles.clear();
+        for(int i = 0; i < _blobs.size(); i++)
+        {
+            cv::Rect drawRect = _blobs[i];
+            cv::Point topLeftCorner = cv::Point(drawRect.x, drawRect.y);
+            cv::Point buttomLeftCorner = cv::Point(drawRect.x + drawRect.width, drawRect.y + drawRect.height);
+            cv::Point midpoint = (topLeftCorner + buttomLeftCorner) / 2;
+
+            int xCordinate = _config.xCordinate;
+            int deltaX = _config.deltaX;
+            if(midpoint.x > xCordinate && midpoint.x < xCordinate + _config.bandWidth)
+            {
+                if(midpoint.y < _config.yCordinate)
+                {
+                    _leftBoundVehicle++;
+                }
+            }
+            if(midpoint.x > xCordinate + deltaX && midpoint.x < xCordinate + deltaX + _config.bandWidth)
+            {
+                if(midpoint.y > _config.yCordinate)
+                {
+                    _rightBoundVehicle++;
+                }
+            }
+            _vehicles.push_back(drawRect);
+        }
+    }
+    if(_leftBoundVehicle != previousWestBound || _rightBoundVehicle != previousEastBound)
+    {
+        updateCountText();
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Collects the bounding boxes of the foreground blobs whose outer contour encloses more than the area limit
+ *
+ * The mask is copied as 0 and 1 into the padded blob image and scanned like cv::findContours does with RETR_EXTERNAL:
+ * the outer border of every blob is followed, except for blobs lying in a hole of another blob. The boxes are the
+ * bounding boxes of the contours, which are those of their minimum area rectangles for axis aligned blobs.
+ **********************************************************************************************************************/
+void TrafficCounter::findBlobs()
+{
+    const int rows = _fgMask.rows;
+    const int cols = _fgMask.cols;
+    for(int y = 0; y < rows; y++)
+    {
+        const uchar *mask = _fgMask.ptr<uchar>(y);
+        signed char *pixel = _borderImage.ptr<signed char>(y + 1) + 1;
+        for(int x = 0; x < cols; x++)
+        {
+            pixel[x] = mask[x] != 0 ? 1 : 0;
+        }
+    }
+
+    // scan the rows, remembering the last traced border pixel to know whether a new blob lies inside another one
+    _blobs.clear();
+    const int step = static_cast<int>(_borderImage.step[0]);
+    for(int y = 1; y <= rows; y++)
+    {
+        signed char *row = _borderImage.ptr<signed char>(y);
+        int lastBorder = 0;
+        int previous = 0;
+        for(int x = 1; x <= cols; x++)
+        {
+            const int pixel = row[x];
+            if(pixel == previous)
+            {
+                continue;
+            }
+            const bool previousTraced = previous != 0 && previous != 1;
+            if(previous == 0 && pixel == 1 && row[lastBorder] <= 0)
+            {
+                cv::Rect box;
+                if(traceOuterBorder(row + x, step, cv::Point(x - 1, y - 1), box) > _config.contourAreaLimit)
+                {
+                    _blobs.push_back(box);
+                }
+                previous = row[x];
+                continue;
+            }
+            if(pixel == 0 && previousTraced)
+            {
+                lastBorder = x - 1;
+            }
+            previous = pixel;
+            if(pixel != 0 && pixel != 1)
+            {
+                lastBorder = x;
+            }
+        }
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Formats the count labels drawn by drawCounts, only when the counts change rather than on every drawn frame
+ **********************************************************************************************************************/
+void TrafficCounter::updateCountText()
+{
+    char text[64];
+    std::snprintf(text, sizeof(text), "WestBound: %d", _leftBoundVehicle);
+    _westText = text;
+    std::snprintf(text, sizeof(text), "EastBound: %d", _rightBoundVehicle);
+    _eastText = text;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Decides whether a frame needs the full pipeline
+ *
+ * The frame is subsampled and compared against the previous subsampled frame within a vertical strip around the
+ * counting lines. Frames are always processed while the background model is still learning, and for a few frames
+ * after the last motion so vehicles leaving the strip are tracked until they are gone.
+ *
+ * @param[in] captureFrame BGR input frame
+ * @return true if the frame must be processed by the full pipeline
+ **********************************************************************************************************************/
+bool TrafficCounter::detectMotion(const cv::Mat &captureFrame)
+{
+    if(!_config.motionGate)
+    {
+        return true;
+    }
+
+    // subsample the frame (cheap compared to the full resolution stages)
+    const int scale = std::max(1, _config.gateScale);
+    cv::Size smallSize(std::max(1, captureFrame.cols / scale), std::max(1, captureFrame.rows / scale));
+    if(ensureBuffer(_gateSmall, smallSize, CV_8UC1) | ensureBuffer(_gatePrevious, smallSize, CV_8UC1) |
+        ensureBuffer(_gateDiff, smallSize, CV_8UC1) |
+        ensureBuffer(_gateSums, cv::Size(3 * captureFrame.cols, smallSize.height), CV_32SC1))
+    {
+        _hangoverFrames = 0;
+        subsampleGray(captureFrame, _gateSums, _gatePrevious);
+        return true;
+    }
+    subsampleGray(captureFrame, _gateSums, _gateSmall);
+
+    // count the changed pixels in the strip around both counting lines
+    int stripBegin = std::max(0, (_config.xCordinate - _config.gateMargin) / scale);
+    int stripEnd = std::min(smallSize.width,
+        (_config.xCordinate + _config.deltaX + _config.bandWidth + _config.gateMargin) / scale + 1);
+    int changedPixels = 0;
+    if(stripEnd > stripBegin)
+    {
+        cv::Rect strip(stripBegin, 0, stripEnd - stripBegin, smallSize.height);
+        cv::Mat diff = _gateDiff(strip);
+        cv::absdiff(_gateSmall(strip), _gatePrevious(strip), diff);
+        cv::threshold(diff, diff, _config.gateDiffThreshold, 255, cv::THRESH_BINARY);
+        changedPixels = cv::countNonZero(diff);
+    }
+    std::swap(_gateSmall, _gatePrevious);
+
+    // keep processing while the background model is learning or shortly after motion
+    bool learning = _learningRate < 0 && _framesProcessed < _config.bgHistory;
+    if(changedPixels >= _config.gateMinPixels || learning)
+    {
+        _hangoverFrames = _config.gateHangover;
+        return true;
+    }
+    if(_hangoverFrames > 0)
+    {
+        _hangoverFrames--;
+        return true;
+    }
+    return false;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Keeps the background model in sync while frames are skipped
+ *
+ * Every idleUpdateInterval-th idle frame is applied to the background model with a learning rate scaled by the
+ * interval, so the model adapts to lighting changes at the same speed as when every frame is processed.
+ *
+ * @param[in] captureFrame BGR input frame
+ **********************************************************************************************************************/
+void TrafficCounter::updateIdleBackground(const cv::Mat &captureFrame)
+{
+    const int interval = std::max(1, _config.idleUpdateInterval);
+    if(++_idleFrames % interval != 0)
+    {
+        return;
+    }
+    double learningRate = _learningRate >= 0 ? _learningRate : 1.0 / _config.bgHistory;
+    learningRate = std::min(1.0, learningRate * interval);
+
+    const int rangeMin = 0;
+    const int rangeMax = 255;
+    {
+        ScopedStageTimer timer(_metrics, STAGE_PREPROCESS);
+        cv::cvtColor(captureFrame, _grayFrame, cv::COLOR_BGR2GRAY);
+        cv::normalize(_grayFrame, _grayFrame, rangeMin, rangeMax, cv::NORM_MINMAX, CV_8UC1);
+    }
+    {
+        ScopedStageTimer timer(_metrics, STAGE_MOG2);
+        _pMOG2->apply(_grayFrame, _morphBuffer, learningRate);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Draws the bounding boxes of the vehicles detected in the last processed frame
+ * @param[in,out] frame image to draw on
+ **********************************************************************************************************************/
+void TrafficCounter::drawVehicles(cv::Mat &frame) const
+{
+    for(int i = 0; i < _vehicles.size(); i++)
+    {
+        const cv::Rect &drawRect = _vehicles[i];
+        cv::Scalar color;
+        if(drawRect.y + drawRect.height / 2 > _config.colorSplitY)
+        {
+            color = cv::Scalar(0,0,255);
+        }
+        else
+        {
+            color = cv::Scalar(0,255,0);
+        }
+        cv::rectangle(frame, drawRect, color);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Draws the counting lines and the current counts
+ * @param[in,out] frame image to draw on
+ **********************************************************************************************************************/
+void TrafficCounter::drawCounts(cv::Mat &frame) const
+{
+    const int xCordinate = _config.xCordinate;
+    const int deltaX = _config.deltaX;
+    cv::line(frame, cv::Point(xCordinate, 0), cv::Point(xCordinate, _config.yCordinate), cv::Scalar(0, 255, 255), 2);
+    cv::line(frame, cv::Point(xCordinate + deltaX, _config.yCordinate), cv::Point(xCordinate + deltaX, frame.rows),
+        cv::Scalar(0, 255, 255), 2);
+
+    const double fontScale = frame.rows / 720.0;
+    const int thickness = std::max(1, frame.rows / 360);
+    cv::putText(frame, _westText, cv::Point(20, static_cast<int>(40 * fontScale)), cv::FONT_HERSHEY_SIMPLEX,
+        fontScale, cv::Scalar(0, 255, 0), thickness);
+    cv::putText(frame, _eastText, cv::Point(20, static_cast<int>(80 * fontScale)), cv::FONT_HERSHEY_SIMPLEX,
+        fontScale, cv::Scalar(0, 0, 255), thickness);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Sets the learning rate passed to the background model
+ * @param[in] learningRate learning rate in [0, 1], or a negative value to let MOG2 choose it from the history length
+ **********************************************************************************************************************/
+void TrafficCounter::setLearningRate(double learningRate)
+{
+    _learningRate = learningRate;
+}
+
+const cv::Ptr<cv::BackgroundSubtractorMOG2> &TrafficCounter::backgroundModel() const
+{
+    return _pMOG2;
+}
+
+const cv::Mat &TrafficCounter::foregroundMask() const
+{
+    return _fgMask;
+}
+
+const CounterConfig &TrafficCounter::config() const
+{
+    return _config;
+}
+
+int TrafficCounter::westBound() const
+{
+    return _leftBoundVehicle;
+}
+
+int TrafficCounter::eastBound() const
+{
+    return _rightBoundVehicle;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of frames skipped by the motion gate
+ * @return the number of skipped frames
+ **********************************************************************************************************************/
+long long TrafficCounter::skippedFrames() const
+{
+    return _skippedFrames;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of heap allocations made while frames were processed
+ *
+ * Allocations are counted on every thread, including the pool workers running the parallel stages. After the first
+ * frames have sized the workspace and the background model, the count stays constant. Allocations made by other
+ * threads at the same time, e.g. by another stream, are counted as well.
+ *
+ * @return the number of allocations, or 0 if heap allocations cannot be counted (see HeapCounter::available)
+ **********************************************************************************************************************/
+long long TrafficCounter::heapAllocations() const
+{
+    return _heapAllocations;
+}
@@ -0,0 +1,118 @@
+/***********************************************************************************************************************
+* @file traffic_counter.h
+* @brief vehicle counting pipeline shared by the TrafficCount application and its benchmark
+*
+* Each frame is converted to grayscale, passed through a MOG2 background subtractor, cleaned up with morphology, and
+* the bounding boxes of large foreground contours are tested against the west and east bound counting lines.
+*
+* An optional motion gate compares subsampled consecutive frames around the counting lines, and skips everything but a
+* reduced rate background update while the road near the lines is empty.
+*
+* Once the workspace has been sized by the first frames, processing a frame makes no heap allocation. The morphology,
+* the contour following and the gate subsampling are implemented here on workspace buffers, as cv::dilate, cv::erode,
+* cv::findContours and cv::resize allocate their state on every call.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_COUNTER_H
+#define TRAFFIC_COUNTER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "stage_metrics.h"
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of the counting pipeline
+ **********************************************************************************************************************/
+struct CounterConfig
+{
+    // background filtering parameters
+    int bgHistory;
+    float bgThreshold;
+    bool bgShadowDetection;
+    double maskThreshold;
+
+    // foreground cleanup and vehicle detection parameters
+    int morphologySize;
+    double contourAreaLimit;
+
+    // counting line geometry
+    int xCordinate;
+    int yCordinate;
+    int deltaX;
+    int bandWidth;
+    int colorSplitY;
+
+    // motion gating parameters
+    bool motionGate;
+    int gateScale;
+    int gateMargin;
+    double gateDiffThreshold;
+    int gateMinPixels;
+    int gateHangover;
+    int idleUpdateInterval;
+
+    CounterConfig();
+};
+
+void writeCounterGeometry(std::ostream &stream, const CounterConfig &config);
+bool readCounterGeometry(const std::string &fileName, CounterConfig &config);
+
+/*******************************************************************************************************************//**
+ * @brief Counts vehicles crossing the west and east bound counting lines
+ **********************************************************************************************************************/
+class TrafficCounter
+{
+    public:
+        TrafficCounter(const CounterConfig &config, StageMetrics &metrics);
+        void process(const cv::Mat &captureFrame);
+        void drawVehicles(cv::Mat &frame) const;
+        void drawCounts(cv::Mat &frame) const;
+        void setLearningRate(double learningRate);
+        const cv::Ptr<cv::BackgroundSubtractorMOG2> &backgroundModel() const;
+        const cv::Mat &foregroundMask() const;
+        const CounterConfig &config() const;
+        int westBound() const;
+        int eastBound() const;
+        long long skippedFrames() const;
+        long long heapAllocations() const;
+
+    private:
+        void processFrame(const cv::Mat &captureFrame);
+        void findBlobs();
+        bool detectMotion(const cv::Mat &captureFrame);
+        void updateIdleBackground(const cv::Mat &captureFrame);
+        void updateCountText();
+
+        CounterConfig _config;
+        StageMetrics &_metrics;
+        cv::Ptr<cv::BackgroundSubtractorMOG2> _pMOG2;
+        double _learningRate;
+        int _leftBoundVehicle;
+        int _rightBoundVehicle;
+
+        // per-stream workspace reused across frames
+        cv::Mat _grayFrame;
+        cv::Mat _fgMask;
+        cv::Mat _morphBuffer;
+        cv::Mat _morphRows;
+        cv::Mat _borderImage;
+        std::vector<cv::Rect> _blobs;
+        std::vector<cv::Rect> _vehicles;
+        std::string _westText;
+        std::string _eastText;
+
+        // motion gate state
+        cv::Mat _gatePrevious;
+        cv::Mat _gateSmall;
+        cv::Mat _gateDiff;
+        cv::Mat _gateSums;
+        long long _framesProcessed;
+        long long _skippedFrames;
+        int _idleFrames;
+        int _hangoverFrames;
+        long long _heapAllocations;
+};
+
+#endif
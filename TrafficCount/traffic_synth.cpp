@@ -0,0 +1,87 @@
+/***********************************************************************************************************************
+* @file traffic_synth.cpp
+* @brief writes synthetic traffic footage with known vehicle counts to a video file
+*
+* The ground truth counts are printed and saved next to the video along with the counting line geometry scaled to the
+* resolution of the clip, so the footage can be replayed through the main TrafficCount application
+* (--geometry <video>.truth) and its output compared against the truth.
+**********************************************************************************************************************/
+
+// include necessary dependencies
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include "opencv2/opencv.hpp"
+#include "synthetic_traffic.h"
+
+// configuration parameters
+#define NUM_COMNMAND_LINE_ARGUMENTS 1
+
+/*******************************************************************************************************************//**
+ * @brief program entry point
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @return return code (0 for normal termination)
+ **********************************************************************************************************************/
+int main(int argc, char **argv)
+{
+    SceneConfig sceneConfig;
+    double fps = 25.0;
+
+    // validate and parse the command line arguments
+    if(argc < NUM_COMNMAND_LINE_ARGUMENTS + 1)
+    {
+        std::printf("USAGE: %s <output_video> [--fps <fps>] %s \n", argv[0], SyntheticTrafficScene::optionsUsage());
+        return 0;
+    }
+    std::string fileName = argv[1];
+    for(int i = NUM_COMNMAND_LINE_ARGUMENTS + 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if(SyntheticTrafficScene::parseOption(argc, argv, i, sceneConfig))
+        {
+            continue;
+        }
+        else if(option == "--fps" && i + 1 < argc)
+        {
+            fps = std::atof(argv[++i]);
+        }
+        else
+        {
+            std::printf("Unknown option %s, terminating program! \n", option.c_str());
+            return 1;
+        }
+    }
+
+    // open the output video
+    cv::VideoWriter writer;
+    if(!writer.open(fileName, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps,
+        cv::Size(sceneConfig.width, sceneConfig.height)))
+    {
+        std::printf("Unable to open output video %s, terminating program! \n", fileName.c_str());
+        return 1;
+    }
+
+    // render and write every frame of the scene
+    SyntheticTrafficScene scene(sceneConfig);
+    cv::Mat frame;
+    while(scene.render(frame))
+    {
+        writer.write(frame);
+    }
+    writer.release();
+
+    // save the ground truth next to the video
+    std::string truthFileName = fileName + ".truth";
+    std::ofstream truthFile(truthFileName.c_str());
+    truthFile << "frames " << scene.frameIndex() << "\n";
+    truthFile << "westbound " << scene.westBound() << "\n";
+    truthFile << "eastbound " << scene.eastBound() << "\n";
+    writeCounterGeometry(truthFile, scene.counterConfig());
+
+    std::cout << "Frames: " << scene.frameIndex() << std::endl;
+    std::cout << "WestBound: " << scene.westBound() << std::endl;
+    std::cout << "EastBound: " << scene.eastBound() << std::endl;
+    return 0;
+}
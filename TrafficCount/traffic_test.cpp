@@ -0,0 +1,147 @@
+/***********************************************************************************************************************
+* @file traffic_test.cpp
+* @brief regression tests of the counting pipeline on synthetic footage, run by ctest
+*
+* Every test prints its measurements and returns false on failure, and the program returns a non-zero code if any test
+* failed.
+**********************************************************************************************************************/
+
+// include necessary dependencies
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "opencv2/opencv.hpp"
+#include "background_seed.h"
+#include "heap_counter.h"
+#include "stage_metrics.h"
+#include "synthetic_traffic.h"
+#include "traffic_counter.h"
+
+/*******************************************************************************************************************//**
+ * @brief Checks that a model seeded from a saved background matches a model that never stopped
+ *
+ * A first counter runs over the whole scene and saves its background seed halfway. A second counter is seeded from that
+ * file and processes the rest of the scene alongside the first one. The seed only holds a single background mode per
+ * pixel, so the masks are allowed to differ by a small share of the pixels, e.g. along the vehicle edges, but not by
+ * the warmup the seed is meant to skip.
+ *
+ * @param[in] seedPath path of the temporary seed file
+ * @return true if the test passed
+ **********************************************************************************************************************/
+static bool testBackgroundSeed(const std::string &seedPath)
+{
+    SceneConfig sceneConfig;
+    sceneConfig.width = 640;
+    sceneConfig.height = 360;
+    sceneConfig.numFrames = 700;
+    const int seedFrame = 400;
+    const double maxMismatch = 0.01;
+
+    SyntheticTrafficScene scene(sceneConfig);
+    StageMetrics metrics;
+    TrafficCounter reference(scene.counterConfig(), metrics);
+    TrafficCounter seeded(scene.counterConfig(), metrics);
+    bool seededRunning = false;
+    double worstMismatch = 0;
+    int comparedFrames = 0;
+
+    cv::Mat frame;
+    cv::Mat difference;
+    while(scene.render(frame))
+    {
+        reference.process(frame);
+        if(seededRunning)
+        {
+            seeded.process(frame);
+            cv::absdiff(reference.foregroundMask(), seeded.foregroundMask(), difference);
+            double mismatch = static_cast<double>(cv::countNonZero(difference)) / difference.total();
+            worstMismatch = std::max(worstMismatch, mismatch);
+            comparedFrames++;
+        }
+        else if(scene.frameIndex() == seedFrame)
+        {
+            long long framesLearned = 0;
+            if(!saveBackgroundSeed(reference.backgroundModel(), seedPath, seedFrame) ||
+                !seedBackgroundModel(seeded.backgroundModel(), seedPath, frame.size(), framesLearned) ||
+                framesLearned != seedFrame)
+            {
+                std::printf("FAIL: background seed: unable to save and load %s \n", seedPath.c_str());
+                std::remove(seedPath.c_str());
+                return false;
+            }
+            seeded.setLearningRate(1.0 / scene.counterConfig().bgHistory);
+            seededRunning = true;
+        }
+    }
+    std::remove(seedPath.c_str());
+
+    std::cout << "background seed: " << comparedFrames << " frames compared, worst mask mismatch "
+        << worstMismatch * 100 << "% of the pixels" << std::endl;
+    if(comparedFrames == 0 || worstMismatch > maxMismatch)
+    {
+        std::printf("FAIL: background seed: masks differ by more than %.1f%% of the pixels \n", maxMismatch * 100);
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Checks that the counter stops allocating once its workspace has been sized
+ *
+ * The scene is empty during its warmup frames, then vehicles cross the counting lines, so the allocations counted after
+ * the warmup are the ones made while blobs are found, tracked and counted.
+ *
+ * @return true if the test passed
+ **********************************************************************************************************************/
+static bool testSteadyAllocations()
+{
+    if(!HeapCounter::available())
+    {
+        std::cout << "steady allocations: not counted (requires glibc)" << std::endl;
+        return true;
+    }
+    SceneConfig sceneConfig;
+    sceneConfig.width = 640;
+    sceneConfig.height = 360;
+    sceneConfig.numFrames = 300;
+
+    SyntheticTrafficScene scene(sceneConfig);
+    StageMetrics metrics;
+    TrafficCounter counter(scene.counterConfig(), metrics);
+    long long warmupAllocations = 0;
+    cv::Mat frame;
+    while(scene.render(frame))
+    {
+        counter.process(frame);
+        if(scene.frameIndex() == sceneConfig.warmupFrames)
+        {
+            warmupAllocations = counter.heapAllocations();
+        }
+    }
+
+    long long steadyAllocations = counter.heapAllocations() - warmupAllocations;
+    std::cout << "steady allocations: " << warmupAllocations << " warmup, " << steadyAllocations << " over "
+        << scene.frameIndex() - sceneConfig.warmupFrames << " frames, " << counter.westBound() + counter.eastBound()
+        << " vehicles counted" << std::endl;
+    if(steadyAllocations != 0)
+    {
+        std::printf("FAIL: steady allocations: %lld heap allocations after the warmup \n", steadyAllocations);
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief program entry point
+ * @return return code (0 if all tests passed)
+ **********************************************************************************************************************/
+int main()
+{
+    // temporary files are written to the working directory, which ctest sets to the build directory
+    bool passed = true;
+    passed = testBackgroundSeed("traffic_test_seed.bin") && passed;
+    passed = testSteadyAllocations() && passed;
+    std::cout << (passed ? "All tests passed" : "Some tests failed") << std::endl;
+    return passed ? 0 : 1;
+}
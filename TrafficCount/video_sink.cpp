@@ -0,0 +1,184 @@
+/***********************************************************************************************************************
+* @file video_sink.cpp
+* @brief asynchronous annotated video output and rate limited logging
+**********************************************************************************************************************/
+
+#include "video_sink.h"
+
+/*******************************************************************************************************************//**
+ * @brief Opens the output video and starts the encoder thread
+ * @param[in] pool frame pool the submitted slots belong to
+ * @param[in] fileName path and name of the output video
+ * @param[in] fourcc codec of the output video
+ * @param[in] fps frame rate of the output video
+ * @param[in] size frame size of the output video
+ * @param[in] queueCapacity maximum number of frames waiting to be encoded
+ * @param[in] dropWhenFull drop frames when the queue is full instead of waiting for the encoder
+ **********************************************************************************************************************/
+AsyncVideoWriter::AsyncVideoWriter(FramePool &pool, const std::string &fileName, int fourcc, double fps,
+    const cv::Size &size, int queueCapacity, bool dropWhenFull):
+    _pool(pool), _queueCapacity(queueCapacity > 0 ? queueCapacity : 1), _dropWhenFull(dropWhenFull),
+    _closing(false), _writtenFrames(0), _droppedFrames(0), _stallTime(0)
+{
+    if(_writer.open(fileName, fourcc, fps, size))
+    {
+        _encoder = std::thread(&AsyncVideoWriter::encoderLoop, this);
+    }
+}
+
+AsyncVideoWriter::~AsyncVideoWriter()
+{
+    close();
+}
+
+bool AsyncVideoWriter::isOpened() const
+{
+    return _writer.isOpened();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Queues a frame for encoding
+ *
+ * Ownership of the slot passes to the writer, which releases it back to the pool once the frame is written or dropped.
+ * If the queue is full the call waits for the encoder, unless the writer was created to drop frames instead.
+ *
+ * @param[in] slot frame pool slot holding the annotated frame
+ **********************************************************************************************************************/
+void AsyncVideoWriter::submit(int slot)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_writer.isOpened() || _closing)
+    {
+        lock.unlock();
+        _pool.release(slot);
+        return;
+    }
+    if(static_cast<int>(_queue.size()) >= _queueCapacity)
+    {
+        if(_dropWhenFull)
+        {
+            _droppedFrames++;
+            lock.unlock();
+            _pool.release(slot);
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while(static_cast<int>(_queue.size()) >= _queueCapacity)
+        {
+            _notFull.wait(lock);
+        }
+        _stallTime += std::chrono::steady_clock::now() - start;
+    }
+    _queue.push_back(slot);
+    _notEmpty.notify_one();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Writes the remaining queued frames, stops the encoder thread and closes the video
+ **********************************************************************************************************************/
+void AsyncVideoWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closing = true;
+    }
+    _notEmpty.notify_all();
+    if(_encoder.joinable())
+    {
+        _encoder.join();
+    }
+    _writer.release();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Encoder thread body, writes queued frames until the writer is closed and the queue is drained
+ **********************************************************************************************************************/
+void AsyncVideoWriter::encoderLoop()
+{
+    while(true)
+    {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(_queue.empty() && !_closing)
+            {
+                _notEmpty.wait(lock);
+            }
+            if(_queue.empty())
+            {
+                return;
+            }
+            slot = _queue.front();
+            _queue.pop_front();
+        }
+        _notFull.notify_one();
+
+        // encode outside of the lock so the capture loop can keep queueing frames
+        _writer.write(_pool.frame(slot));
+        _pool.release(slot);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _writtenFrames++;
+        }
+    }
+}
+
+long long AsyncVideoWriter::writtenFrames() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _writtenFrames;
+}
+
+long long AsyncVideoWriter::droppedFrames() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _droppedFrames;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the total time the capture loop spent waiting for queue space
+ * @return the stall time in seconds
+ **********************************************************************************************************************/
+double AsyncVideoWriter::stallSeconds() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::chrono::duration<double>(_stallTime).count();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Creates a rate limited logger
+ * @param[in] out stream receiving the log lines
+ * @param[in] intervalSeconds minimum time between two log lines
+ **********************************************************************************************************************/
+RateLimitedLogger::RateLimitedLogger(std::ostream &out, double intervalSeconds):
+    _out(out),
+    _interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(intervalSeconds))),
+    _lastLog(std::chrono::steady_clock::now()), _logged(false)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Checks whether the next log line would be emitted, so callers can skip formatting it otherwise
+ * @return true if no line was logged yet or the interval has elapsed
+ **********************************************************************************************************************/
+bool RateLimitedLogger::due() const
+{
+    return !_logged || std::chrono::steady_clock::now() - _lastLog >= _interval;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Emits a log line and restarts the interval
+ * @param[in] message log line without trailing newline
+ **********************************************************************************************************************/
+void RateLimitedLogger::log(const std::string &message)
+{
+    _out << message << '\n';
+    _lastLog = std::chrono::steady_clock::now();
+    _logged = true;
+}
+
+void RateLimitedLogger::flush()
+{
+    _out.flush();
+}
@@ -0,0 +1,77 @@
+/***********************************************************************************************************************
+* @file video_sink.h
+* @brief asynchronous annotated video output and rate limited logging
+*
+* Annotated frames are handed to a dedicated encoder thread through a bounded queue of frame pool slots, so writing
+* evidence video does not stall the capture loop. The frames are not copied: ownership of the pool slot moves to the
+* encoder, which returns it to the pool once the frame is written.
+**********************************************************************************************************************/
+
+#ifndef TRAFFIC_VIDEO_SINK_H
+#define TRAFFIC_VIDEO_SINK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "opencv2/opencv.hpp"
+#include "frame_pool.h"
+
+/*******************************************************************************************************************//**
+ * @brief Writes frames to a video file on a background thread
+ **********************************************************************************************************************/
+class AsyncVideoWriter
+{
+    public:
+        AsyncVideoWriter(FramePool &pool, const std::string &fileName, int fourcc, double fps, const cv::Size &size,
+            int queueCapacity, bool dropWhenFull);
+        ~AsyncVideoWriter();
+        bool isOpened() const;
+        void submit(int slot);
+        void close();
+        long long writtenFrames() const;
+        long long droppedFrames() const;
+        double stallSeconds() const;
+
+    private:
+        AsyncVideoWriter(const AsyncVideoWriter &);
+        AsyncVideoWriter &operator=(const AsyncVideoWriter &);
+        void encoderLoop();
+
+        FramePool &_pool;
+        cv::VideoWriter _writer;
+        int _queueCapacity;
+        bool _dropWhenFull;
+        bool _closing;
+        std::deque<int> _queue;
+        mutable std::mutex _mutex;
+        std::condition_variable _notEmpty;
+        std::condition_variable _notFull;
+        std::thread _encoder;
+        long long _writtenFrames;
+        long long _droppedFrames;
+        std::chrono::steady_clock::duration _stallTime;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Emits log lines at most once per interval, without flushing the stream for every line
+ **********************************************************************************************************************/
+class RateLimitedLogger
+{
+    public:
+        RateLimitedLogger(std::ostream &out, double intervalSeconds);
+        bool due() const;
+        void log(const std::string &message);
+        void flush();
+
+    private:
+        std::ostream &_out;
+        std::chrono::steady_clock::duration _interval;
+        std::chrono::steady_clock::time_point _lastLog;
+        bool _logged;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/***********************************************************************************************************************
+* @file opencv_task_pool.h
+* @brief runs the parallel loops of OpenCV on the process wide task pool
+*
+* Most of the time of the OpenCV applications is spent inside OpenCV, whose filters, color conversions and background
+* subtractors split their images in stripes with cv::parallel_for_. OpenCV 4.5.2 and later accept a custom parallel
+* backend, so the stripes become tasks of the shared pool instead of running on a second set of threads. With older
+* versions, OpenCV keeps its own threads, limited to the size of the pool.
+*
+* The adapter is header only, so the common library itself does not depend on OpenCV.
+**********************************************************************************************************************/
+
+#ifndef COMMON_OPENCV_TASK_POOL_H
+#define COMMON_OPENCV_TASK_POOL_H
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include "task_pool.h"
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || \
+    (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 2)))
+#define COMMON_OPENCV_PARALLEL_BACKEND 1
+#include <opencv2/core/parallel/parallel_backend.hpp>
+
+/*******************************************************************************************************************//**
+ * @brief OpenCV parallel backend forwarding the stripes of every loop to the process wide pool
+ *
+ * The pool is looked up on every loop, so the backend follows TaskPool::configureGlobal. Its size is set by the
+ * application, so cv::setNumThreads has no effect.
+ **********************************************************************************************************************/
+class TaskPoolParallelBackend: public cv::parallel::ParallelForAPI
+{
+    public:
+        virtual void parallel_for(int tasks, FN_parallel_for_body_cb_t bodyCallback, void *callbackData) CV_OVERRIDE
+        {
+            TaskPool::global().parallelFor(0, static_cast<size_t>(tasks), 1, [&](size_t begin, size_t end)
+            {
+                bodyCallback(static_cast<int>(begin), static_cast<int>(end), callbackData);
+            });
+        }
+
+        virtual int getThreadNum() const CV_OVERRIDE
+        {
+            return TaskPool::global().currentThreadIndex();
+        }
+
+        virtual int getNumThreads() const CV_OVERRIDE
+        {
+            return TaskPool::global().numThreads();
+        }
+
+        virtual int setNumThreads(int) CV_OVERRIDE
+        {
+            return TaskPool::global().numThreads();
+        }
+
+        virtual const char *getName() const CV_OVERRIDE
+        {
+            return "task_pool";
+        }
+};
+#endif
+
+/*******************************************************************************************************************//**
+ * @brief Makes OpenCV run its parallel loops on the process wide pool, to call after configuring the pool
+ **********************************************************************************************************************/
+inline void useTaskPoolInOpenCV()
+{
+#ifdef COMMON_OPENCV_PARALLEL_BACKEND
+    cv::parallel::setParallelForBackend(std::make_shared<TaskPoolParallelBackend>(), false);
+#else
+    cv::setNumThreads(TaskPool::global().numThreads());
+#endif
+}
+
+#endif
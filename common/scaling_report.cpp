@@ -0,0 +1,89 @@
+/***********************************************************************************************************************
+* @file scaling_report.cpp
+* @brief table of the speedup of a benchmark from one thread to all cores
+**********************************************************************************************************************/
+
+#include "scaling_report.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+ScalingReport::ScalingReport(const std::string &title):
+    _title(title)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Adds a run
+ * @param[in] numThreads number of threads of the run
+ * @param[in] seconds duration of the run
+ **********************************************************************************************************************/
+void ScalingReport::add(int numThreads, double seconds)
+{
+    Sample sample = {numThreads, seconds};
+    _samples.push_back(sample);
+}
+
+/*******************************************************************************************************************//**
+ * @brief Prints the runs sorted by number of threads, with their speedup and efficiency
+ * @param[in] stream output stream
+ **********************************************************************************************************************/
+void ScalingReport::print(FILE *stream) const
+{
+    std::vector<Sample> samples(_samples);
+    std::stable_sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b)
+    {
+        return a.numThreads < b.numThreads;
+    });
+    std::fprintf(stream, "scaling of %s (%u hardware threads) \n", _title.c_str(), std::thread::hardware_concurrency());
+    std::fprintf(stream, "%8s %12s %9s %11s \n", "threads", "seconds", "speedup", "efficiency");
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        const Sample &base = samples.front();
+        double speedup = samples[i].seconds > 0 ? base.seconds / samples[i].seconds : 0.0;
+        double efficiency = speedup * base.numThreads / std::max(1, samples[i].numThreads);
+        std::fprintf(stream, "%8d %12.4f %8.2fx %10.0f%% \n", samples[i].numThreads, samples[i].seconds, speedup,
+            100.0 * efficiency);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Parses a comma separated list of thread counts, e.g. "1,2,4,8"
+ * @param[in] list text of the list
+ * @param[out] counts thread counts
+ * @return false if an entry is not a positive number
+ **********************************************************************************************************************/
+bool parseThreadCounts(const std::string &list, std::vector<int> &counts)
+{
+    counts.clear();
+    std::stringstream entries(list);
+    std::string entry;
+    while(std::getline(entries, entry, ','))
+    {
+        int count = std::atoi(entry.c_str());
+        if(count <= 0)
+        {
+            return false;
+        }
+        counts.push_back(count);
+    }
+    return !counts.empty();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the thread counts of a default scaling run: the powers of two below the number of hardware threads, then
+ * that number
+ * @param[out] counts thread counts
+ **********************************************************************************************************************/
+void defaultThreadCounts(std::vector<int> &counts)
+{
+    const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    counts.clear();
+    for(int count = 1; count < hardwareThreads; count *= 2)
+    {
+        counts.push_back(count);
+    }
+    counts.push_back(hardwareThreads);
+}
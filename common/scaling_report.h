@@ -0,0 +1,40 @@
+/***********************************************************************************************************************
+* @file scaling_report.h
+* @brief table of the speedup of a benchmark from one thread to all cores
+**********************************************************************************************************************/
+
+#ifndef COMMON_SCALING_REPORT_H
+#define COMMON_SCALING_REPORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*******************************************************************************************************************//**
+ * @brief Collects the time of the same work run with different numbers of threads
+ *
+ * The speedup of each run is relative to the run with the fewest threads, and the efficiency is the speedup divided by
+ * the increase in threads.
+ **********************************************************************************************************************/
+class ScalingReport
+{
+    public:
+        explicit ScalingReport(const std::string &title);
+        void add(int numThreads, double seconds);
+        void print(FILE *stream = stdout) const;
+
+    private:
+        struct Sample
+        {
+            int numThreads;
+            double seconds;
+        };
+
+        std::string _title;
+        std::vector<Sample> _samples;
+};
+
+bool parseThreadCounts(const std::string &list, std::vector<int> &counts);
+void defaultThreadCounts(std::vector<int> &counts);
+
+#endif
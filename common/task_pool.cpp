@@ -0,0 +1,654 @@
+/***********************************************************************************************************************
+* @file task_pool.cpp
+* @brief work-stealing task pool shared by the applications, with cooperative cancellation and core affinity
+**********************************************************************************************************************/
+
+#include "task_pool.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <dirent.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// pool and worker index of the calling thread, -1 outside of the workers
+static thread_local const TaskPool *currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+// process wide pool, created on first use with the configuration given by the application
+static std::mutex globalMutex;
+static std::unique_ptr<TaskPool> globalPool;
+static std::atomic<TaskPool*> globalInstance(nullptr);
+static PoolConfig globalConfig;
+
+/*******************************************************************************************************************//**
+ * @brief State of a parallel loop, owned by the thread that started it
+ **********************************************************************************************************************/
+struct TaskPool::Job
+{
+    const std::function<void(size_t)> *task;
+    const CancellationToken *token;
+    std::atomic<size_t> pending;
+    std::atomic<bool> skipped;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Default configuration: every hardware thread, placed by the system
+ **********************************************************************************************************************/
+PoolConfig::PoolConfig():
+    numThreads(0), affinity(AFFINITY_NONE), numaNode(-1)
+{
+}
+
+CancellationToken::CancellationToken():
+    _flag(std::make_shared<std::atomic<bool> >(false))
+{
+}
+
+void CancellationToken::cancel() const
+{
+    _flag->store(true);
+}
+
+void CancellationToken::reset() const
+{
+    _flag->store(false);
+}
+
+bool CancellationToken::cancelled() const
+{
+    return _flag->load();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Reads a list of cpus in the kernel format, e.g. "0-3,8-11"
+ * @return false if the file cannot be read
+ **********************************************************************************************************************/
+static bool readCpuList(const std::string &fileName, std::vector<int> &cpus)
+{
+    std::ifstream file(fileName.c_str());
+    std::string list;
+    if(!std::getline(file, list))
+    {
+        return false;
+    }
+    std::stringstream ranges(list);
+    std::string range;
+    while(std::getline(ranges, range, ','))
+    {
+        if(range.empty())
+        {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for(int cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Lists the cores the pool may use, in the order the workers are placed on them
+ *
+ * The cores allowed to the process are grouped by NUMA node. Compact placement fills one node before the next, scatter
+ * placement takes one core of each node in turn. Without NUMA information all cores form a single node.
+ *
+ * @param[in] config pool configuration
+ * @param[out] cores ordered core numbers, empty if affinity is not supported
+ **********************************************************************************************************************/
+static void orderedCores(const PoolConfig &config, std::vector<int> &cores)
+{
+    cores.clear();
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return;
+    }
+
+    // group the allowed cores by node
+    std::vector<std::vector<int> > nodes;
+    std::vector<int> nodeIds;
+    const std::string nodeDirectory = "/sys/devices/system/node";
+    DIR *directory = opendir(nodeDirectory.c_str());
+    while(directory != NULL)
+    {
+        struct dirent *entry = readdir(directory);
+        if(entry == NULL)
+        {
+            break;
+        }
+        std::string name(entry->d_name);
+        if(name.compare(0, 4, "node") != 0 || name.size() == 4 || name.find_first_not_of("0123456789", 4) !=
+            std::string::npos)
+        {
+            continue;
+        }
+        std::vector<int> cpus;
+        std::vector<int> usable;
+        if(readCpuList(nodeDirectory + "/" + name + "/cpulist", cpus))
+        {
+            for(size_t i = 0; i < cpus.size(); i++)
+            {
+                if(cpus[i] < CPU_SETSIZE && CPU_ISSET(cpus[i], &allowed))
+                {
+                    usable.push_back(cpus[i]);
+                }
+            }
+        }
+        nodes.push_back(usable);
+        nodeIds.push_back(std::atoi(name.c_str() + 4));
+    }
+    if(directory != NULL)
+    {
+        closedir(directory);
+    }
+    if(nodes.empty())
+    {
+        nodes.resize(1);
+        nodeIds.push_back(0);
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if(CPU_ISSET(cpu, &allowed))
+            {
+                nodes[0].push_back(cpu);
+            }
+        }
+    }
+
+    // order the nodes by number, keeping only the requested node if any
+    std::vector<std::vector<int> > selected;
+    std::vector<int> order(nodes.size());
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = static_cast<int>(i);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return nodeIds[a] < nodeIds[b]; });
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        if(config.numaNode < 0 || nodeIds[order[i]] == config.numaNode)
+        {
+            selected.push_back(nodes[order[i]]);
+        }
+    }
+
+    if(config.affinity == AFFINITY_SCATTER)
+    {
+        for(size_t k = 0; ; k++)
+        {
+            bool any = false;
+            for(size_t n = 0; n < selected.size(); n++)
+            {
+                if(k < selected[n].size())
+                {
+                    cores.push_back(selected[n][k]);
+                    any = true;
+                }
+            }
+            if(!any)
+            {
+                break;
+            }
+        }
+        return;
+    }
+    for(size_t n = 0; n < selected.size(); n++)
+    {
+        cores.insert(cores.end(), selected[n].begin(), selected[n].end());
+    }
+#else
+    (void)config;
+#endif
+}
+
+/*******************************************************************************************************************//**
+ * @brief Starts the worker threads of a pool
+ * @param[in] config number of threads and placement of the workers
+ **********************************************************************************************************************/
+TaskPool::TaskPool(const PoolConfig &config):
+    _numThreads(1), _pinnedThreads(0), _queuedTasks(0), _nextQueue(0), _stop(false)
+{
+    int threads = config.numThreads;
+    if(threads <= 0)
+    {
+        std::vector<int> cores;
+        if(config.numaNode >= 0)
+        {
+            orderedCores(config, cores);
+        }
+        threads = !cores.empty() ? static_cast<int>(cores.size()) :
+            static_cast<int>(std::thread::hardware_concurrency());
+    }
+    _numThreads = std::max(1, threads);
+
+    // the thread starting a loop takes part in it, so one thread fewer is started
+    for(int w = 0; w + 1 < _numThreads; w++)
+    {
+        _queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
+    }
+    for(int w = 0; w + 1 < _numThreads; w++)
+    {
+        _workers.push_back(std::thread(&TaskPool::workerLoop, this, w));
+    }
+    if(config.affinity != AFFINITY_NONE || config.numaNode >= 0)
+    {
+        pinWorkers(config);
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Stops the workers once the queued tasks are done
+ **********************************************************************************************************************/
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+    for(size_t w = 0; w < _workers.size(); w++)
+    {
+        _workers[w].join();
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Places the workers on the cores
+ *
+ * With compact or scatter placement each worker is bound to one core, the first core being left to the thread starting
+ * the loops, whose own affinity is not changed. Without placement but with a NUMA node, the workers may run on any
+ * core of the node.
+ *
+ * @param[in] config pool configuration
+ **********************************************************************************************************************/
+void TaskPool::pinWorkers(const PoolConfig &config)
+{
+#ifdef __linux__
+    std::vector<int> cores;
+    orderedCores(config, cores);
+    if(cores.empty())
+    {
+        return;
+    }
+    for(size_t w = 0; w < _workers.size(); w++)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(config.affinity == AFFINITY_NONE)
+        {
+            for(size_t c = 0; c < cores.size(); c++)
+            {
+                CPU_SET(cores[c], &set);
+            }
+        }
+        else
+        {
+            CPU_SET(cores[(w + 1) % cores.size()], &set);
+        }
+        if(pthread_setaffinity_np(_workers[w].native_handle(), sizeof(set), &set) == 0)
+        {
+            _pinnedThreads++;
+        }
+    }
+#else
+    (void)config;
+#endif
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of threads running the loops, including the thread starting them
+ **********************************************************************************************************************/
+int TaskPool::numThreads() const
+{
+    return _numThreads;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the number of workers whose affinity was set
+ **********************************************************************************************************************/
+int TaskPool::pinnedThreads() const
+{
+    return _pinnedThreads;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the index of the calling thread: 1 to numThreads() - 1 for the workers, 0 for any other thread
+ **********************************************************************************************************************/
+int TaskPool::currentThreadIndex() const
+{
+    return currentPool == this ? currentWorker + 1 : 0;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs a task for every index in [0, numTasks) and waits for all of them
+ *
+ * The tasks are queued on the calling worker, or spread over all workers when called from another thread, and the
+ * calling thread runs queued tasks until none is left. The first exception thrown by a task is rethrown here, after
+ * the remaining tasks have been skipped.
+ *
+ * Once the queues have grown to the largest loop, running a loop does not allocate, provided the task is stored inside
+ * the std::function. The loop helpers of task_pool.h therefore pass lambdas capturing a single reference.
+ *
+ * @param[in] numTasks number of tasks
+ * @param[in] task callable taking the task index
+ * @param[in] token optional cancellation token, checked before every task
+ * @return false if tasks were skipped because of a cancellation
+ **********************************************************************************************************************/
+bool TaskPool::run(size_t numTasks, const std::function<void(size_t)> &task, const CancellationToken *token)
+{
+    // without workers, or with a single task, there is nothing to share
+    if(_workers.empty() || numTasks <= 1)
+    {
+        for(size_t i = 0; i < numTasks; i++)
+        {
+            if(token != NULL && token->cancelled())
+            {
+                return false;
+            }
+            task(i);
+        }
+        return true;
+    }
+
+    Job job;
+    job.task = &task;
+    job.token = token;
+    job.pending.store(numTasks);
+    job.skipped.store(false);
+    job.failed.store(false);
+    job.finished = false;
+
+    // queue the tasks, counting them first so a woken worker never sees more tasks than are counted
+    const int self = currentPool == this ? currentWorker : -1;
+    const size_t numQueues = _queues.size();
+    _queuedTasks.fetch_add(numTasks);
+    if(self >= 0)
+    {
+        std::lock_guard<std::mutex> lock(_queues[self]->mutex);
+        for(size_t i = 0; i < numTasks; i++)
+        {
+            Task queued = {&job, i};
+            _queues[self]->pushBack(queued);
+        }
+    }
+    else
+    {
+        const size_t first = _nextQueue.fetch_add(1);
+        for(size_t q = 0; q < numQueues && q < numTasks; q++)
+        {
+            WorkerQueue &queue = *_queues[(first + q) % numQueues];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for(size_t i = q; i < numTasks; i += numQueues)
+            {
+                Task queued = {&job, i};
+                queue.pushBack(queued);
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wakeUp.notify_all();
+
+    // help until every task is taken, then wait for the ones still running
+    Task next;
+    while(job.pending.load() > 0 && ((self >= 0 && popTask(self, next)) || stealTask(self + 1, next)))
+    {
+        execute(next);
+    }
+    {
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.done.wait(lock, [&]() { return job.finished; });
+    }
+    if(job.error)
+    {
+        std::rethrow_exception(job.error);
+    }
+    return !job.skipped.load();
+}
+
+TaskPool::WorkerQueue::WorkerQueue():
+    head(0), count(0)
+{
+}
+
+/*******************************************************************************************************************//**
+ * @brief Queues a task at the back, doubling the ring when it is full
+ *
+ * Unlike a std::deque, which frees and allocates blocks as tasks are queued and taken, the ring keeps its storage, so
+ * the queues stop allocating once they have held the largest loop.
+ *
+ * @param[in] task task to queue
+ **********************************************************************************************************************/
+void TaskPool::WorkerQueue::pushBack(const Task &task)
+{
+    if(count == ring.size())
+    {
+        std::vector<Task> grown(std::max<size_t>(16, 2 * ring.size()));
+        for(size_t i = 0; i < count; i++)
+        {
+            grown[i] = ring[(head + i) % ring.size()];
+        }
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + count) % ring.size()] = task;
+    count++;
+}
+
+bool TaskPool::WorkerQueue::popBack(Task &task)
+{
+    if(count == 0)
+    {
+        return false;
+    }
+    count--;
+    task = ring[(head + count) % ring.size()];
+    return true;
+}
+
+bool TaskPool::WorkerQueue::popFront(Task &task)
+{
+    if(count == 0)
+    {
+        return false;
+    }
+    task = ring[head];
+    head = (head + 1) % ring.size();
+    count--;
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Takes the most recently queued task of a worker
+ * @return false if the queue is empty
+ **********************************************************************************************************************/
+bool TaskPool::popTask(int worker, Task &task)
+{
+    WorkerQueue &queue = *_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(!queue.popBack(task))
+    {
+        return false;
+    }
+    _queuedTasks.fetch_sub(1);
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Takes the oldest task of the first non-empty queue, starting from a given queue
+ * @return false if every queue is empty
+ **********************************************************************************************************************/
+bool TaskPool::stealTask(int first, Task &task)
+{
+    const size_t numQueues = _queues.size();
+    for(size_t k = 0; k < numQueues; k++)
+    {
+        WorkerQueue &queue = *_queues[(first + k) % numQueues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.popFront(task))
+        {
+            _queuedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs a task, unless its loop was cancelled or failed, and signals the end of the loop after its last task
+ **********************************************************************************************************************/
+void TaskPool::execute(const Task &task)
+{
+    Job &job = *task.job;
+    if(job.token != NULL && job.token->cancelled())
+    {
+        job.skipped.store(true);
+    }
+    else if(!job.failed.load())
+    {
+        try
+        {
+            (*job.task)(task.index);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if(!job.error)
+            {
+                job.error = std::current_exception();
+            }
+            job.failed.store(true);
+        }
+    }
+
+    // the job is owned by the waiting thread, which may return as soon as finished is set
+    if(job.pending.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.finished = true;
+        job.done.notify_all();
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs the queued tasks, own tasks first and stolen ones next, and sleeps while there are none
+ * @param[in] worker index of the worker
+ **********************************************************************************************************************/
+void TaskPool::workerLoop(int worker)
+{
+    currentPool = this;
+    currentWorker = worker;
+    while(true)
+    {
+        Task task;
+        if(popTask(worker, task) || stealTask(worker + 1, task))
+        {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [&]() { return _stop || _queuedTasks.load() > 0; });
+        if(_stop && _queuedTasks.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the process wide pool, creating it with the configuration given to configureGlobal
+ *
+ * Called for every parallel loop, so once the pool is published the call is a single atomic load; the mutex is only
+ * taken to create the pool.
+ **********************************************************************************************************************/
+TaskPool &TaskPool::global()
+{
+    TaskPool *pool = globalInstance.load(std::memory_order_acquire);
+    if(pool != nullptr)
+    {
+        return *pool;
+    }
+    std::lock_guard<std::mutex> lock(globalMutex);
+    if(!globalPool)
+    {
+        globalPool.reset(new TaskPool(globalConfig));
+        globalInstance.store(globalPool.get(), std::memory_order_release);
+    }
+    return *globalPool;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Sets the configuration of the process wide pool
+ *
+ * Meant to be called from main, while no loop is running: a pool already created is replaced, which is how the
+ * benchmarks measure several thread counts in one process.
+ *
+ * @param[in] config pool configuration
+ **********************************************************************************************************************/
+void TaskPool::configureGlobal(const PoolConfig &config)
+{
+    std::lock_guard<std::mutex> lock(globalMutex);
+    globalConfig = config;
+    globalInstance.store(nullptr, std::memory_order_release);
+    globalPool.reset();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Parses a pool option from the command line
+ * @param[in] argc number of command line arguments
+ * @param[in] argv string array of command line arguments
+ * @param[in,out] index index of the option, advanced past its value if the option was consumed
+ * @param[in,out] config pool configuration receiving the option value
+ * @return false if the argument is not a pool option
+ **********************************************************************************************************************/
+bool parsePoolOption(int argc, char **argv, int &index, PoolConfig &config)
+{
+    std::string option = argv[index];
+    if(index + 1 >= argc)
+    {
+        return false;
+    }
+    std::string value = argv[index + 1];
+    if(option == "--threads")
+    {
+        config.numThreads = std::atoi(value.c_str());
+    }
+    else if(option == "--affinity" && (value == "none" || value == "compact" || value == "scatter"))
+    {
+        config.affinity = value == "compact" ? AFFINITY_COMPACT : value == "scatter" ? AFFINITY_SCATTER :
+            AFFINITY_NONE;
+    }
+    else if(option == "--numa-node")
+    {
+        config.numaNode = std::atoi(value.c_str());
+    }
+    else
+    {
+        return false;
+    }
+    index++;
+    return true;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Gets the usage text of the pool options, for the usage messages of the applications
+ **********************************************************************************************************************/
+const char *poolOptionsUsage()
+{
+    return "[--threads <count>] [--affinity none|compact|scatter] [--numa-node <node>]";
+}
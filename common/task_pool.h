@@ -0,0 +1,245 @@
+/***********************************************************************************************************************
+* @file task_pool.h
+* @brief work-stealing task pool shared by the applications, with cooperative cancellation and core affinity
+*
+* A parallel loop is split into tasks that are spread over per-worker queues. Workers take tasks from the back of their
+* own queue and steal from the front of the others once it is empty, so uneven tasks are balanced without a central
+* queue. The thread starting a loop runs tasks as well until the loop is complete, which makes nested loops safe: a
+* task may itself start a parallel loop on the same pool.
+*
+* Each application configures the process wide pool once from its command line, and every parallel loop of the
+* application, including the ones OpenCV runs internally (see opencv_task_pool.h), shares its threads.
+**********************************************************************************************************************/
+
+#ifndef COMMON_TASK_POOL_H
+#define COMMON_TASK_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// placement of the worker threads on the cores: left to the system, packed on as few NUMA nodes as possible, or spread
+// over the nodes
+enum AffinityMode {AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SCATTER};
+
+/*******************************************************************************************************************//**
+ * @brief Parameters of a task pool
+ *
+ * The number of threads includes the thread starting the loops, so a single thread runs everything inline. A NUMA node
+ * of -1 uses the cores of every node, otherwise only the cores of that node are used, and the default number of threads
+ * becomes its number of cores.
+ **********************************************************************************************************************/
+struct PoolConfig
+{
+    int numThreads;
+    AffinityMode affinity;
+    int numaNode;
+
+    PoolConfig();
+};
+
+/*******************************************************************************************************************//**
+ * @brief Flag shared between the code requesting a cancellation and the loops checking it
+ *
+ * Copies of a token share the same flag. Loops skip the tasks that have not started once the flag is set, and long
+ * tasks can poll cancelled() to stop early.
+ **********************************************************************************************************************/
+class CancellationToken
+{
+    public:
+        CancellationToken();
+        void cancel() const;
+        void reset() const;
+        bool cancelled() const;
+
+    private:
+        std::shared_ptr<std::atomic<bool> > _flag;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Pool of worker threads running parallel loops
+ **********************************************************************************************************************/
+class TaskPool
+{
+    public:
+        explicit TaskPool(const PoolConfig &config = PoolConfig());
+        ~TaskPool();
+        int numThreads() const;
+        int pinnedThreads() const;
+        int currentThreadIndex() const;
+        bool run(size_t numTasks, const std::function<void(size_t)> &task, const CancellationToken *token = NULL);
+
+        /***************************************************************************************************************
+         * @brief Runs a function over [begin, end), split in chunks of at least grain elements
+         *
+         * The range is split in about four chunks per thread, so idle threads have chunks left to steal. Rows of an
+         * image, clusters of points or frames of a sequence are all ranges of indices.
+         *
+         * @param[in] begin first index
+         * @param[in] end one past the last index
+         * @param[in] grain minimum number of indices per chunk (0 for 1)
+         * @param[in] function callable taking (chunkBegin, chunkEnd)
+         * @param[in] token optional cancellation token
+         * @return false if the loop was cancelled before all chunks ran
+         **************************************************************************************************************/
+        template<typename Function>
+        bool parallelFor(size_t begin, size_t end, size_t grain, Function function,
+            const CancellationToken *token = NULL)
+        {
+            if(end <= begin)
+            {
+                return token == NULL || !token->cancelled();
+            }
+            const size_t count = end - begin;
+            const size_t chunksPerThread = 4;
+            size_t chunk = (count + chunksPerThread * _numThreads - 1) / (chunksPerThread * _numThreads);
+            chunk = std::max(chunk, std::max<size_t>(grain, 1));
+            const size_t numChunks = (count + chunk - 1) / chunk;
+            struct Chunks
+            {
+                size_t begin;
+                size_t end;
+                size_t size;
+                Function *function;
+            } chunks = {begin, end, chunk, &function};
+            return run(numChunks, [&chunks](size_t c)
+            {
+                const size_t chunkBegin = chunks.begin + c * chunks.size;
+                (*chunks.function)(chunkBegin, std::min(chunks.end, chunkBegin + chunks.size));
+            }, token);
+        }
+
+        static TaskPool &global();
+        static void configureGlobal(const PoolConfig &config);
+
+    private:
+        struct Job;
+
+        // a task is one index of a job, the job outlives its tasks as its caller waits for all of them
+        struct Task
+        {
+            Job *job;
+            size_t index;
+        };
+
+        // circular buffer of tasks, which keeps its storage once it has grown
+        struct WorkerQueue
+        {
+            std::mutex mutex;
+            std::vector<Task> ring;
+            size_t head;
+            size_t count;
+
+            WorkerQueue();
+            void pushBack(const Task &task);
+            bool popBack(Task &task);
+            bool popFront(Task &task);
+        };
+
+        void workerLoop(int worker);
+        bool popTask(int worker, Task &task);
+        bool stealTask(int first, Task &task);
+        void execute(const Task &task);
+        void pinWorkers(const PoolConfig &config);
+
+        int _numThreads;
+        int _pinnedThreads;
+        std::vector<std::unique_ptr<WorkerQueue> > _queues;
+        std::vector<std::thread> _workers;
+        std::atomic<size_t> _queuedTasks;
+        std::atomic<size_t> _nextQueue;
+        std::mutex _sleepMutex;
+        std::condition_variable _wakeUp;
+        bool _stop;
+};
+
+/*******************************************************************************************************************//**
+ * @brief Resolves the number of threads of a loop
+ * @param[in] numThreads requested number of threads, or 0 for the threads of the process wide pool
+ * @return the number of threads (at least 1)
+ **********************************************************************************************************************/
+inline int resolveThreadCount(int numThreads)
+{
+    return numThreads > 0 ? numThreads : TaskPool::global().numThreads();
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs a function on contiguous chunks of [0, count), at most one chunk per thread, on the process wide pool
+ *
+ * Each chunk gets its own index, below the resolved number of threads, so chunks can accumulate into per-thread
+ * buffers. Small ranges are processed as a single chunk.
+ *
+ * @param[in] numThreads number of threads (0 for the threads of the process wide pool)
+ * @param[in] count number of elements
+ * @param[in] function callable taking (begin, end, chunkIndex)
+ * @return the number of chunks the range was split into
+ **********************************************************************************************************************/
+template<typename Function>
+int parallelRanges(int numThreads, size_t count, Function function)
+{
+    const size_t minChunk = 4096;
+    int threads = resolveThreadCount(numThreads);
+    threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(threads, (count + minChunk - 1) / minChunk)));
+    const size_t chunk = (count + threads - 1) / threads;
+    if(threads == 1)
+    {
+        function(static_cast<size_t>(0), count, 0);
+        return 1;
+    }
+    struct Ranges
+    {
+        size_t count;
+        size_t chunk;
+        Function *function;
+    } ranges = {count, chunk, &function};
+    TaskPool::global().run(threads, [&ranges](size_t c)
+    {
+        const size_t begin = std::min(ranges.count, c * ranges.chunk);
+        (*ranges.function)(begin, std::min(ranges.count, begin + ranges.chunk), static_cast<int>(c));
+    });
+    return threads;
+}
+
+/*******************************************************************************************************************//**
+ * @brief Runs a function once for every task in [0, count) on the process wide pool
+ *
+ * Up to numThreads lanes claim the tasks one at a time, which balances tasks of very different costs. Each lane has
+ * its own index, below the resolved number of threads, for per-thread buffers.
+ *
+ * @param[in] numThreads number of threads (0 for the threads of the process wide pool)
+ * @param[in] count number of tasks
+ * @param[in] function callable taking (taskIndex, laneIndex)
+ **********************************************************************************************************************/
+template<typename Function>
+void parallelTasks(int numThreads, size_t count, Function function)
+{
+    const int lanes = static_cast<int>(std::min<size_t>(resolveThreadCount(numThreads), std::max<size_t>(count, 1)));
+    struct Tasks
+    {
+        std::atomic<size_t> next;
+        size_t count;
+        Function *function;
+    } tasks;
+    tasks.next.store(0);
+    tasks.count = count;
+    tasks.function = &function;
+    TaskPool::global().run(lanes, [&tasks](size_t lane)
+    {
+        for(size_t task = tasks.next.fetch_add(1); task < tasks.count; task = tasks.next.fetch_add(1))
+        {
+            (*tasks.function)(task, static_cast<int>(lane));
+        }
+    });
+}
+
+bool parsePoolOption(int argc, char **argv, int &index, PoolConfig &config);
+const char *poolOptionsUsage();
+
+#endif